@@ -7,4 +7,3 @@ make
 cd ..
 mkdir -p bin
 mv build/input_dispi bin
-cp -Rp fonts bin
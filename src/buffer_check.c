@@ -0,0 +1,262 @@
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "state_engine.h"
+#include "tick_scheduler.h"
+#include "triple_buffer.h"
+
+// トリプルバッファの負荷試験用プログラム
+// 書き込みスレッドは待ち時間なしで公開し続け、読み出し側は空回りしながら受け取り続ける。
+// 各バッファは描画用状態と同じ大きさの領域を通し番号で埋めるため、1語でも違えば書き込み途中の状態を読んだことになる。
+// 受け取った通し番号が前回より小さい場合は、古い状態に戻ったものとして数える。
+// --render-sync を指定すると、MVSのtick（59.1856Hz）で公開する書き込みスレッドに対して、固定60Hzで描く場合と
+// 公開ごとのeventfdを待って描く場合（input_dispi の --render-sync）を順に再現し、同じ状態を続けて描いた回数と
+// 描かずに飛ばした状態の数を数える。eventfdを待っても、描画側の起床が遅れてeventfdの値が2以上になると
+// 最新の状態だけを描くため飛ばしは起きうる。その数を遅れた起床として数え、eventfdを待つ場合の繰り返しと飛ばしが
+// 描いたフレームの SYNC_TOLERANCE を超えたら失敗とする（固定60Hzでは約1.4%の繰り返しが起きる）。
+
+#define CHECK_WORDS (sizeof(DrawableSet) / sizeof(uint64_t)) // 描画用状態と同じ大きさにする
+#define SYNC_TICK_NS 16896002.0                              // 状態を公開する周期（MVS）
+#define SYNC_FIXED_NS (1000000000ULL / 60)                   // 固定フレームレートの描画周期
+#define SYNC_TOLERANCE 0.005                                 // eventfd待ちで許す繰り返しと飛ばしの割合
+
+typedef struct
+{
+    uint64_t seq;
+    uint64_t words[CHECK_WORDS];
+} CheckSnapshot;
+
+static CheckSnapshot snapshots[3];
+static TripleBuffer buffer;
+static atomic_bool writer_done;
+
+static void *writer_thread(void *arg)
+{
+    unsigned long count = *(unsigned long *)arg;
+    for (uint64_t seq = 1; seq <= count; seq++)
+    {
+        CheckSnapshot *s = &snapshots[triple_buffer_write_index(&buffer)];
+        s->seq = seq;
+        for (size_t i = 0; i < CHECK_WORDS; i++)
+            s->words[i] = seq;
+        triple_buffer_publish(&buffer);
+    }
+    atomic_store(&writer_done, true);
+    return NULL;
+}
+
+// --render-sync の書き込みスレッドの状態
+static atomic_bool sync_running;
+static int sync_event_fd = -1; // 公開ごとに書き込むeventfd（-1なら知らせない）
+
+/**
+ * @brief 状態管理スレッドと同じくtickごとに状態を公開する。通し番号にはtick番号を入れる。
+ */
+static void *tick_writer_thread(void *arg)
+{
+    TickScheduler *scheduler = arg;
+    tick_scheduler_start(scheduler);
+    for (uint64_t tick = 1; atomic_load(&sync_running); tick++)
+    {
+        tick_scheduler_wait(scheduler);
+        snapshots[triple_buffer_write_index(&buffer)].seq = tick;
+        triple_buffer_publish(&buffer);
+        if (sync_event_fd >= 0)
+        {
+            uint64_t one = 1;
+            if (write(sync_event_fd, &one, sizeof(one)) < 0)
+                perror("[warn] tick eventfd");
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 描画側を固定60Hzもしくはeventfd待ちで seconds 秒動かし、描いた状態の繰り返しと飛ばしを数える。
+ *        数え方は input_dispi の count_rendered_tick と同じ。late には起床が遅れてまとめて受け取った公開の数を返す。
+ */
+static void run_render_sync(bool use_event, int seconds, unsigned long *frames, unsigned long *repeated,
+                            unsigned long *skipped, unsigned long *late)
+{
+    static TickScheduler scheduler;
+    triple_buffer_init(&buffer);
+    memset(snapshots, 0, sizeof(snapshots));
+    tick_scheduler_init(&scheduler, SYNC_TICK_NS);
+    sync_event_fd = use_event ? eventfd(0, EFD_CLOEXEC) : -1;
+    atomic_store(&sync_running, true);
+    pthread_t writer;
+    pthread_create(&writer, NULL, tick_writer_thread, &scheduler);
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    uint64_t end_ns = (uint64_t)next.tv_sec * 1000000000ULL + next.tv_nsec + (uint64_t)seconds * 1000000000ULL;
+    uint64_t last_tick = 0;
+    *frames = *repeated = *skipped = *late = 0;
+    for (;;)
+    {
+        if (use_event)
+        {
+            struct pollfd pfd = {.fd = sync_event_fd, .events = POLLIN};
+            uint64_t ticks = 0;
+            if (poll(&pfd, 1, (int)(SYNC_TICK_NS * 2 / 1e6) + 1) > 0 && read(sync_event_fd, &ticks, sizeof(ticks)) < 0)
+                perror("[warn] tick eventfd");
+            if (ticks > 1)
+                *late += ticks - 1; // 前回の起床から2回以上公開された。最新の状態しか読めないので飛ばしになる
+        }
+        else
+        {
+            next.tv_nsec += SYNC_FIXED_NS;
+            if (next.tv_nsec >= 1000000000)
+            {
+                next.tv_sec++;
+                next.tv_nsec -= 1000000000;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec >= end_ns)
+            break;
+
+        bool updated;
+        uint64_t tick = snapshots[triple_buffer_read_index(&buffer, &updated)].seq;
+        if (tick == 0)
+            continue; // 最初の公開の前
+        if (*frames > 0)
+        {
+            if (tick == last_tick)
+                (*repeated)++;
+            else if (tick > last_tick + 1)
+                *skipped += tick - last_tick - 1;
+        }
+        last_tick = tick;
+        (*frames)++;
+    }
+    atomic_store(&sync_running, false);
+    pthread_join(writer, NULL);
+    if (sync_event_fd >= 0)
+        close(sync_event_fd);
+}
+
+/**
+ * @brief 固定60Hzとeventfd待ちの描画を順に再現して比べる。
+ */
+static int check_render_sync(int seconds)
+{
+    unsigned long frames, repeated, skipped, late;
+    run_render_sync(false, seconds, &frames, &repeated, &skipped, &late);
+    printf("[info] fixed 60 Hz: %lu frames, %lu repeated, %lu skipped over %d s (about %.1f repeats expected)\n", frames,
+           repeated, skipped, seconds, seconds * (60.0 - 1e9 / SYNC_TICK_NS));
+    run_render_sync(true, seconds, &frames, &repeated, &skipped, &late);
+    printf("[info] render sync: %lu frames, %lu repeated, %lu skipped over %d s (%lu states published while the reader "
+           "was late)\n",
+           frames, repeated, skipped, seconds, late);
+    unsigned long allowed = (unsigned long)(frames * SYNC_TOLERANCE);
+    if (frames == 0 || repeated + skipped > allowed)
+    {
+        printf("[error] render sync drew %lu states twice and skipped %lu (at most %lu allowed)\n", repeated, skipped,
+               allowed);
+        return 1;
+    }
+    printf("[info] render sync stayed within %lu repeated or skipped states\n", allowed);
+    return 0;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --count N        number of publishes (default: 2000000)\n"
+            "  --render-sync    compare fixed 60 Hz rendering with waiting for each published tick\n"
+            "  --seconds N      length of each --render-sync run (default: 10)\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"count", required_argument, NULL, 'c'},
+        {"render-sync", no_argument, NULL, 'r'},
+        {"seconds", required_argument, NULL, 's'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    unsigned long count = 2000000;
+    bool render_sync = false;
+    int seconds = 10;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            count = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            render_sync = true;
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        default:
+            print_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (count == 0 || seconds <= 0)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (render_sync)
+        return check_render_sync(seconds);
+
+    triple_buffer_init(&buffer);
+    pthread_t writer;
+    pthread_create(&writer, NULL, writer_thread, &count);
+
+    unsigned long reads = 0, updates = 0, torn = 0, backwards = 0;
+    uint64_t last_seq = 0;
+    bool done = false;
+    while (!done)
+    {
+        // 書き込みが終わった後にもう一度受け取り、最後に公開した状態まで読む
+        done = atomic_load(&writer_done);
+        bool updated;
+        const CheckSnapshot *s = &snapshots[triple_buffer_read_index(&buffer, &updated)];
+        reads++;
+        if (!updated)
+            continue;
+        updates++;
+        uint64_t seq = s->seq;
+        for (size_t i = 0; i < CHECK_WORDS; i++)
+            if (s->words[i] != seq)
+            {
+                torn++;
+                break;
+            }
+        if (seq <= last_seq)
+            backwards++;
+        last_seq = seq;
+    }
+    pthread_join(writer, NULL);
+
+    printf("[info] %lu publishes of %zu bytes, %lu reads, %lu new snapshots (last %llu)\n", count,
+           sizeof(CheckSnapshot), reads, updates, (unsigned long long)last_seq);
+    if (torn || backwards || last_seq != count)
+    {
+        printf("[error] %lu torn, %lu not newer than the previous one, last snapshot %llu of %lu\n", torn, backwards,
+               (unsigned long long)last_seq, count);
+        return 1;
+    }
+    printf("[info] all snapshots complete and in order\n");
+    return 0;
+}
@@ -0,0 +1,202 @@
+#include "draw_list.h"
+
+#include <math.h>
+#include <string.h>
+
+void draw_list_clear(DrawList *list, DrawColor color)
+{
+    draw_list_push(list, DRAW_CMD_CLEAR, color);
+}
+
+void draw_list_gradient_h(DrawList *list, float x, float y, float w, float h, DrawColor left, DrawColor right)
+{
+    DrawCmd *cmd = draw_list_push(list, DRAW_CMD_GRADIENT_H, left);
+    if (!cmd)
+        return;
+    cmd->color2 = right;
+    cmd->rect = (DrawRect){x, y, w, h};
+}
+
+void draw_list_rect_rounded(DrawList *list, float x, float y, float w, float h, float roundness, int segments, DrawColor color)
+{
+    DrawCmd *cmd = draw_list_push(list, DRAW_CMD_RECT_ROUNDED, color);
+    if (!cmd)
+        return;
+    cmd->rect = (DrawRect){x, y, w, h};
+    cmd->param = roundness;
+    cmd->segments = segments;
+}
+
+void draw_list_line(DrawList *list, float x0, float y0, float x1, float y1, float thick, DrawColor color)
+{
+    DrawCmd *cmd = draw_list_push(list, DRAW_CMD_LINE, color);
+    if (!cmd)
+        return;
+    cmd->rect = (DrawRect){x0, y0, x1, y1};
+    cmd->param = thick;
+}
+
+void draw_list_circle(DrawList *list, float x, float y, float radius, DrawColor color)
+{
+    DrawCmd *cmd = draw_list_push(list, DRAW_CMD_CIRCLE, color);
+    if (!cmd)
+        return;
+    cmd->rect = (DrawRect){x, y, 0, 0};
+    cmd->param = radius;
+}
+
+void draw_list_glyphs(DrawList *list, const GlyphQuad *quads, int quad_count, float x, float y, DrawColor color)
+{
+    if (quad_count <= 0)
+        return;
+    DrawCmd *cmd = draw_list_push(list, DRAW_CMD_GLYPHS, color);
+    if (!cmd)
+        return;
+    cmd->rect = (DrawRect){x, y, 0, 0};
+    cmd->quads = quads;
+    cmd->quad_count = quad_count;
+}
+
+void draw_list_layer(DrawList *list, int layer, float x, float y, float w, float h)
+{
+    DrawCmd *cmd = draw_list_push(list, DRAW_CMD_LAYER, (DrawColor){0xFF, 0xFF, 0xFF, 0xFF});
+    if (!cmd)
+        return;
+    cmd->rect = (DrawRect){x, y, w, h};
+    cmd->layer = layer;
+}
+
+void draw_list_polyline(DrawList *list, const DrawVertex *vertices, int vertex_count, float thick)
+{
+    if (vertex_count < 2 || vertex_count > UINT8_MAX)
+        return;
+    if (list->vertex_count + vertex_count > DRAW_LIST_VERTEX_CAPACITY)
+    {
+        list->overflowed = true;
+        return;
+    }
+    DrawCmd *cmd = draw_list_push(list, DRAW_CMD_POLYLINE, vertices[0].color);
+    if (!cmd)
+        return;
+    DrawVertex *dest = &list->vertices[list->vertex_count];
+    memcpy(dest, vertices, sizeof(*dest) * vertex_count);
+    list->vertex_count += vertex_count;
+    cmd->vertices = dest;
+    cmd->quad_count = vertex_count;
+    cmd->param = thick;
+}
+
+void draw_list_triangles(DrawList *list, const DrawTriangles *tris, float x, float y)
+{
+    if (tris->vertex_count < 3)
+        return;
+    DrawCmd *cmd = draw_list_push(list, DRAW_CMD_TRIANGLES, tris->vertices[0].color);
+    if (!cmd)
+        return;
+    cmd->rect = (DrawRect){x, y, 0, 0};
+    cmd->triangles = tris;
+}
+
+/**
+ * @brief 描画命令列を実行したときのドローコール数の見積もりを返す。
+ *        raylib（rlgl）はテクスチャや合成方式が変わるまで描画をまとめて送るため、それと同じ規則で数える。
+ *        テクスチャなしの図形の連続と文字の連続はそれぞれ1回、レイヤーの合成は1枚ごとに1回とする。
+ *        実際の呼び出しを数えたものではなく、バッチの頂点数の上限による分割やraylib内部の描画は含まない。
+ */
+int draw_list_estimate_batches(const DrawList *list)
+{
+    enum
+    {
+        BATCH_NONE,
+        BATCH_SHAPES,
+        BATCH_GLYPHS,
+    } current = BATCH_NONE;
+    int batches = 0;
+    for (int i = 0; i < list->count; i++)
+    {
+        switch (list->cmds[i].type)
+        {
+        case DRAW_CMD_CLEAR:
+            break;
+        case DRAW_CMD_GLYPHS:
+            batches += current != BATCH_GLYPHS;
+            current = BATCH_GLYPHS;
+            break;
+        case DRAW_CMD_LAYER:
+            batches++;
+            current = BATCH_NONE;
+            break;
+        default:
+            batches += current != BATCH_SHAPES;
+            current = BATCH_SHAPES;
+            break;
+        }
+    }
+    return batches;
+}
+
+/**
+ * @brief 三角形を1つ追加する。向きはraylibの矩形と同じ（画面上で反時計回り）に揃える。
+ */
+static inline void add_triangle(DrawTriangles *tris, float x0, float y0, float x1, float y1, float x2, float y2, DrawColor color)
+{
+    DrawVertex *v = &tris->vertices[tris->vertex_count];
+    v[0] = (DrawVertex){x0, y0, color};
+    v[1] = (DrawVertex){x1, y1, color};
+    v[2] = (DrawVertex){x2, y2, color};
+    tris->vertex_count += 3;
+}
+
+static inline void add_rect(DrawTriangles *tris, float x0, float y0, float x1, float y1, DrawColor color)
+{
+    add_triangle(tris, x0, y0, x0, y1, x1, y1, color);
+    add_triangle(tris, x0, y0, x1, y1, x1, y0, color);
+}
+
+/**
+ * @brief 中心(cx, cy)の扇形をsegments個の三角形で追加する。角度はラジアンで、画面下向きが正。
+ */
+static void add_fan(DrawTriangles *tris, float cx, float cy, float radius, float start, float end, int segments, DrawColor color)
+{
+    float step = (end - start) / segments;
+    for (int i = 0; i < segments; i++)
+    {
+        float a0 = start + step * i, a1 = a0 + step;
+        add_triangle(tris, cx, cy, cx + cosf(a1) * radius, cy + sinf(a1) * radius, cx + cosf(a0) * radius,
+                      cy + sinf(a0) * radius, color);
+    }
+}
+
+/**
+ * @brief 角丸矩形を三角形に分割して追加する。DrawRectangleRoundedと同じく短辺に対する角丸率から半径を求める。
+ */
+bool draw_triangles_add_rect_rounded(DrawTriangles *tris, float x, float y, float w, float h, float roundness, int segments,
+                                DrawColor color)
+{
+    if (tris->vertex_count + (5 * 2 + 4 * segments) * 3 > tris->capacity)
+        return false;
+    float r = (w < h ? w : h) * roundness / 2;
+    float x0 = x + r, x1 = x + w - r, y0 = y + r, y1 = y + h - r;
+    add_rect(tris, x0, y0, x1, y1, color);   // 中央
+    add_rect(tris, x0, y, x1, y0, color);    // 上
+    add_rect(tris, x0, y1, x1, y + h, color); // 下
+    add_rect(tris, x, y0, x0, y1, color);    // 左
+    add_rect(tris, x1, y0, x + w, y1, color); // 右
+    const float pi = 3.14159265f;
+    add_fan(tris, x0, y0, r, pi, pi * 1.5f, segments, color);
+    add_fan(tris, x1, y0, r, pi * 1.5f, pi * 2, segments, color);
+    add_fan(tris, x1, y1, r, 0, pi * 0.5f, segments, color);
+    add_fan(tris, x0, y1, r, pi * 0.5f, pi, segments, color);
+    return true;
+}
+
+/**
+ * @brief 塗りつぶし円を三角形に分割して追加する。
+ */
+bool draw_triangles_add_circle(DrawTriangles *tris, float x, float y, float radius, int segments, DrawColor color)
+{
+    if (tris->vertex_count + segments * 3 > tris->capacity)
+        return false;
+    add_fan(tris, x, y, radius, 0, 3.14159265f * 2, segments, color);
+    return true;
+}
@@ -0,0 +1,136 @@
+#ifndef DRAW_LIST_H
+#define DRAW_LIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DRAW_LIST_CAPACITY 1024 // 1フレーム分の描画命令数の上限
+#define DRAW_LIST_MAX_LAYERS 8  // 描画キャッシュとして差し込めるレイヤー数（プレイヤーごとのパネル）
+#define DRAW_LIST_VERTEX_CAPACITY 512 // 1フレーム分の折れ線の頂点数の上限
+
+// 描画命令の種類
+typedef enum
+{
+    DRAW_CMD_CLEAR,        // 全面塗りつぶし
+    DRAW_CMD_GRADIENT_H,   // 横方向グラデーションの矩形
+    DRAW_CMD_RECT_ROUNDED, // 角丸矩形
+    DRAW_CMD_LINE,         // 太さつきの線分
+    DRAW_CMD_CIRCLE,       // 塗りつぶし円
+    DRAW_CMD_GLYPHS,       // フォントテクスチャの矩形列（文字列）
+    DRAW_CMD_LAYER,        // 別に描画済みのレイヤーの合成
+    DRAW_CMD_POLYLINE,     // 頂点ごとに色を持つ太さつきの折れ線
+    DRAW_CMD_TRIANGLES,    // 事前に分割済みの三角形列（CPU側の頂点列）
+} DrawCmdType;
+
+// raylibのColorと同じ並びの色
+typedef struct
+{
+    uint8_t r, g, b, a;
+} DrawColor;
+
+typedef struct
+{
+    float x, y, width, height;
+} DrawRect;
+
+// 1文字分の描画矩形
+typedef struct
+{
+    DrawRect dst; // 描画位置からの相対座標
+    DrawRect uv;  // フォントテクスチャ上の正規化座標
+} GlyphQuad;
+
+// 折れ線の頂点
+typedef struct
+{
+    float x, y;
+    DrawColor color;
+} DrawVertex;
+
+// 事前に分割済みの三角形列
+// 位置の変わらない図形を起動時に一度だけ三角形に分割しておき、毎フレームは命令から参照するだけにする。
+// 頂点はCPU側に保持するだけで、GPUのバッファには置かない。raylibでは毎フレーム頂点をrlglのバッチに積み直すため、
+// 省けるのは分割の計算で、頂点の転送は残る。頂点領域は呼び出し側が用意する。
+typedef struct
+{
+    int vertex_count;
+    int capacity;
+    DrawVertex *vertices; // 3頂点ごとに1つの三角形
+} DrawTriangles;
+
+// 描画命令
+// 座標の意味は種類ごとに異なる。
+//   GRADIENT_H   : rect=矩形 color=左端 color2=右端
+//   RECT_ROUNDED : rect=矩形 param=角丸率 segments=角の分割数
+//   LINE         : rect.x,y=始点 rect.width,height=終点 param=太さ
+//   CIRCLE       : rect.x,y=中心 param=半径
+//   GLYPHS       : rect.x,y=描画位置 quads/quad_count=文字の矩形
+//   LAYER        : rect=合成先の矩形 layer=レイヤー番号
+//   POLYLINE     : vertices/quad_count=頂点列（命令列が持つ頂点領域を指す） param=太さ
+//   TRIANGLES    : rect.x,y=平行移動量 triangles=三角形列
+typedef struct
+{
+    uint8_t type;
+    uint8_t segments;
+    uint8_t layer;
+    uint8_t quad_count; // GLYPHSの矩形数、POLYLINEの頂点数
+    DrawColor color;
+    DrawColor color2;
+    DrawRect rect;
+    float param;
+    union
+    {
+        const GlyphQuad *quads;
+        const DrawVertex *vertices;
+        const DrawTriangles *triangles;
+    };
+} DrawCmd;
+
+// 1フレーム分の描画命令列
+// 固定長で確保しておき、毎フレームのメモリ確保をしない。
+// 折れ線の頂点も命令列の中に持ち、命令からはそこを指す。
+typedef struct
+{
+    int count;
+    bool overflowed; // 上限を超えて命令を捨てたかどうか
+    int vertex_count;
+    DrawCmd cmds[DRAW_LIST_CAPACITY];
+    DrawVertex vertices[DRAW_LIST_VERTEX_CAPACITY];
+} DrawList;
+
+static inline void draw_list_reset(DrawList *list)
+{
+    list->count = 0;
+    list->overflowed = false;
+    list->vertex_count = 0;
+}
+
+static inline DrawCmd *draw_list_push(DrawList *list, DrawCmdType type, DrawColor color)
+{
+    if (list->count >= DRAW_LIST_CAPACITY)
+    {
+        list->overflowed = true;
+        return NULL;
+    }
+    DrawCmd *cmd = &list->cmds[list->count++];
+    *cmd = (DrawCmd){.type = type, .color = color};
+    return cmd;
+}
+
+void draw_list_clear(DrawList *list, DrawColor color);
+void draw_list_gradient_h(DrawList *list, float x, float y, float w, float h, DrawColor left, DrawColor right);
+void draw_list_rect_rounded(DrawList *list, float x, float y, float w, float h, float roundness, int segments, DrawColor color);
+void draw_list_line(DrawList *list, float x0, float y0, float x1, float y1, float thick, DrawColor color);
+void draw_list_circle(DrawList *list, float x, float y, float radius, DrawColor color);
+void draw_list_glyphs(DrawList *list, const GlyphQuad *quads, int quad_count, float x, float y, DrawColor color);
+void draw_list_layer(DrawList *list, int layer, float x, float y, float w, float h);
+void draw_list_polyline(DrawList *list, const DrawVertex *vertices, int vertex_count, float thick);
+void draw_list_triangles(DrawList *list, const DrawTriangles *tris, float x, float y);
+int draw_list_estimate_batches(const DrawList *list);
+
+bool draw_triangles_add_rect_rounded(DrawTriangles *tris, float x, float y, float w, float h, float roundness, int segments,
+                                DrawColor color);
+bool draw_triangles_add_circle(DrawTriangles *tris, float x, float y, float radius, int segments, DrawColor color);
+
+#endif
@@ -0,0 +1,182 @@
+#include "draw_raylib.h"
+
+#include <math.h>
+#include "rlgl.h"
+
+static inline Color to_color(DrawColor c)
+{
+    return (Color){c.r, c.g, c.b, c.a};
+}
+
+/**
+ * @brief 連続する文字描画命令の矩形数を数える。1つの矩形列として送るための事前確認用。
+ */
+static int count_glyph_run(const DrawList *list, int start, int *end)
+{
+    int quads = 0, i = start;
+    for (; i < list->count && list->cmds[i].type == DRAW_CMD_GLYPHS; i++)
+        quads += list->cmds[i].quad_count;
+    *end = i;
+    return quads;
+}
+
+/**
+ * @brief 連続する文字描画命令をフォントテクスチャの1つの矩形列としてまとめて送る。
+ */
+static void draw_glyph_run(const DrawList *list, int start, int end, Texture2D glyphs, int quads)
+{
+    rlCheckRenderBatchLimit(quads * 4);
+    rlSetTexture(glyphs.id);
+    rlBegin(RL_QUADS);
+    rlNormal3f(0.0f, 0.0f, 1.0f);
+    for (int i = start; i < end; i++)
+    {
+        const DrawCmd *cmd = &list->cmds[i];
+        rlColor4ub(cmd->color.r, cmd->color.g, cmd->color.b, cmd->color.a);
+        for (int k = 0; k < cmd->quad_count; k++)
+        {
+            const GlyphQuad *q = &cmd->quads[k];
+            float x0 = cmd->rect.x + q->dst.x, y0 = cmd->rect.y + q->dst.y;
+            float x1 = x0 + q->dst.width, y1 = y0 + q->dst.height;
+            float u0 = q->uv.x, v0 = q->uv.y;
+            float u1 = u0 + q->uv.width, v1 = v0 + q->uv.height;
+            rlTexCoord2f(u0, v0);
+            rlVertex2f(x0, y0);
+            rlTexCoord2f(u0, v1);
+            rlVertex2f(x0, y1);
+            rlTexCoord2f(u1, v1);
+            rlVertex2f(x1, y1);
+            rlTexCoord2f(u1, v0);
+            rlVertex2f(x1, y0);
+        }
+    }
+    rlEnd();
+    rlSetTexture(0);
+}
+
+/**
+ * @brief 折れ線を1つの三角形列として送る。線分ごとにDrawLineExを呼ぶ場合と同じく端に丸みのない矩形を並べ、
+ *        両端の頂点の色で補間する。
+ */
+static void draw_polyline(const DrawCmd *cmd)
+{
+    int segments = cmd->quad_count - 1;
+    float half = cmd->param / 2;
+    rlCheckRenderBatchLimit(segments * 6);
+    rlBegin(RL_TRIANGLES);
+    for (int k = 0; k < segments; k++)
+    {
+        const DrawVertex *a = &cmd->vertices[k], *b = &cmd->vertices[k + 1];
+        float dx = b->x - a->x, dy = b->y - a->y;
+        float len = sqrtf(dx * dx + dy * dy);
+        if (len <= 0)
+            continue;
+        float nx = -dy / len * half, ny = dx / len * half;
+        // 背面カリングで消えないよう、raylibの矩形と同じ向き（a-n, a+n, b+n / a-n, b+n, b-n）で並べる
+        rlColor4ub(a->color.r, a->color.g, a->color.b, a->color.a);
+        rlVertex2f(a->x - nx, a->y - ny);
+        rlVertex2f(a->x + nx, a->y + ny);
+        rlColor4ub(b->color.r, b->color.g, b->color.b, b->color.a);
+        rlVertex2f(b->x + nx, b->y + ny);
+        rlColor4ub(a->color.r, a->color.g, a->color.b, a->color.a);
+        rlVertex2f(a->x - nx, a->y - ny);
+        rlColor4ub(b->color.r, b->color.g, b->color.b, b->color.a);
+        rlVertex2f(b->x + nx, b->y + ny);
+        rlVertex2f(b->x - nx, b->y - ny);
+    }
+    rlEnd();
+}
+
+/**
+ * @brief 分割済みの三角形列を平行移動してrlglのバッチに積む。
+ *        頂点はCPU側の頂点列から毎フレーム送り直す。図形ごとにGPUのバッファから描くと図形の数だけ
+ *        ドローコールが増えるため、他の図形と同じバッチにまとめる方を選んでいる。
+ */
+static void draw_triangles(const DrawCmd *cmd)
+{
+    const DrawTriangles *tris = cmd->triangles;
+    float ox = cmd->rect.x, oy = cmd->rect.y;
+    rlCheckRenderBatchLimit(tris->vertex_count);
+    rlBegin(RL_TRIANGLES);
+    for (int i = 0; i < tris->vertex_count; i++)
+    {
+        const DrawVertex *v = &tris->vertices[i];
+        rlColor4ub(v->color.r, v->color.g, v->color.b, v->color.a);
+        rlVertex2f(v->x + ox, v->y + oy);
+    }
+    rlEnd();
+}
+
+/**
+ * @brief 透過の描画先に、アルファも重ねた値（乗算済みアルファ）が残るよう合成方法を設定する。
+ *        色は通常どおり重ね、アルファは 1-(1-a)(1-a') にする。
+ */
+static void begin_alpha_output(void)
+{
+    rlSetBlendFactorsSeparate(RL_SRC_ALPHA, RL_ONE_MINUS_SRC_ALPHA, RL_ONE, RL_ONE_MINUS_SRC_ALPHA, RL_FUNC_ADD, RL_FUNC_ADD);
+    BeginBlendMode(BLEND_CUSTOM_SEPARATE);
+}
+
+/**
+ * @brief 描画命令列をraylibで描画する。
+ *        レイヤー合成の命令は乗算済みアルファで保持したレンダーテクスチャを貼る。
+ *        alpha_outputが真のときは透過の描画先向けに乗算済みアルファで描く。
+ */
+void draw_list_execute_raylib(const DrawList *list, Texture2D glyphs, const RenderTexture2D *layers, bool alpha_output)
+{
+    if (alpha_output)
+        begin_alpha_output();
+    for (int i = 0; i < list->count;)
+    {
+        const DrawCmd *cmd = &list->cmds[i];
+        const DrawRect *r = &cmd->rect;
+        switch (cmd->type)
+        {
+        case DRAW_CMD_CLEAR:
+            ClearBackground(to_color(cmd->color));
+            break;
+        case DRAW_CMD_GRADIENT_H:
+            DrawRectangleGradientH(r->x, r->y, r->width, r->height, to_color(cmd->color), to_color(cmd->color2));
+            break;
+        case DRAW_CMD_RECT_ROUNDED:
+            DrawRectangleRounded((Rectangle){r->x, r->y, r->width, r->height}, cmd->param, cmd->segments,
+                                 to_color(cmd->color));
+            break;
+        case DRAW_CMD_LINE:
+            DrawLineEx((Vector2){r->x, r->y}, (Vector2){r->width, r->height}, cmd->param, to_color(cmd->color));
+            break;
+        case DRAW_CMD_CIRCLE:
+            DrawCircleV((Vector2){r->x, r->y}, cmd->param, to_color(cmd->color));
+            break;
+        case DRAW_CMD_GLYPHS:
+        {
+            int end;
+            int quads = count_glyph_run(list, i, &end);
+            draw_glyph_run(list, i, end, glyphs, quads);
+            i = end;
+            continue;
+        }
+        case DRAW_CMD_POLYLINE:
+            draw_polyline(cmd);
+            break;
+        case DRAW_CMD_TRIANGLES:
+            draw_triangles(cmd);
+            break;
+        case DRAW_CMD_LAYER:
+            if (layers && cmd->layer < DRAW_LIST_MAX_LAYERS)
+            {
+                // レンダーテクスチャは上下反転して保持されている
+                BeginBlendMode(BLEND_ALPHA_PREMULTIPLY);
+                DrawTextureRec(layers[cmd->layer].texture, (Rectangle){0, 0, r->width, -r->height},
+                               (Vector2){r->x, r->y}, WHITE);
+                EndBlendMode();
+                if (alpha_output)
+                    begin_alpha_output();
+            }
+            break;
+        }
+        i++;
+    }
+    if (alpha_output)
+        EndBlendMode();
+}
@@ -0,0 +1,10 @@
+#ifndef DRAW_RAYLIB_H
+#define DRAW_RAYLIB_H
+
+#include <stdbool.h>
+#include "raylib.h"
+#include "draw_list.h"
+
+void draw_list_execute_raylib(const DrawList *list, Texture2D glyphs, const RenderTexture2D *layers, bool alpha_output);
+
+#endif
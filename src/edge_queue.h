@@ -0,0 +1,65 @@
+#ifndef EDGE_QUEUE_H
+#define EDGE_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "input_edge.h"
+
+#define EDGE_QUEUE_SIZE 1024 // 2のべき乗。1tick中に届くエッジ数に対して十分大きくしておく
+#define EDGE_QUEUE_MASK (EDGE_QUEUE_SIZE - 1)
+#define CACHE_LINE_SIZE 64
+
+// 入力検知スレッドから状態管理スレッドへエッジを渡す単一生産者・単一消費者のリングバッファ
+// 生産者はheadだけ、消費者はtailだけを書き換えるためロックなしで互いに待つことがない。
+// head/tailは偽共有しないようにキャッシュラインを分けている。
+// 満杯時は新しいエッジを捨てて溢れ数を数える。エッジは変化後のワード全体を持つため、
+// 取りこぼしても次のエッジで状態は正しく戻る。
+typedef struct
+{
+    _Alignas(CACHE_LINE_SIZE) atomic_uint head;        // 次に書き込む位置（生産者）
+    _Alignas(CACHE_LINE_SIZE) atomic_uint tail;        // 次に読み出す位置（消費者）
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong overflows;  // 満杯で捨てたエッジ数
+    InputEdge slots[EDGE_QUEUE_SIZE];
+} EdgeQueue;
+
+/**
+ * @brief エッジを追加する。満杯なら溢れ数を加算してfalseを返す。
+ */
+static inline bool edge_queue_push(EdgeQueue *q, const InputEdge *e)
+{
+    unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head - tail >= EDGE_QUEUE_SIZE)
+    {
+        atomic_fetch_add_explicit(&q->overflows, 1, memory_order_relaxed);
+        return false;
+    }
+    q->slots[head & EDGE_QUEUE_MASK] = *e;
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief エッジを1つ取り出す。空ならfalseを返す。
+ */
+static inline bool edge_queue_pop(EdgeQueue *q, InputEdge *e)
+{
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (tail == head)
+        return false;
+    *e = q->slots[tail & EDGE_QUEUE_MASK];
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief 溢れ数を返す。
+ */
+static inline unsigned long edge_queue_overflows(EdgeQueue *q)
+{
+    return atomic_load_explicit(&q->overflows, memory_order_relaxed);
+}
+
+#endif
@@ -0,0 +1,533 @@
+#include "evdev_input.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+
+// キーコードから入力ワードへの割り当て
+// キーボードモードのJAMMAアダプタに合わせたマッピングで、raylibバックエンドと同じ割り当てにしている。
+typedef struct
+{
+    uint8_t player; // 0=未割り当て 1=1P 2=2P 3=システム
+    uint16_t bit;
+} KeyMapping;
+
+#define MAP_1P(b) {1, (b)}
+#define MAP_2P(b) {2, (b)}
+#define MAP_SYS(b) {3, (b)}
+
+static const KeyMapping key_map[EVDEV_KEY_COUNT] = {
+    // 1P
+    [KEY_W] = MAP_1P(INPUT_BIT_UP),
+    [KEY_S] = MAP_1P(INPUT_BIT_DOWN),
+    [KEY_A] = MAP_1P(INPUT_BIT_LEFT),
+    [KEY_D] = MAP_1P(INPUT_BIT_RIGHT),
+    [KEY_N] = MAP_1P(INPUT_BIT_A),
+    [KEY_M] = MAP_1P(INPUT_BIT_B),
+    [KEY_COMMA] = MAP_1P(INPUT_BIT_C),
+    [KEY_DOT] = MAP_1P(INPUT_BIT_D),
+    [KEY_1] = MAP_1P(INPUT_BIT_START),
+    [KEY_5] = MAP_1P(INPUT_BIT_SELECT),
+    // 2P
+    [KEY_UP] = MAP_2P(INPUT_BIT_UP),
+    [KEY_DOWN] = MAP_2P(INPUT_BIT_DOWN),
+    [KEY_LEFT] = MAP_2P(INPUT_BIT_LEFT),
+    [KEY_RIGHT] = MAP_2P(INPUT_BIT_RIGHT),
+    [KEY_KP1] = MAP_2P(INPUT_BIT_A),
+    [KEY_KP2] = MAP_2P(INPUT_BIT_B),
+    [KEY_KP3] = MAP_2P(INPUT_BIT_C),
+    [KEY_KP4] = MAP_2P(INPUT_BIT_D),
+    [KEY_2] = MAP_2P(INPUT_BIT_START),
+    [KEY_6] = MAP_2P(INPUT_BIT_SELECT),
+    // システム
+    [KEY_DELETE] = MAP_SYS(INPUT_SYS_DELETE),
+    [KEY_PAGEUP] = MAP_SYS(INPUT_SYS_SCROLL_BACK),
+    [KEY_PAGEDOWN] = MAP_SYS(INPUT_SYS_SCROLL_FORWARD),
+};
+
+// フィクスチャで使えるキー名
+static const struct
+{
+    const char *name;
+    uint16_t code;
+} key_names[] = {
+    {"KEY_W", KEY_W}, {"KEY_S", KEY_S}, {"KEY_A", KEY_A}, {"KEY_D", KEY_D},
+    {"KEY_N", KEY_N}, {"KEY_M", KEY_M}, {"KEY_COMMA", KEY_COMMA}, {"KEY_DOT", KEY_DOT},
+    {"KEY_1", KEY_1}, {"KEY_5", KEY_5},
+    {"KEY_UP", KEY_UP}, {"KEY_DOWN", KEY_DOWN}, {"KEY_LEFT", KEY_LEFT}, {"KEY_RIGHT", KEY_RIGHT},
+    {"KEY_KP1", KEY_KP1}, {"KEY_KP2", KEY_KP2}, {"KEY_KP3", KEY_KP3}, {"KEY_KP4", KEY_KP4},
+    {"KEY_2", KEY_2}, {"KEY_6", KEY_6},
+    {"KEY_DELETE", KEY_DELETE}, {"KEY_PAGEUP", KEY_PAGEUP}, {"KEY_PAGEDOWN", KEY_PAGEDOWN},
+};
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline bool test_bit(const unsigned char *bits, int n)
+{
+    return bits[n / 8] & (1 << (n % 8));
+}
+
+/**
+ * @brief epollとデバイス管理領域を初期化する。
+ */
+bool evdev_input_init(EvdevInput *ev, int player_count)
+{
+    memset(ev, 0, sizeof(*ev));
+    ev->player_count = player_count;
+    ev->timer_fd = -1;
+    ev->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (ev->epoll_fd == -1)
+    {
+        perror("epoll_create1");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief デバイスをepollに登録する。epollのユーザーデータにはデバイス番号を入れておく。
+ */
+static int register_device(EvdevInput *ev, int fd, const char *path, bool is_fixture)
+{
+    if (ev->device_count >= EVDEV_MAX_DEVICES)
+    {
+        fprintf(stderr, "[error] too many input devices: %s\n", path);
+        close(fd);
+        return -1;
+    }
+    int index = ev->device_count;
+    EvdevDevice *dev = &ev->devices[index];
+    memset(dev, 0, sizeof(*dev));
+    dev->fd = fd;
+    dev->is_fixture = is_fixture;
+    snprintf(dev->path, sizeof(dev->path), "%s", path);
+    int groups = (ev->player_count + 1) / 2;
+    dev->player_base = groups > 1 ? (index % groups) * 2 : 0;
+
+    struct epoll_event e = {.events = EPOLLIN, .data.u32 = index};
+    if (epoll_ctl(ev->epoll_fd, EPOLL_CTL_ADD, fd, &e) == -1)
+    {
+        perror("epoll_ctl");
+        close(fd);
+        return -1;
+    }
+    ev->group_devices[dev->player_base] |= 1u << index;
+    ev->device_count++;
+    return index;
+}
+
+/**
+ * @brief キーの押下状態を更新し、プレイヤーのワードが変化したらエッジを出力する。
+ *        出力先が満杯のときは状態だけを更新し、ワードを unsent_words に記録して次の呼び出しで送る。
+ */
+static void handle_key(EvdevInput *ev, int index, uint16_t code, int32_t value, uint64_t time_ns,
+                       InputEdge *edges, int *count, int max_edges)
+{
+    if (code >= EVDEV_KEY_COUNT || value == 2) // リピートは状態変化ではないので無視
+        return;
+    const KeyMapping *m = &key_map[code];
+    if (m->player == 0)
+        return;
+
+    if (value)
+        ev->key_holders[code] |= 1u << index;
+    else
+        ev->key_holders[code] &= ~(1u << index);
+
+    // プレイヤーのキーは同じプレイヤーを受け持つデバイスの押下だけを合成する
+    int base = ev->devices[index].player_base;
+    uint32_t holders = ev->key_holders[code] & (m->player == 3 ? ~0u : ev->group_devices[base]);
+    uint8_t player = m->player == 3 ? INPUT_PLAYER_SYSTEM : base + m->player - 1;
+    uint16_t *word = m->player == 3 ? &ev->system_word : &ev->player_word[player];
+    uint16_t next = (*word & ~m->bit) | (-(uint16_t)(holders != 0) & m->bit);
+    if (next == *word)
+        return;
+    *word = next;
+
+    if (*count >= max_edges)
+    {
+        int slot = m->player == 3 ? INPUT_MAX_PLAYERS : player;
+        ev->unsent_words |= 1u << slot;
+        ev->unsent_device[slot] = index;
+        return;
+    }
+    edges[(*count)++] = (InputEdge){.time_ns = time_ns, .word = next, .player = player, .device = index};
+}
+
+/**
+ * @brief 出力先が満杯で送れなかったワードを、現在の値のエッジとして送る。
+ */
+static void flush_unsent_words(EvdevInput *ev, InputEdge *edges, int *count, int max_edges)
+{
+    uint64_t t = now_ns();
+    for (int slot = 0; slot <= INPUT_MAX_PLAYERS && ev->unsent_words && *count < max_edges; slot++)
+    {
+        if (!(ev->unsent_words & (1u << slot)))
+            continue;
+        ev->unsent_words &= ~(1u << slot);
+        bool system = slot == INPUT_MAX_PLAYERS;
+        edges[(*count)++] = (InputEdge){.time_ns = t,
+                                        .word = system ? ev->system_word : ev->player_word[slot],
+                                        .player = system ? INPUT_PLAYER_SYSTEM : slot,
+                                        .device = ev->unsent_device[slot]};
+    }
+}
+
+/**
+ * @brief デバイスの現在のキー状態を取得して押下状態を合わせ直す。
+ *        起動直後や SYN_DROPPED でイベントを取りこぼしたときに使う。
+ */
+static void sync_device_keys(EvdevInput *ev, int index, InputEdge *edges, int *count, int max_edges)
+{
+    unsigned char keys[EVDEV_KEY_COUNT / 8] = {0};
+    if (ioctl(ev->devices[index].fd, EVIOCGKEY(sizeof(keys)), keys) == -1)
+        return;
+    uint64_t t = now_ns();
+    for (int code = 0; code < EVDEV_KEY_COUNT; code++)
+    {
+        if (key_map[code].player == 0)
+            continue;
+        bool held = ev->key_holders[code] & (1u << index);
+        bool down = test_bit(keys, code);
+        if (held != down)
+            handle_key(ev, index, code, down, t, edges, count, max_edges);
+    }
+}
+
+/**
+ * @brief evdevデバイスを開いて登録する。
+ *        タイムスタンプは状態管理スレッドと同じCLOCK_MONOTONICで受け取るように設定する。
+ */
+int evdev_input_add_device(EvdevInput *ev, const char *path)
+{
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1)
+    {
+        fprintf(stderr, "[error] open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    int clock_id = CLOCK_MONOTONIC;
+    if (ioctl(fd, EVIOCSCLOCKID, &clock_id) == -1)
+        fprintf(stderr, "[warn] EVIOCSCLOCKID %s: %s\n", path, strerror(errno));
+
+    int index = register_device(ev, fd, path, false);
+    if (index < 0)
+        return -1;
+
+    // 起動時点で押されているキーを反映（エッジは捨てる）
+    InputEdge discard[EVDEV_KEY_COUNT];
+    int n = 0;
+    sync_device_keys(ev, index, discard, &n, EVDEV_KEY_COUNT);
+
+    printf("[info] evdev device: %s\n", path);
+    return index;
+}
+
+/**
+ * @brief /dev/input/event* から割り当て済みのキーを持つデバイスを探して登録する。
+ */
+int evdev_input_scan_devices(EvdevInput *ev)
+{
+    glob_t g;
+    if (glob("/dev/input/event*", 0, NULL, &g) != 0)
+        return 0;
+
+    int added = 0;
+    for (size_t i = 0; i < g.gl_pathc; i++)
+    {
+        int fd = open(g.gl_pathv[i], O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd == -1)
+            continue;
+        unsigned char keys[EVDEV_KEY_COUNT / 8] = {0};
+        bool usable = ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) != -1 &&
+                      (test_bit(keys, KEY_W) || test_bit(keys, KEY_UP) || test_bit(keys, KEY_KP1));
+        close(fd);
+        if (usable && evdev_input_add_device(ev, g.gl_pathv[i]) >= 0)
+            added++;
+    }
+    globfree(&g);
+    return added;
+}
+
+/**
+ * @brief キー名もしくは数値のキーコードを解決する。
+ */
+static int parse_key_code(const char *s)
+{
+    if (isdigit((unsigned char)s[0]))
+        return atoi(s);
+    for (size_t i = 0; i < sizeof(key_names) / sizeof(key_names[0]); i++)
+        if (strcmp(s, key_names[i].name) == 0)
+            return key_names[i].code;
+    return -1;
+}
+
+/**
+ * @brief フィクスチャの次のイベント時刻にタイマーを合わせる。
+ */
+static void arm_fixture(EvdevDevice *dev)
+{
+    struct itimerspec its = {0};
+    if (dev->fixture_pos < dev->fixture_count)
+    {
+        uint64_t t = dev->fixture_base_ns + dev->fixture[dev->fixture_pos].offset_ns;
+        its.it_value.tv_sec = t / 1000000000ULL;
+        its.it_value.tv_nsec = t % 1000000000ULL;
+    }
+    timerfd_settime(dev->fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/**
+ * @brief 実機がなくても動作確認できるように、テキストのフィクスチャをデバイスの代わりに登録する。
+ *        1行1イベントで「開始からのマイクロ秒 キー 値」の形式。#以降はコメント。
+ *        例: 16000 KEY_W 1
+ *        登録した時点から記録どおりの時刻でイベントを配信し、その時刻をタイムスタンプとする。
+ */
+int evdev_input_add_fixture(EvdevInput *ev, const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "[error] open fixture %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    EvdevFixtureEvent *events = calloc(EVDEV_MAX_FIXTURE, sizeof(EvdevFixtureEvent));
+    if (!events)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    int count = 0, line_no = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), fp) && count < EVDEV_MAX_FIXTURE)
+    {
+        line_no++;
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+        unsigned long long usec;
+        char key[32];
+        int value;
+        int fields = sscanf(line, "%llu %31s %d", &usec, key, &value);
+        if (fields <= 0)
+            continue;
+        int code = fields == 3 ? parse_key_code(key) : -1;
+        if (code < 0 || code >= EVDEV_KEY_COUNT)
+        {
+            fprintf(stderr, "[warn] %s:%d: invalid fixture line\n", path, line_no);
+            continue;
+        }
+        events[count++] = (EvdevFixtureEvent){usec * 1000ULL, code, value};
+    }
+    fclose(fp);
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1)
+    {
+        perror("timerfd_create");
+        free(events);
+        return -1;
+    }
+    int index = register_device(ev, fd, path, true);
+    if (index < 0)
+    {
+        free(events);
+        return -1;
+    }
+    EvdevDevice *dev = &ev->devices[index];
+    dev->fixture = events;
+    dev->fixture_count = count;
+    dev->fixture_base_ns = now_ns();
+    arm_fixture(dev);
+
+    printf("[info] evdev fixture: %s (%d events)\n", path, count);
+    return index;
+}
+
+/**
+ * @brief フィクスチャの配信時刻を過ぎたイベントを処理する。
+ */
+static void read_fixture(EvdevInput *ev, int index, InputEdge *edges, int *count, int max_edges)
+{
+    EvdevDevice *dev = &ev->devices[index];
+    uint64_t expirations;
+    if (read(dev->fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN)
+        return;
+
+    uint64_t t = now_ns();
+    while (dev->fixture_pos < dev->fixture_count && *count < max_edges)
+    {
+        const EvdevFixtureEvent *e = &dev->fixture[dev->fixture_pos];
+        uint64_t at = dev->fixture_base_ns + e->offset_ns;
+        if (at > t)
+            break;
+        handle_key(ev, index, e->code, e->value, at, edges, count, max_edges);
+        dev->fixture_pos++;
+    }
+    arm_fixture(dev);
+}
+
+/**
+ * @brief 読み出し済みのイベントを出力先に入る分だけ処理する。すべて処理できたら真を返す。
+ *        キーのイベントは1つで高々1エッジなので、空きがある間だけ取り出せば入りきらないことはない。
+ */
+static bool drain_pending(EvdevInput *ev, int index, InputEdge *edges, int *count, int max_edges)
+{
+    EvdevDevice *dev = &ev->devices[index];
+    while (dev->pending_pos < dev->pending_count)
+    {
+        if (*count >= max_edges)
+            return false;
+        const struct input_event *e = &dev->pending[dev->pending_pos++];
+        if (e->type == EV_KEY)
+        {
+            uint64_t t = (uint64_t)e->input_event_sec * 1000000000ULL + (uint64_t)e->input_event_usec * 1000ULL;
+            handle_key(ev, index, e->code, e->value, t, edges, count, max_edges);
+        }
+        else if (e->type == EV_SYN && e->code == SYN_DROPPED)
+        {
+            // 取りこぼした分は現在の状態に合わせ直す。入りきらない変化は unsent_words で後から送る
+            sync_device_keys(ev, index, edges, count, max_edges);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief デバイスからイベントを読み出す。出力先に入りきる分だけ読み、入りきらなかったイベントは次回に回す。
+ */
+static void read_device(EvdevInput *ev, int index, InputEdge *edges, int *count, int max_edges)
+{
+    EvdevDevice *dev = &ev->devices[index];
+    bool more = true;
+    while (drain_pending(ev, index, edges, count, max_edges) && more && *count < max_edges)
+    {
+        size_t room = max_edges - *count;
+        if (room > EVDEV_READ_BATCH)
+            room = EVDEV_READ_BATCH;
+        ssize_t r = read(dev->fd, dev->pending, room * sizeof(dev->pending[0]));
+        if (r == -1)
+        {
+            if (errno == ENODEV)
+            {
+                fprintf(stderr, "[warn] evdev device removed: %s\n", dev->path);
+                epoll_ctl(ev->epoll_fd, EPOLL_CTL_DEL, dev->fd, NULL);
+                close(dev->fd);
+                dev->fd = -1;
+                // 押しっぱなしにならないようにこのデバイスの押下をすべて解放する。入りきらない変化は次回に送る
+                uint64_t t = now_ns();
+                for (int code = 0; code < EVDEV_KEY_COUNT; code++)
+                    if (ev->key_holders[code] & (1u << index))
+                        handle_key(ev, index, code, 0, t, edges, count, max_edges);
+            }
+            return;
+        }
+        dev->pending_pos = 0;
+        dev->pending_count = r / sizeof(dev->pending[0]);
+        more = (size_t)dev->pending_count == room;
+    }
+}
+
+/**
+ * @brief デバイスと同じepollで待つタイマー（timerfd）を登録する。
+ *        期限が来ると evdev_input_wait が timer_fired を真にして返る。タイマーの設定と解放は呼び出し側が行う。
+ */
+bool evdev_input_add_timer(EvdevInput *ev, int timer_fd)
+{
+    struct epoll_event e = {.events = EPOLLIN, .data.u32 = EVDEV_TIMER_INDEX};
+    if (epoll_ctl(ev->epoll_fd, EPOLL_CTL_ADD, timer_fd, &e) == -1)
+    {
+        perror("epoll_ctl");
+        return false;
+    }
+    ev->timer_fd = timer_fd;
+    return true;
+}
+
+/**
+ * @brief いずれかのデバイスにイベントが届くまで待ち、発生したエッジを返す。
+ *        戻り値はエッジ数。タイムアウト時は0、エラー時は-1。
+ *        max_edgesが0のときはデバイスを読まずにタイマーだけを待つ。
+ */
+int evdev_input_wait(EvdevInput *ev, int timeout_ms, InputEdge *edges, int max_edges)
+{
+    // デバイスは読み残しがある間ずっと読める状態のため、読めないのにepollで待つとすぐ戻って空回りする。
+    // 出力先に空きがないときはタイマーだけを待ち、イベントはカーネル側（フィクスチャは配列）に残しておく
+    if (max_edges <= 0)
+    {
+        struct pollfd timer = {.fd = ev->timer_fd, .events = POLLIN};
+        int r = poll(&timer, 1, timeout_ms);
+        if (r == -1)
+            return errno == EINTR ? 0 : -1;
+        uint64_t expirations;
+        if (r > 0 && read(ev->timer_fd, &expirations, sizeof(expirations)) > 0)
+            ev->timer_fired = true;
+        return 0;
+    }
+
+    // 前回入りきらなかった変化とイベントはカーネル側に残っていないため、epollで待たずに先に送る
+    int count = 0;
+    flush_unsent_words(ev, edges, &count, max_edges);
+    for (int index = 0; index < ev->device_count; index++)
+        if (!ev->devices[index].is_fixture)
+            drain_pending(ev, index, edges, &count, max_edges);
+
+    struct epoll_event ready[EVDEV_MAX_DEVICES + 1];
+    int nready = epoll_wait(ev->epoll_fd, ready, EVDEV_MAX_DEVICES + 1, count > 0 ? 0 : timeout_ms);
+    if (nready == -1)
+        return errno == EINTR ? count : -1;
+
+    for (int i = 0; i < nready; i++)
+    {
+        int index = ready[i].data.u32;
+        if (index == EVDEV_TIMER_INDEX)
+        {
+            uint64_t expirations;
+            if (read(ev->timer_fd, &expirations, sizeof(expirations)) > 0)
+                ev->timer_fired = true;
+            continue;
+        }
+        if (ev->devices[index].fd < 0)
+            continue;
+        if (ev->devices[index].is_fixture)
+            read_fixture(ev, index, edges, &count, max_edges);
+        else
+            read_device(ev, index, edges, &count, max_edges);
+    }
+    return count;
+}
+
+/**
+ * @brief 全デバイスとepollを閉じる。
+ */
+void evdev_input_close(EvdevInput *ev)
+{
+    for (int i = 0; i < ev->device_count; i++)
+    {
+        if (ev->devices[i].fd >= 0)
+            close(ev->devices[i].fd);
+        free(ev->devices[i].fixture);
+    }
+    ev->device_count = 0;
+    if (ev->epoll_fd >= 0)
+        close(ev->epoll_fd);
+    ev->epoll_fd = -1;
+}
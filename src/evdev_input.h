@@ -0,0 +1,69 @@
+#ifndef EVDEV_INPUT_H
+#define EVDEV_INPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <linux/input.h>
+#include "input_edge.h"
+
+#define EVDEV_MAX_DEVICES 16     // 同時に扱うデバイス数の上限（JAMMAアダプタ複数台を想定）
+#define EVDEV_MAX_FIXTURE 4096   // フィクスチャ1ファイルあたりのイベント数上限
+#define EVDEV_KEY_COUNT 0x300    // linux/input-event-codes.h の KEY_CNT と同じ値
+#define EVDEV_TIMER_INDEX EVDEV_MAX_DEVICES // epollのユーザーデータでタイマーを示す値
+#define EVDEV_READ_BATCH 64      // 実デバイスから1回に読むイベント数の上限
+
+// フィクスチャに記録された1イベント
+typedef struct
+{
+    uint64_t offset_ns; // 再生開始からの経過時間
+    uint16_t code;      // キーコード
+    int32_t value;      // 1=押下 0=解放 2=リピート
+} EvdevFixtureEvent;
+
+// epollに登録する1デバイス
+// 実デバイスはイベントファイルそのもの、フィクスチャはtimerfdを擬似デバイスとして扱う。
+typedef struct
+{
+    int fd;
+    bool is_fixture;
+    char path[64];
+    EvdevFixtureEvent *fixture;  // フィクスチャのイベント列
+    int fixture_count;
+    int fixture_pos;             // 次に配信するイベント
+    uint64_t fixture_base_ns;    // 再生開始時刻
+    uint8_t player_base;         // このデバイスの1Pキーを割り当てるプレイヤー番号（2Pキーはその次）
+    struct input_event pending[EVDEV_READ_BATCH]; // 読んだが出力先に入りきらなかったイベント
+    int pending_pos;             // 次に処理するイベント
+    int pending_count;
+} EvdevDevice;
+
+// evdev入力バックエンド
+// 全デバイスの押下状態を合成して各プレイヤーとシステムの入力ワードを保持する。
+// 同じキーが複数デバイスで押されていても、すべて離されるまでは押下として扱う。
+// 3人以上のときはデバイスを登録順に2人ずつのプレイヤーへ割り当てる（1台目は1P/2P、2台目は3P/4P...）。
+// 2人のときは従来どおり全デバイスが1P/2Pになる。
+typedef struct
+{
+    int epoll_fd;
+    EvdevDevice devices[EVDEV_MAX_DEVICES];
+    int device_count;
+    uint32_t key_holders[EVDEV_KEY_COUNT]; // キーごとの押下中デバイスのビットマスク
+    uint32_t group_devices[INPUT_MAX_PLAYERS]; // player_baseごとのデバイスのビットマスク
+    int player_count;
+    uint16_t player_word[INPUT_MAX_PLAYERS];
+    uint16_t system_word;
+    uint16_t unsent_words; // 出力先が満杯で変化を送れなかったワード（ビット0～7がプレイヤー、ビット8がシステム）
+    uint8_t unsent_device[INPUT_MAX_PLAYERS + 1]; // 送れなかった変化の発生元デバイス
+    int timer_fd;     // evdev_input_add_timer で登録したタイマー
+    bool timer_fired; // タイマーの期限が来た（呼び出し側が偽に戻す）
+} EvdevInput;
+
+bool evdev_input_init(EvdevInput *ev, int player_count);
+int evdev_input_add_device(EvdevInput *ev, const char *path);
+int evdev_input_scan_devices(EvdevInput *ev);
+int evdev_input_add_fixture(EvdevInput *ev, const char *path);
+bool evdev_input_add_timer(EvdevInput *ev, int timer_fd);
+int evdev_input_wait(EvdevInput *ev, int timeout_ms, InputEdge *edges, int max_edges);
+void evdev_input_close(EvdevInput *ev);
+
+#endif
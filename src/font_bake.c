@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raylib.h"
+#include "text_cache.h"
+
+// フォントアトラスと文字列キャッシュの生成プログラム（ビルド時に実行）
+// フォントファイルから表示に使う文字だけのアトラスを作り、各文字列の幅とグリフの矩形を計算して
+// input_dispi が取り込むヘッダに書き出す。raylibのフォント処理はGPUを使わない関数だけを使う。
+//
+// usage: input_dispi_font_bake FONT OUTPUT
+
+static Font font;
+
+/**
+ * @brief 表示に使う文字のコードポイントを重複なしで返す。
+ */
+static int *load_charset_codepoints(int *count)
+{
+    int codepoint_count = 0;
+    int *codepoints = LoadCodepoints(TEXT_CACHE_CHARSET, &codepoint_count);
+    int *unique = calloc(codepoint_count, sizeof(int));
+    int n = 0;
+    for (int i = 0; i < codepoint_count; i++)
+    {
+        bool duplicate = false;
+        for (int j = 0; j < n && !duplicate; j++)
+            duplicate = codepoints[i] == unique[j];
+        if (!duplicate)
+            unique[n++] = codepoints[i];
+    }
+    UnloadCodepoints(codepoints);
+    *count = n;
+    return unique;
+}
+
+/**
+ * @brief DrawTextCodepointsと同じ配置規則でグリフの矩形を計算する。
+ */
+static void init_glyph_quads(CachedText *c, const int *codepoints, int codepoint_count, float font_size, float spacing,
+                             int atlas_width, int atlas_height)
+{
+    float scale = font_size / font.baseSize;
+    float pad = font.glyphPadding;
+    float offset_x = 0;
+    c->quad_count = 0;
+    for (int i = 0; i < codepoint_count && c->quad_count < CACHED_TEXT_MAX_GLYPHS; i++)
+    {
+        int index = GetGlyphIndex(font, codepoints[i]);
+        Rectangle rec = font.recs[index];
+        GlyphInfo *glyph = &font.glyphs[index];
+        if (codepoints[i] != ' ')
+        {
+            c->quads[c->quad_count++] = (GlyphQuad){
+                .dst = {offset_x + (glyph->offsetX - pad) * scale, (glyph->offsetY - pad) * scale,
+                        (rec.width + 2 * pad) * scale, (rec.height + 2 * pad) * scale},
+                .uv = {(rec.x - pad) / atlas_width, (rec.y - pad) / atlas_height,
+                       (rec.width + 2 * pad) / atlas_width, (rec.height + 2 * pad) / atlas_height}};
+        }
+        offset_x += (glyph->advanceX ? glyph->advanceX : rec.width) * scale + spacing;
+    }
+}
+
+static void init_cached_text(CachedText *c, const char *s, int atlas_width, int atlas_height)
+{
+    memset(c, 0, sizeof(*c));
+    strncpy(c->text, s, sizeof(c->text) - 1);
+    int codepoint_count = 0;
+    int *codepoints = LoadCodepoints(c->text, &codepoint_count);
+    c->width = MeasureTextEx(font, c->text, FONT_SIZE, 1).x;
+    init_glyph_quads(c, codepoints, codepoint_count, FONT_SIZE, 2, atlas_width, atlas_height);
+    UnloadCodepoints(codepoints);
+}
+
+/**
+ * @brief フレームカウント、レバー、ボタンの全文字列のキャッシュを作る。
+ */
+static void build_text_caches(TextCaches *t, int atlas_width, int atlas_height)
+{
+    char buf[8];
+    for (int i = 0; i < MAX_FRAME_COUNT; i++)
+    {
+        snprintf(buf, sizeof(buf), "%03d", i);
+        init_cached_text(&t->count[i], buf, atlas_width, atlas_height);
+    }
+    init_cached_text(&t->count[MAX_FRAME_COUNT], "LOT", atlas_width, atlas_height);
+    for (int i = 0; i < SUBFRAME_CACHE_SIZE; i++)
+    {
+        snprintf(buf, sizeof(buf), "%d.%d", i / 10, i % 10);
+        init_cached_text(&t->subframe[i], buf, atlas_width, atlas_height);
+    }
+
+    const char *nt = "•", *up = "↑", *down = "↓", *left = "←", *right = "→",
+               *ul = "↖", *ur = "↗", *dl = "↙", *dr = "↘";
+    const char *directions[DIR_STATE_COUNT] = {
+        nt,    // 0x00 neutral
+        up,    // 0x01
+        down,  // 0x02
+        nt,    // 0x03 (↑↓ cancel)
+        left,  // 0x04
+        ul,    // 0x05
+        dl,    // 0x06
+        left,  // 0x07 (↑↓+←)
+        right, // 0x08
+        ur,    // 0x09
+        dr,    // 0x0A
+        right, // 0x0B (↑↓+→)
+        nt,    // 0x0C (←→ cancel)
+        up,    // 0x0D (←→+↑)
+        down,  // 0x0E (←→+↓)
+        nt     // 0x0F (↑↓←→ cancel)
+    };
+    for (int i = 0; i < DIR_STATE_COUNT; i++)
+        init_cached_text(&t->dir[i], directions[i], atlas_width, atlas_height);
+
+    for (int i = 0; i < BTN_STATE_COUNT; i++)
+    {
+        int len = 0;
+        char b[8] = "";
+        if (i & 0x1)
+            b[len++] = 'A';
+        if (i & 0x2)
+            b[len++] = 'B';
+        if (i & 0x4)
+            b[len++] = 'C';
+        if (i & 0x8)
+            b[len++] = 'D';
+        b[len] = '\0';
+        init_cached_text(&t->button[i], b, atlas_width, atlas_height);
+    }
+}
+
+static void write_rect(FILE *fp, DrawRect r)
+{
+    fprintf(fp, "{%a, %a, %a, %a}", r.x, r.y, r.width, r.height);
+}
+
+static void write_cached_texts(FILE *fp, const char *name, const CachedText *c, int count)
+{
+    if (name)
+        fprintf(fp, "    .%s = {\n", name);
+    for (int i = 0; i < count; i++)
+    {
+        fprintf(fp, "        {\"%s\", %a, %d, {", c[i].text, c[i].width, c[i].quad_count);
+        for (int q = 0; q < c[i].quad_count; q++)
+        {
+            fprintf(fp, "%s{", q ? ", " : "");
+            write_rect(fp, c[i].quads[q].dst);
+            fprintf(fp, ", ");
+            write_rect(fp, c[i].quads[q].uv);
+            fprintf(fp, "}");
+        }
+        if (c[i].quad_count == 0)
+            fprintf(fp, "{{0}}");
+        fprintf(fp, "}},\n");
+    }
+    if (name)
+        fprintf(fp, "    },\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s FONT OUTPUT\n", argv[0]);
+        return 1;
+    }
+    SetTraceLogLevel(LOG_WARNING);
+
+    int size = 0;
+    unsigned char *data = LoadFileData(argv[1], &size);
+    if (!data)
+    {
+        fprintf(stderr, "[error] failed to load font: %s\n", argv[1]);
+        return 1;
+    }
+    int codepoint_count = 0;
+    int *codepoints = load_charset_codepoints(&codepoint_count);
+    int glyph_count = codepoint_count;
+    font.baseSize = FONT_SIZE;
+    font.glyphCount = codepoint_count;
+    font.glyphPadding = FONT_GLYPH_PADDING;
+    font.glyphs = LoadFontData(data, size, FONT_SIZE, codepoints, codepoint_count, FONT_DEFAULT);
+    UnloadFileData(data);
+    if (!font.glyphs)
+    {
+        fprintf(stderr, "[error] failed to rasterize font: %s\n", argv[1]);
+        return 1;
+    }
+
+    // アトラスは白一色でアルファだけが変わるため、アルファだけを書き出す
+    Image atlas = GenImageFontAtlas(font.glyphs, &font.recs, font.glyphCount, FONT_SIZE, font.glyphPadding, 0);
+    ImageFormat(&atlas, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    const unsigned char *rgba = atlas.data;
+
+    static TextCaches caches;
+    build_text_caches(&caches, atlas.width, atlas.height);
+
+    // 実行時に読み込む文字列（コマンドの表示など）を組み立てるための1文字ずつのキャッシュ
+    CachedText *glyph_texts = calloc(glyph_count, sizeof(CachedText));
+    for (int i = 0; i < glyph_count; i++)
+    {
+        int utf8_size = 0;
+        const char *utf8 = CodepointToUTF8(codepoints[i], &utf8_size);
+        char buf[5] = "";
+        memcpy(buf, utf8, utf8_size < 4 ? utf8_size : 4);
+        init_cached_text(&glyph_texts[i], buf, atlas.width, atlas.height);
+    }
+    free(codepoints);
+
+    FILE *fp = fopen(argv[2], "w");
+    if (!fp)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+    fprintf(fp, "// input_dispi_font_bake が %s から生成したファイル。編集しないこと\n", argv[1]);
+    fprintf(fp, "#ifndef FONT_BAKED_H\n#define FONT_BAKED_H\n\n#include \"text_cache.h\"\n\n");
+    fprintf(fp, "#define BAKED_FONT_ATLAS_WIDTH %d\n#define BAKED_FONT_ATLAS_HEIGHT %d\n\n", atlas.width, atlas.height);
+    fprintf(fp, "static const unsigned char baked_font_atlas_alpha[BAKED_FONT_ATLAS_WIDTH * BAKED_FONT_ATLAS_HEIGHT] = {");
+    for (int i = 0; i < atlas.width * atlas.height; i++)
+        fprintf(fp, "%s%d,", i % 32 ? "" : "\n    ", rgba[i * 4 + 3]);
+    fprintf(fp, "\n};\n\n");
+    fprintf(fp, "static const TextCaches baked_text_caches = {\n");
+    write_cached_texts(fp, "count", caches.count, COUNT_CACHE_SIZE);
+    write_cached_texts(fp, "subframe", caches.subframe, SUBFRAME_CACHE_SIZE);
+    write_cached_texts(fp, "dir", caches.dir, DIR_STATE_COUNT);
+    write_cached_texts(fp, "button", caches.button, BTN_STATE_COUNT);
+    fprintf(fp, "};\n\n");
+    fprintf(fp, "#define BAKED_GLYPH_COUNT %d\n\n", glyph_count);
+    fprintf(fp, "static const CachedText baked_glyph_texts[BAKED_GLYPH_COUNT] = {\n");
+    write_cached_texts(fp, NULL, glyph_texts, glyph_count);
+    fprintf(fp, "};\n\n#endif\n");
+    bool ok = fclose(fp) == 0;
+
+    printf("[info] baked %d glyphs into a %dx%d atlas: %s\n", font.glyphCount, atlas.width, atlas.height, argv[2]);
+    free(glyph_texts);
+    UnloadImage(atlas);
+    UnloadFontData(font.glyphs, font.glyphCount);
+    MemFree(font.recs);
+    return ok ? 0 : 1;
+}
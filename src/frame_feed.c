@@ -0,0 +1,134 @@
+#include "frame_feed.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static inline uint64_t round_up_page(uint64_t n)
+{
+    return (n + FRAME_FEED_PAGE_SIZE - 1) / FRAME_FEED_PAGE_SIZE * FRAME_FEED_PAGE_SIZE;
+}
+
+/**
+ * @brief 共有メモリを作成してヘッダを書き込む。同名の古い共有メモリがあれば作り直す。
+ *        画素の領域は最初に書き込むまで実メモリを割り当てないため、書き込む前に一度触れておく。
+ */
+bool frame_feed_writer_open(FrameFeedWriter *w, const char *name, int width, int height, int slots, uint32_t flags)
+{
+    memset(w, 0, sizeof(*w));
+    if (slots < 2 || slots > FRAME_FEED_MAX_SLOTS)
+    {
+        fprintf(stderr, "[error] frame feed slots must be 2-%d\n", FRAME_FEED_MAX_SLOTS);
+        return false;
+    }
+    snprintf(w->name, sizeof(w->name), "%s", name);
+    uint64_t stride = (uint64_t)width * 4;
+    uint64_t pixels_offset = round_up_page(sizeof(FrameFeedHeader));
+    uint64_t slot_size = round_up_page(stride * height);
+    w->size = pixels_offset + slot_size * slots;
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd == -1)
+    {
+        fprintf(stderr, "[error] shm_open %s: %s\n", name, strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, w->size) == -1)
+    {
+        fprintf(stderr, "[error] ftruncate %s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    void *p = mmap(NULL, w->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        fprintf(stderr, "[error] mmap %s: %s\n", name, strerror(errno));
+        shm_unlink(name);
+        return false;
+    }
+
+    FrameFeedHeader *h = p;
+    memcpy(h->magic, FRAME_FEED_MAGIC, 4);
+    h->version = FRAME_FEED_VERSION;
+    h->slot_count = slots;
+    h->width = width;
+    h->height = height;
+    h->stride = stride;
+    h->flags = flags;
+    h->pixels_offset = pixels_offset;
+    h->slot_size = slot_size;
+    atomic_store(&h->latest, 0);
+    for (int i = 0; i < FRAME_FEED_MAX_SLOTS; i++)
+        atomic_store(&h->slots[i].seq, 0);
+    memset((uint8_t *)h + pixels_offset, 0, slot_size * slots);
+    w->header = h;
+    printf("[info] frame feed: /dev/shm%s (%dx%d RGBA, %d slots, %.1f MB)\n", name, width, height, slots,
+           w->size / 1048576.0);
+    return true;
+}
+
+/**
+ * @brief 共有メモリを解放して名前を削除する。読み出し側の割り当ては閉じるまで有効なまま残る。
+ */
+void frame_feed_writer_close(FrameFeedWriter *w)
+{
+    if (!w->header)
+        return;
+    munmap(w->header, w->size);
+    shm_unlink(w->name);
+    w->header = NULL;
+}
+
+/**
+ * @brief 共有メモリを読み取り専用で開き、形式を確認する。
+ */
+bool frame_feed_reader_open(FrameFeedReader *r, const char *name)
+{
+    r->header = NULL;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1)
+    {
+        fprintf(stderr, "[error] shm_open %s: %s\n", name, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(FrameFeedHeader))
+    {
+        fprintf(stderr, "[error] %s: segment too small\n", name);
+        close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        fprintf(stderr, "[error] mmap %s: %s\n", name, strerror(errno));
+        return false;
+    }
+
+    const FrameFeedHeader *h = p;
+    if (memcmp(h->magic, FRAME_FEED_MAGIC, 4) != 0 || h->version != FRAME_FEED_VERSION || h->slot_count < 2 ||
+        h->slot_count > FRAME_FEED_MAX_SLOTS || h->pixels_offset + h->slot_size * h->slot_count > (uint64_t)st.st_size)
+    {
+        fprintf(stderr, "[error] %s: not a frame feed segment of version %d\n", name, FRAME_FEED_VERSION);
+        munmap(p, st.st_size);
+        return false;
+    }
+    r->header = h;
+    r->size = st.st_size;
+    return true;
+}
+
+void frame_feed_reader_close(FrameFeedReader *r)
+{
+    if (r->header)
+        munmap((void *)r->header, r->size);
+    r->header = NULL;
+}
@@ -0,0 +1,143 @@
+#ifndef FRAME_FEED_H
+#define FRAME_FEED_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 他プロセス向けの描画フレーム配信
+// 透過色のキー合成に頼らず、アルファつきで描いたRGBAのフレームを POSIX 共有メモリのリングに書き込み、
+// 同じ機械の合成ソフトやOBSのソースがコピーせずにそのまま読めるようにする。
+// リングはN枚のフレームで、フレーム番号 n は n % N 枚目に書く。各枚にシーケンス番号（seqlock）を持たせ、
+// 書き込み側は読み出し側を一切待たない。読み出し側は使い終わるまでに上書きされなかったかを確かめる。
+// 上書きされるのはN-1フレーム後なので、その間に使い終えればよい。
+//
+// このヘッダは input_dispi の他のヘッダに依存しないため、読み出し側のプログラムはこれだけを取り込めばよい。
+// 共有メモリ名の既定は "/input_dispi_frames"（/dev/shm/input_dispi_frames）。
+
+#define FRAME_FEED_MAGIC "IDFF"
+#define FRAME_FEED_VERSION 1
+#define FRAME_FEED_DEFAULT_NAME "/input_dispi_frames"
+#define FRAME_FEED_DEFAULT_SLOTS 3
+#define FRAME_FEED_MAX_SLOTS 8
+#define FRAME_FEED_PAGE_SIZE 4096 // 各フレームの画素の先頭をページ境界にそろえる
+
+// 画素の形式を示すフラグ
+#define FRAME_FEED_PREMULTIPLIED 0x1 // RGBはアルファを乗算済み
+#define FRAME_FEED_BOTTOM_UP 0x2     // 先頭の行が画面の一番下（OpenGLから読み出したまま）
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+// 1枚分の情報。画素とは別の場所に置く
+// seq はフレーム番号の2倍で、奇数の間は書き込み中。
+typedef struct
+{
+    _Alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t seq;
+    uint64_t frame;      // フレーム番号（1から）
+    uint64_t tick;       // 描いた状態のtick番号
+    uint64_t publish_ns; // 書き終えた時刻（CLOCK_MONOTONIC）
+} FrameFeedSlot;
+
+// 共有メモリの先頭
+// 画素は pixels_offset から slot_size ごとに slot_count 枚並ぶ。1行は stride バイトのRGBA（8bit）。
+typedef struct
+{
+    char magic[4];         // "IDFF"
+    uint16_t version;      // FRAME_FEED_VERSION
+    uint16_t slot_count;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t flags;        // FRAME_FEED_PREMULTIPLIED など
+    uint64_t pixels_offset;
+    uint64_t slot_size;
+    _Alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t latest; // 書き終えた最新のフレーム番号（0ならまだない）
+    FrameFeedSlot slots[FRAME_FEED_MAX_SLOTS];
+} FrameFeedHeader;
+
+// 書き込み側（input_dispi）
+typedef struct
+{
+    FrameFeedHeader *header;
+    size_t size;
+    uint64_t frame; // 書き込み中もしくは最後に書いたフレーム番号
+    char name[64];
+} FrameFeedWriter;
+
+bool frame_feed_writer_open(FrameFeedWriter *w, const char *name, int width, int height, int slots, uint32_t flags);
+void frame_feed_writer_close(FrameFeedWriter *w);
+
+static inline uint8_t *frame_feed_pixels(const FrameFeedHeader *h, uint64_t frame)
+{
+    return (uint8_t *)h + h->pixels_offset + (frame % h->slot_count) * h->slot_size;
+}
+
+/**
+ * @brief 次のフレームの書き込みを開始する。書き込む枚のシーケンス番号を奇数にしてから画素の書き込み先を返す。
+ */
+static inline uint8_t *frame_feed_write_begin(FrameFeedWriter *w)
+{
+    uint64_t frame = ++w->frame;
+    FrameFeedSlot *slot = &w->header->slots[frame % w->header->slot_count];
+    atomic_store_explicit(&slot->seq, frame * 2 - 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return frame_feed_pixels(w->header, frame);
+}
+
+/**
+ * @brief 書き込みを終える。シーケンス番号を偶数にしてから最新のフレーム番号として公開する。
+ */
+static inline void frame_feed_write_end(FrameFeedWriter *w, uint64_t tick, uint64_t publish_ns)
+{
+    FrameFeedSlot *slot = &w->header->slots[w->frame % w->header->slot_count];
+    slot->frame = w->frame;
+    slot->tick = tick;
+    slot->publish_ns = publish_ns;
+    atomic_store_explicit(&slot->seq, w->frame * 2, memory_order_release);
+    atomic_store_explicit(&w->header->latest, w->frame, memory_order_release);
+}
+
+// 読み出し側
+typedef struct
+{
+    const FrameFeedHeader *header;
+    size_t size;
+} FrameFeedReader;
+
+bool frame_feed_reader_open(FrameFeedReader *r, const char *name);
+void frame_feed_reader_close(FrameFeedReader *r);
+
+/**
+ * @brief 書き終えた最新のフレーム番号を返す。
+ */
+static inline uint64_t frame_feed_latest(const FrameFeedReader *r)
+{
+    return atomic_load_explicit((atomic_uint_fast64_t *)&r->header->latest, memory_order_acquire);
+}
+
+/**
+ * @brief フレームの画素をコピーせずに参照する。すでに上書きが始まっていればNULLを返す。
+ *        使い終えたら frame_feed_still_valid で上書きされなかったかを確かめる。
+ */
+static inline const uint8_t *frame_feed_acquire(const FrameFeedReader *r, uint64_t frame)
+{
+    const FrameFeedSlot *slot = &r->header->slots[frame % r->header->slot_count];
+    if (atomic_load_explicit((atomic_uint_fast64_t *)&slot->seq, memory_order_acquire) != frame * 2)
+        return NULL;
+    return frame_feed_pixels(r->header, frame);
+}
+
+/**
+ * @brief 参照している間に上書きが始まらなかったかを返す。偽値なら読んだ内容を捨てる。
+ */
+static inline bool frame_feed_still_valid(const FrameFeedReader *r, uint64_t frame)
+{
+    atomic_thread_fence(memory_order_acquire);
+    const FrameFeedSlot *slot = &r->header->slots[frame % r->header->slot_count];
+    return atomic_load_explicit((atomic_uint_fast64_t *)&slot->seq, memory_order_relaxed) == frame * 2;
+}
+
+#endif
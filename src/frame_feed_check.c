@@ -0,0 +1,278 @@
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "frame_feed.h"
+#include "soft_raster.h"
+
+// フレーム配信の確認用プログラム
+// 配信中の共有メモリを1kHzで見張り、新しいフレームが公開されるたびに画素をコピーせずに全部読んで、
+// 読んでいる間に上書きされなかったか、飛ばしたフレームがないかを数える。あわせて公開から読み始めるまでの遅れと
+// 1フレームを読み切る手間を測る。合成ソフトがテクスチャに転送するときに画素を1回読むのと同じ手間になる。
+// --self-feed を指定すると自分で共有メモリを作り、フレーム番号から決まる値で埋めるスレッドを動かして
+// input_dispi なしで内容の食い違いがないかを確かめる。
+
+#define SELF_FEED_WIDTH 1920
+#define SELF_FEED_HEIGHT 1080
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static inline uint64_t self_pattern(uint64_t frame)
+{
+    return frame * 0x9E3779B97F4A7C15ULL;
+}
+
+// 自前の書き込みスレッド
+// 60fpsより速い2msごとに書き、読み出し中の上書きが起きやすくする。
+static FrameFeedWriter self_writer;
+static atomic_bool self_running;
+
+static void *self_feed_thread(void *arg)
+{
+    (void)arg;
+    const struct timespec pace = {.tv_sec = 0, .tv_nsec = 2000000}; // 2ms
+    size_t words = (size_t)self_writer.header->stride * self_writer.header->height / sizeof(uint64_t);
+    for (uint64_t tick = 1; atomic_load(&self_running); tick++)
+    {
+        uint64_t *pixels = (uint64_t *)frame_feed_write_begin(&self_writer);
+        uint64_t value = self_pattern(self_writer.frame);
+        for (size_t i = 0; i < words; i++)
+            pixels[i] = value;
+        frame_feed_write_end(&self_writer, tick, now_ns());
+        nanosleep(&pace, NULL);
+    }
+    return NULL;
+}
+
+/**
+ * @brief フレームの画素をすべて読んで合計を求める。
+ */
+static uint64_t sum_pixels(const uint8_t *pixels, size_t size)
+{
+    const uint64_t *p = (const uint64_t *)pixels;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size / sizeof(uint64_t); i++)
+        sum += p[i];
+    return sum;
+}
+
+/**
+ * @brief 最後に読めたフレームを上から下の順のストレートアルファに直してPAM画像で書き出す。
+ */
+static bool dump_frame(const FrameFeedHeader *h, const uint8_t *pixels, const char *path)
+{
+    SoftCanvas canvas;
+    if (!soft_canvas_init(&canvas, h->width, h->height))
+        return false;
+    for (uint32_t y = 0; y < h->height; y++)
+    {
+        uint32_t src_y = h->flags & FRAME_FEED_BOTTOM_UP ? h->height - 1 - y : y;
+        uint8_t *dst = canvas.rgba + (size_t)y * h->width * 4;
+        memcpy(dst, pixels + (size_t)src_y * h->stride, (size_t)h->width * 4);
+        if (!(h->flags & FRAME_FEED_PREMULTIPLIED))
+            continue;
+        for (uint32_t x = 0; x < h->width; x++)
+        {
+            uint8_t *p = dst + x * 4;
+            if (p[3] == 0 || p[3] == 255)
+                continue;
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned v = (p[c] * 255 + p[3] / 2) / p[3];
+                p[c] = v > 255 ? 255 : v;
+            }
+        }
+    }
+    bool ok = soft_canvas_write_pam(&canvas, path);
+    soft_canvas_free(&canvas);
+    return ok;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options] [NAME]\n"
+            "  NAME            shared memory name (default: " FRAME_FEED_DEFAULT_NAME ")\n"
+            "  --seconds N     watch for N seconds (default: 5)\n"
+            "  --self-feed     create the segment and write it from a background thread\n"
+            "  --dump PATH     write the last frame read as a PAM image\n",
+            prog);
+}
+
+static void report_us(const char *label, uint64_t *samples, unsigned long n)
+{
+    if (n == 0)
+        return;
+    qsort(samples, n, sizeof(uint64_t), compare_u64);
+    printf("[info] %s p50 %.1f us, p99 %.1f us, max %.1f us\n", label, samples[(n - 1) / 2] / 1e3,
+           samples[(n - 1) * 99 / 100] / 1e3, samples[n - 1] / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"seconds", required_argument, NULL, 's'},
+        {"self-feed", no_argument, NULL, 'f'},
+        {"dump", required_argument, NULL, 'd'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    int seconds = 5;
+    bool self_feed = false;
+    const char *dump_path = NULL;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'f':
+            self_feed = true;
+            break;
+        case 'd':
+            dump_path = optarg;
+            break;
+        default:
+            print_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    const char *name = optind < argc ? argv[optind] : FRAME_FEED_DEFAULT_NAME;
+    if (seconds <= 0)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    pthread_t writer;
+    if (self_feed)
+    {
+        if (!frame_feed_writer_open(&self_writer, name, SELF_FEED_WIDTH, SELF_FEED_HEIGHT, FRAME_FEED_DEFAULT_SLOTS, 0))
+            return 1;
+        atomic_store(&self_running, true);
+        pthread_create(&writer, NULL, self_feed_thread, NULL);
+    }
+
+    FrameFeedReader reader;
+    if (!frame_feed_reader_open(&reader, name))
+        return 1;
+    const FrameFeedHeader *h = reader.header;
+    size_t frame_size = (size_t)h->stride * h->height;
+    printf("[info] %s: %ux%u, %u slots, flags 0x%x\n", name, h->width, h->height, h->slot_count, h->flags);
+
+    // 1msごとの絶対時刻で見張る
+    int total = seconds * 1000;
+    uint64_t *ages = malloc(total * sizeof(uint64_t));
+    uint64_t *reads_ns = malloc(total * sizeof(uint64_t));
+    // 書き出し用の写しは読み終えてから上書きを確かめるため、2つの領域を交互に使う
+    uint8_t *last_pixels = dump_path ? malloc(frame_size) : NULL;
+    uint8_t *copy_pixels = dump_path ? malloc(frame_size) : NULL;
+    unsigned long reads = 0, skipped = 0, overwritten = 0, mismatched = 0;
+    uint64_t last_frame = 0;
+    bool dumped = false;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (int i = 0; i < total; i++)
+    {
+        next.tv_nsec += 1000000;
+        if (next.tv_nsec >= 1000000000)
+        {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        uint64_t frame = frame_feed_latest(&reader);
+        if (frame == 0 || frame == last_frame)
+            continue;
+        if (last_frame && frame > last_frame + 1)
+            skipped += frame - last_frame - 1;
+        last_frame = frame;
+
+        uint64_t start = now_ns();
+        const uint8_t *pixels = frame_feed_acquire(&reader, frame);
+        if (!pixels)
+        {
+            overwritten++;
+            continue;
+        }
+        uint64_t publish_ns = h->slots[frame % h->slot_count].publish_ns;
+        uint64_t sum = sum_pixels(pixels, frame_size);
+        if (copy_pixels)
+            memcpy(copy_pixels, pixels, frame_size);
+        uint64_t end = now_ns();
+        if (!frame_feed_still_valid(&reader, frame))
+        {
+            overwritten++;
+            continue;
+        }
+        if (self_feed && sum != self_pattern(frame) * (frame_size / sizeof(uint64_t)))
+            mismatched++;
+        ages[reads] = start > publish_ns ? start - publish_ns : 0;
+        reads_ns[reads++] = end - start;
+        if (copy_pixels)
+        {
+            uint8_t *t = last_pixels;
+            last_pixels = copy_pixels;
+            copy_pixels = t;
+            dumped = true;
+        }
+    }
+
+    if (self_feed)
+    {
+        atomic_store(&self_running, false);
+        pthread_join(writer, NULL);
+    }
+
+    printf("[info] %lu frames read over %d s (last frame %llu)\n", reads, seconds, (unsigned long long)last_frame);
+    printf("[info] skipped %lu frames between polls, discarded %lu overwritten while reading\n", skipped, overwritten);
+    report_us("frame age at read", ages, reads);
+    report_us(last_pixels ? "in-place read + copy" : "in-place read", reads_ns, reads);
+    if (reads > 0)
+        printf("[info] %.1f MB per frame, %.0f MB/s at the median read time\n", frame_size / 1048576.0,
+               frame_size / 1048576.0 / (reads_ns[(reads - 1) / 2] / 1e9));
+    int result = 0;
+    if (dump_path && dumped)
+    {
+        if (dump_frame(h, last_pixels, dump_path))
+            printf("[info] wrote %s\n", dump_path);
+        else
+        {
+            perror(dump_path);
+            result = 1;
+        }
+    }
+    free(ages);
+    free(reads_ns);
+    free(last_pixels);
+    free(copy_pixels);
+    frame_feed_reader_close(&reader);
+    if (self_feed)
+        frame_feed_writer_close(&self_writer);
+    if (mismatched)
+    {
+        printf("[error] %lu frames changed while reading without being detected\n", mismatched);
+        return 1;
+    }
+    if (result == 0)
+        printf("[info] all frames consistent\n");
+    return result;
+}
@@ -0,0 +1,234 @@
+#define _GNU_SOURCE
+#include "health.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// 出力する項目
+// scaleが0でなければ秒単位の値（ナノ秒×scale）として出力する。
+static const struct
+{
+    const char *name;
+    const char *type;
+    const char *help;
+    size_t offset;
+    double scale;
+} metrics[] = {
+    {"input_dispi_uptime_seconds", "gauge", "Time since input_dispi started.", offsetof(HealthSnapshot, uptime_ns), 1e-9},
+    {"input_dispi_ticks_total", "counter", "State ticks executed.", offsetof(HealthSnapshot, ticks), 0},
+    {"input_dispi_ticks_skipped_total", "counter", "State ticks given up after oversleeping.", offsetof(HealthSnapshot, ticks_skipped), 0},
+    {"input_dispi_ticks_late_total", "counter", "State ticks woken more than 1 ms after their deadline.", offsetof(HealthSnapshot, ticks_late), 0},
+    {"input_dispi_tick_late_max_seconds", "gauge", "Largest tick wake-up delay.", offsetof(HealthSnapshot, tick_late_max_ns), 1e-9},
+    {"input_dispi_edges_total", "counter", "Input edges applied to the state.", offsetof(HealthSnapshot, edges), 0},
+    {"input_dispi_edges_dropped_total", "counter", "Input edges dropped because the edge queue was full.", offsetof(HealthSnapshot, edges_dropped), 0},
+    {"input_dispi_recorder_dropped_total", "counter", "Edges the session recorder could not queue.", offsetof(HealthSnapshot, recorder_dropped), 0},
+    {"input_dispi_log_resets_total", "counter", "Input log resets by DEL or idle timeout.", offsetof(HealthSnapshot, log_resets), 0},
+    {"input_dispi_snapshot_age_seconds", "gauge", "Time since the state thread last published a snapshot.", offsetof(HealthSnapshot, snapshot_age_ns), 1e-9},
+    {"input_dispi_frames_total", "counter", "Frames rendered.", offsetof(HealthSnapshot, frames), 0},
+    {"input_dispi_render_overruns_total", "counter", "Frames started more than 1.5 frame periods after the previous one.", offsetof(HealthSnapshot, render_overruns), 0},
+    {"input_dispi_render_repeated_states_total", "counter", "Frames that drew the same state tick as the previous frame.", offsetof(HealthSnapshot, repeated_states), 0},
+    {"input_dispi_render_skipped_states_total", "counter", "State ticks replaced before being drawn.", offsetof(HealthSnapshot, skipped_states), 0},
+    {"input_dispi_render_sync_waits_total", "counter", "Render waits for a state tick that timed out (--render-sync).", offsetof(HealthSnapshot, sync_waits), 0},
+};
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief 値をPrometheusのテキスト形式で書き出し、書いた長さを返す。収まらない項目は書かない。
+ */
+size_t health_format(const HealthSnapshot *snap, char *buf, size_t size)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < sizeof(metrics) / sizeof(metrics[0]); i++)
+    {
+        uint64_t value = *(const uint64_t *)((const char *)snap + metrics[i].offset);
+        int n = metrics[i].scale != 0
+                    ? snprintf(buf + len, size - len, "# HELP %s %s\n# TYPE %s %s\n%s %.9g\n", metrics[i].name,
+                               metrics[i].help, metrics[i].name, metrics[i].type, metrics[i].name, value * metrics[i].scale)
+                    : snprintf(buf + len, size - len, "# HELP %s %s\n# TYPE %s %s\n%s %" PRIu64 "\n", metrics[i].name,
+                               metrics[i].help, metrics[i].name, metrics[i].type, metrics[i].name, value);
+        if (n < 0 || (size_t)n >= size - len)
+            break;
+        len += n;
+    }
+    if (len < size)
+        buf[len] = '\0';
+    return len;
+}
+
+/**
+ * @brief 一時ファイルに書いてから置き換え、読み手が書きかけのファイルを読まないようにする。
+ *        node_exporterは .prom で終わるファイルだけを読むため、一時ファイルは読まれない。
+ */
+static bool write_textfile(const char *path, const char *text, size_t len)
+{
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+        return false;
+    FILE *fp = fopen(tmp, "w");
+    if (!fp)
+        return false;
+    bool ok = fwrite(text, 1, len, fp) == len;
+    ok &= fclose(fp) == 0;
+    if (ok && rename(tmp, path) == 0)
+        return true;
+    unlink(tmp);
+    return false;
+}
+
+/**
+ * @brief ソケットに接続してきた相手に現在の値を返して切断する。
+ */
+static void serve_client(HealthExporter *ex, char *text)
+{
+    int fd = accept4(ex->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0)
+        return;
+    HealthSnapshot snap;
+    ex->collect(&snap);
+    size_t len = health_format(&snap, text, HEALTH_TEXT_MAX);
+    for (size_t sent = 0; sent < len;)
+    {
+        ssize_t n = send(fd, text + sent, len - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            break;
+        sent += n;
+    }
+    close(fd);
+}
+
+static void *health_thread(void *arg)
+{
+    HealthExporter *ex = arg;
+    pthread_setname_np(pthread_self(), "input_dispi_hl");
+    static char text[HEALTH_TEXT_MAX];
+    uint64_t interval_ns = (uint64_t)ex->interval_ms * 1000000ULL;
+    uint64_t next_ns = now_ns();
+    bool warned = false;
+    for (;;)
+    {
+        uint64_t now = now_ns();
+        if (ex->textfile_path && now >= next_ns)
+        {
+            HealthSnapshot snap;
+            ex->collect(&snap);
+            size_t len = health_format(&snap, text, sizeof(text));
+            if (!write_textfile(ex->textfile_path, text, len) && !warned)
+            {
+                fprintf(stderr, "[warn] failed to write health textfile %s: %s\n", ex->textfile_path, strerror(errno));
+                warned = true;
+            }
+            next_ns += interval_ns;
+            if (next_ns <= now)
+                next_ns = now + interval_ns;
+        }
+
+        struct pollfd pfd[2] = {{.fd = ex->stop_fd, .events = POLLIN}, {.fd = ex->listen_fd, .events = POLLIN}};
+        int timeout_ms = -1; // ソケットだけなら接続か停止要求まで待つ
+        if (ex->textfile_path)
+        {
+            uint64_t t = now_ns();
+            timeout_ms = next_ns > t ? (int)((next_ns - t + 999999) / 1000000) : 0;
+        }
+        if (poll(pfd, ex->listen_fd >= 0 ? 2 : 1, timeout_ms) < 0 && errno != EINTR)
+            break;
+        if (pfd[0].revents & POLLIN)
+            break;
+        if (ex->listen_fd >= 0 && (pfd[1].revents & POLLIN))
+            serve_client(ex, text);
+    }
+    return NULL;
+}
+
+/**
+ * @brief ソケットを作って待ち受ける。以前の実行で残ったソケットファイルは消してから作る。
+ */
+static int open_listen_socket(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "[error] health socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0)
+    {
+        perror("[error] health socket");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0)
+    {
+        fprintf(stderr, "[error] health socket %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief 書き出しスレッドを開始する。ファイルもソケットも指定がなければ何もしない。
+ */
+bool health_exporter_start(HealthExporter *ex)
+{
+    ex->listen_fd = -1;
+    ex->stop_fd = -1;
+    ex->running = false;
+    if (!ex->textfile_path && !ex->socket_path)
+        return true;
+    if (ex->interval_ms == 0)
+        ex->interval_ms = HEALTH_DEFAULT_INTERVAL_MS;
+    if (ex->socket_path && (ex->listen_fd = open_listen_socket(ex->socket_path)) < 0)
+        return false;
+    ex->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (ex->stop_fd < 0 || pthread_create(&ex->tid, NULL, health_thread, ex) != 0)
+    {
+        perror("[error] health exporter");
+        health_exporter_stop(ex);
+        return false;
+    }
+    ex->running = true;
+    return true;
+}
+
+/**
+ * @brief 書き出しスレッドを止め、ソケットファイルを消す。
+ */
+void health_exporter_stop(HealthExporter *ex)
+{
+    if (ex->running)
+    {
+        uint64_t one = 1;
+        if (write(ex->stop_fd, &one, sizeof(one)) == sizeof(one))
+            pthread_join(ex->tid, NULL);
+        ex->running = false;
+    }
+    if (ex->stop_fd >= 0)
+        close(ex->stop_fd);
+    if (ex->listen_fd >= 0)
+    {
+        close(ex->listen_fd);
+        unlink(ex->socket_path);
+    }
+    ex->stop_fd = ex->listen_fd = -1;
+}
@@ -0,0 +1,88 @@
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+#define HEALTH_DEFAULT_INTERVAL_MS 5000 // テキストファイルの既定の書き出し間隔
+#define HEALTH_TEXT_MAX 4096            // 出力するテキストの上限
+
+// 常時有効な稼働状況カウンタ
+// 各カウンタを書き込むスレッドは1つだけなので、ロックも読み書き一体の命令も使わずに読んで足して書くだけにする。
+// 書き込むスレッドごとにキャッシュラインを分け、互いの更新で同じラインを取り合わないようにしている。
+// 他のモジュールが既に持っている値（tick数、キューの溢れ数など）はここには持たず、出力時に集める。
+typedef struct
+{
+    // 状態管理スレッド
+    _Alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t edges; // 処理したエッジ数
+    atomic_uint_fast64_t log_resets;                      // DELもしくは無操作でログをリセットした回数
+    atomic_uint_fast64_t published_ns;                    // 直近に描画用状態を公開した時刻
+    // 描画スレッド
+    _Alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t frames; // 描画したフレーム数
+    atomic_uint_fast64_t render_overruns;                  // 前のフレームから1.5フレーム以上空いたフレーム数
+    atomic_uint_fast64_t repeated_states;                  // 同じ状態を続けて描いたフレーム数
+    atomic_uint_fast64_t skipped_states;                   // 一度も描かずに置き換わった状態の数
+    atomic_uint_fast64_t sync_waits;                       // --render-sync で状態の公開を待ちきれなかった回数
+} HealthCounters;
+
+/**
+ * @brief 書き込むスレッドが1つだけのカウンタに加算する。
+ */
+static inline void health_add(atomic_uint_fast64_t *counter, uint64_t n)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static inline void health_set(atomic_uint_fast64_t *counter, uint64_t value)
+{
+    atomic_store_explicit(counter, value, memory_order_relaxed);
+}
+
+// 出力する時点の値
+typedef struct
+{
+    uint64_t uptime_ns;
+    uint64_t ticks;
+    uint64_t ticks_skipped;
+    uint64_t ticks_late;
+    uint64_t tick_late_max_ns;
+    uint64_t edges;
+    uint64_t edges_dropped;
+    uint64_t recorder_dropped;
+    uint64_t log_resets;
+    uint64_t snapshot_age_ns;
+    uint64_t frames;
+    uint64_t render_overruns;
+    uint64_t repeated_states;
+    uint64_t skipped_states;
+    uint64_t sync_waits;
+} HealthSnapshot;
+
+// 稼働状況の書き出しスレッド
+// 一定間隔でPrometheus（node_exporterのtextfile collector）形式のファイルを置き換え、
+// Unixドメインソケットに接続があれば同じ内容を返して切断する。
+// 値は collect で集めるため、描画や状態管理のスレッドはこのスレッドを一切待たない。
+typedef struct
+{
+    const char *textfile_path;              // 書き出すファイル（NULLなら書き出さない）
+    const char *socket_path;                // 待ち受けるソケット（NULLなら待ち受けない）
+    unsigned interval_ms;                   // ファイルの書き出し間隔
+    void (*collect)(HealthSnapshot *snap);  // 出力する値を集める関数
+    int listen_fd;
+    int stop_fd;                            // 停止要求のeventfd
+    pthread_t tid;
+    bool running;
+} HealthExporter;
+
+size_t health_format(const HealthSnapshot *snap, char *buf, size_t size);
+bool health_exporter_start(HealthExporter *ex);
+void health_exporter_stop(HealthExporter *ex);
+
+#endif
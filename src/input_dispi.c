@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "raylib.h"
+#include "rlgl.h"
 #include <math.h>
 #include <string.h>
 #include <stdio.h>
@@ -16,6 +17,29 @@
 #include <time.h>
 #include <signal.h>
 #include <termios.h>
+#include <getopt.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <dlfcn.h>
+#include "edge_queue.h"
+#include "triple_buffer.h"
+#include "draw_list.h"
+#include "draw_raylib.h"
+#include "evdev_input.h"
+#include "frame_feed.h"
+#include "health.h"
+#include "latency_trace.h"
+#include "live_feed.h"
+#include "motion.h"
+#include "rt_thread.h"
+#include "session_record.h"
+#include "soft_raster.h"
+#include "state_engine.h"
+#include "text_cache.h"
+#include "font_baked.h"
+#include "tick_scheduler.h"
 
 // 画面のサイズ1920x1920
 #define SCREEN_WIDTH 1920
@@ -26,27 +50,20 @@
 #define BG1_WIDTH 240 // メイン領域幅
 #define BG2_WIDTH 30  // 見栄え用の終端グラデーション幅
 
-#define MAX_LOG 22        // 最大入力ログ表示数。画面の縦幅に併せた件数にする
-#define MAX_TRAJECTORY 15 // 最大レバー軌跡数。描画の負担にならない程度にする
 #define LINE_HEIGHT 36    // 行高さ。フォントサイズと調整した高さにする
 
 // レバー軌跡とボタン状態の表示オフセット
-#define STATUS_X1 80   // 1Pログ表示の左端
-#define STATUS_X2 1680 // 2Pログ表示の左端
-#define STATUS_Y 980   // 1P2P共通の上端
+// 3人以上のときは左右それぞれ内側の列へずらす（init_player_layouts）
+#define STATUS_X1 80   // 左端の列のログ表示の左端
+#define STATUS_X2 1680 // 右端の列のログ表示の左端
+#define STATUS_Y 980   // 全プレイヤー共通の上端
 
 // ログ表示オフセット
-#define LOG_X1 40                 // 1Pログ表示の左端
-#define LOG_X2 1860               // 2Pログ表示の左端
+#define LOG_X1 40                 // 左端の列のログ表示の左端
+#define LOG_X2 1860               // 右端の列のログ表示の左端
 #define LOG_X_FIX 80              // ログ表示の個別の補正幅
-#define LOG_Y (LINE_HEIGHT * 3.5) // 1P2P共通の上端
-#define MAX_FRAME_COUNT 1000
-#define RESET_FRAME_COUNT 1800 // 30秒間無操作（約1800フレーム）でリセット
-
-// 文字のコードポイントキャッシュ数
-#define COUNT_CACHE_SIZE 1001 // フレームカウント文字列000～999およびLOTのキャッシュ数
-#define DIR_STATE_COUNT 16    // レバー状態ビット構成の0～Fにあわせた上下左右文字のキャッシュ数
-#define BTN_STATE_COUNT 16    // ボタン状態ビット構成の0～Fにあわせた上下左右文字のキャッシュ数
+#define LOG_Y (LINE_HEIGHT * 3.5) // 全プレイヤー共通の上端
+
 // レバー状態もしくはボタン状態のビット列は次の仕様になります
 // 0 0 0 0
 // | | | |       stick  button
@@ -64,15 +81,20 @@
 // ロックファイル
 #define LOCK_FILE_PATH "/tmp/input_dispi.lock"
 
-// ・↖↗↙↘ が収録されているフォント
-#define FONT_PATH "fonts/InputDispi.otf"
-#define FONT_SIZE 32
+#define TARGET_FPS 60 // 描画のフレームレート
+
+// SCHED_FIFOの優先度。入力検知 > 状態管理 > 描画 の順にする
+#define RT_PRIO_INPUT 50
+#define RT_PRIO_STATE 40
+#define RT_PRIO_RENDER 30
 
 // 状態表示で使う文字サイズと連動したボタンサイズ
 #define BTN_SIZE (FONT_SIZE * 0.5625) // ボタンサイズ
 #define BTN_Y_FIX (FONT_SIZE * 0.4)   // 文字表示位置の補正値
 
-static Font font; // 全体共通のフォント変数
+// 全体共通のフォントテクスチャ
+// ・↖↗↙↘ が収録されている fonts/InputDispi.otf からビルド時に作ったアトラス（font_baked.h）を読み込む
+static Texture2D font_texture;
 
 // ロックファイル用ファイルディスクリプタ（多重起動防止機能で使用）
 static int lock_fd = -1;
@@ -131,6 +153,7 @@ static void release_lock(void)
 }
 
 static volatile sig_atomic_t exit_requested = 0;
+static volatile sig_atomic_t trace_dump_requested = 0;
 
 static void sigint_handler(int sig)
 {
@@ -138,17 +161,30 @@ static void sigint_handler(int sig)
     exit_requested = 1;
 }
 
+static void sigusr1_handler(int sig)
+{
+    (void)sig;
+    trace_dump_requested = 1;
+}
+
 /**
  * @brief SIGINTシグナルハンドラを登録する。
  *        安全なプログラム中断を可能にする。
+ *        遅延トレースが有効な場合はSIGUSR1でトレースを書き出せるようにする。
  */
-static void setup_signal_handlers(void)
+static void setup_signal_handlers(bool trace)
 {
     struct sigaction sa;
     sa.sa_handler = sigint_handler;
     sigemptyset(&sa.sa_mask);
     sa.sa_flags = 0;
     sigaction(SIGINT, &sa, NULL);
+
+    if (trace)
+    {
+        sa.sa_handler = sigusr1_handler;
+        sigaction(SIGUSR1, &sa, NULL);
+    }
 }
 
 /**
@@ -171,220 +207,191 @@ static void reset_terminal_mode(void)
     }
 }
 
-// raylibのテキスト描画はコードポイントを事前に登録してそこから文字列を指定する
-// 必要になるテキストを事前に用意しておきユニークなコードポイント列として保存する
-static char *text = "•・↖↗↙↘↑↓←→ABCD0123456789LOTあいうえお";
-
-// デバッグ表示はスタート+セレクト同時押しのトグル方式になるため
-// トグル用に前回状態を保存することと
-// 入力検知からの状態変更、表示スレッドへ順に連携させていく必要がある
-static bool show_debug = false; // デバッグ状態のフラグ本体
-static bool rt_debug_state = false; // 入力検知時のバッファ
-static bool debug_triggered = false; // 更新トリガー用のバッファ
-static bool prev_debug_state = false; // 前回状態
-
-// レバー状態とボタン状態と継続フレームカウントの構造体
-// コードポイントキャッシュから文字列を解決するためのインデックスと有限カウンタでの構成としている。
+// フレームカウント・レバー・ボタンの文字列キャッシュ
+// ビルド時に生成した表（font_baked.h）をそのまま参照する。基準画像の確認時だけ確認用フォントの表に差し替える。
+static const CachedText *count_cache = baked_text_caches.count;
+static const CachedText *subframe_cache = baked_text_caches.subframe;
+static const CachedText *dir_cache = baked_text_caches.dir;
+static const CachedText *button_cache = baked_text_caches.button;
+static bool subframe_counts; // --subframe 指定時は100フレーム未満のカウントを1/10フレーム単位で表示する
+
+// コマンドの認識に使うオートマトン。--motions もしくは --motion-file 指定時だけ読み込む
+// 読み込んだ後は状態管理スレッドと描画スレッドが読み出すだけなので共有する。
+static MotionTable motion_table;
+static const MotionTable *motions;
+
+// 入力ログに添えるコマンドの表示文字列
+// 定義は実行時に読み込むため、1文字ずつのキャッシュ（baked_glyph_texts）を並べて縮小したものを作っておく。
+#define MOTION_LABEL_SCALE 0.625f // ログの文字に対する大きさ
+#define MOTION_LABEL_GAP 8        // ボタン表示との間隔
 typedef struct
 {
-    unsigned char dir_index : 4;   // 上下左右状態のビット値を合成した計算省略用フィールド
-    unsigned char btn_index : 4;   // ABCD状態のビット値を合成した計算省略用フィールド
-    unsigned short int count : 10; // フレームカウント0-1000まで
-} LogState;
-
-// 入力検知用状態フラグ構造体
-// 1000Hzで動作する入力検知用スレッドで高速に更新をしていくため単純なON/OFF構成にしている。
-// 状態管理スレッドでフラグ判定からのビット加算してLogStateへ変換するために利用する。
-typedef struct
+    float width;
+    int quad_count;
+    GlyphQuad quads[MOTION_LABEL_MAX];
+} MotionLabel;
+static MotionLabel motion_labels[MOTION_MAX];
+static Color MOTION_LABEL_COLOR = (Color){0xFF, 0xD0, 0x00, 0xFF}; // #FFD000FF
+
+// 状態更新スレッドと入力検知スレッド用のエッジキュー
+// 入力検知スレッドは変化のたびに時刻つきのエッジを積み、状態管理スレッドがtickごとにすべて取り出す。
+static EdgeQueue edge_queue;
+
+// エッジが取得されてから画面に出るまでの遅延の記録。--trace 指定時だけ有効
+static LatencyTrace latency_trace;
+
+// スレッドごとの起床遅れ。入力検知は予定した確認時刻もしくは入力の時刻から、
+// 状態管理はtickの期限から、描画は前のフレームから1フレーム分の時間が経ってから動き出すまでの遅れ
+static WakeHistogram wake_input = {.name = "input"};
+static WakeHistogram wake_state = {.name = "state"};
+static WakeHistogram wake_render = {.name = "render"};
+
+// 描画スレッドと状態更新スレッドはトリプルバッファで受け渡し、互いにロックで待たないようにする。
+static DrawableSet drawable_sets[3];
+static TripleBuffer drawable_buffer;
+
+// --render-sync のときに状態を公開するたびに描画スレッドへ知らせるeventfd（-1なら知らせない）
+// 描画スレッドは通知を待ってから描くため、1フレームでちょうど1tick分の状態を描く。
+static int tick_event_fd = -1;
+
+// 描画処理はraylibを直接呼ばずに1フレーム分の描画命令列を組み立てる。
+// 命令列はraylibもしくはソフトウェアラスタライザで実行するため、画面がなくても描画の計測や出力確認ができる。
+
+static inline DrawColor to_draw_color(Color c)
 {
-    unsigned char up : 1;
-    unsigned char down : 1;
-    unsigned char left : 1;
-    unsigned char right : 1;
-    unsigned char a : 1;
-    unsigned char b : 1;
-    unsigned char c : 1;
-    unsigned char d : 1;
-} InputState;
+    return (DrawColor){c.r, c.g, c.b, c.a};
+}
 
 /**
- * @brief 各ビット値の合計フィールドを比較して同値なら真値を返す。
+ * @brief 文字表示用のユーティリティです。寄せ方向にあわせた位置で文字の矩形列を追加する。
  */
-static inline bool is_neutral(const LogState *a)
+static void draw_text(DrawList *list, const CachedText *c, int x, int y, int align)
 {
-    return a->dir_index == 0 && a->btn_index == 0;
+    if (!c || c->quad_count <= 0)
+        return;
+    int base_x = x;
+    if (align == CENTER)
+        base_x = x - c->width / 2;
+    else if (align == RIGHT)
+        base_x = x - c->width;
+    draw_list_glyphs(list, c->quads, c->quad_count, base_x, y, to_draw_color(WHITE));
 }
 
 /**
- * @brief 各ビット値の合計フィールドを比較して同値なら真値を返す。
+ * @brief コマンドの表示文字列を1文字ずつのキャッシュから組み立てる。
+ *        文字の間隔はビルド時の文字列キャッシュと同じ規則にし、全体を MOTION_LABEL_SCALE 倍に縮める。
+ *        使える文字は定義の読み込み時に確かめてあるが、アトラスにその文字がなければ偽を返す。
  */
-static inline bool is_equal_state(const LogState *a, const LogState *b)
-{
-    return a->dir_index == b->dir_index && a->btn_index == b->btn_index;
-}
-
-// 文字キャッシュ構造体
-// 文字列を逐次コードポイントに変換して使用後に破棄すると非効率であるため
-// 事前に使用するすべての文字パターンをキャッシュとして保持するようにする。
-// 描画に必要なコードポイントとその長さで構成している。
-// 元文字列を保持しているのはコードポイントではなく文字列そのものを要求する関数の利用があるため。
-// レバー状態とボタンの組み合わせが上限となるため文字列長は短めで設定している。
-// 
-// [入力ログ表示の仕様]
-// 000 →ABCD
-// ~~~ ~~~~~~
-//  |   |
-//  |   `----- 最大5文字: レバー状態とボタンの組み合わせ
-//  `--------- 最大3文字: 000～999もしくはLOT
-typedef struct
+static bool build_motion_labels(const MotionTable *t)
 {
-    char text[5];        // 元文字列
-    int *codepoints;     // 文字列と一致するコードポイントバッファ
-    int codepoint_count; // コードポイント数=文字数
-} CachedText;
-
-static void init_cached_text(CachedText *c, const char *s)
-{
-    memset(c->text, 0, sizeof(c->text));
-    strncpy(c->text, s, sizeof(c->text) - 1);
-    c->codepoints = LoadCodepoints(c->text, &c->codepoint_count);
-}
-
-static CachedText count_cache[COUNT_CACHE_SIZE];
-static CachedText dir_cache[DIR_STATE_COUNT];
-static CachedText button_cache[BTN_STATE_COUNT];
-
-static void init_codepoint_cache()
-{
-    char buf[8];
-    for (int i = 0; i < MAX_FRAME_COUNT; i++)
-    {
-        snprintf(buf, sizeof(buf), "%03d", i);
-        init_cached_text(&count_cache[i], buf);
-    }
-    init_cached_text(&count_cache[MAX_FRAME_COUNT], "LOT");
-
-    const char *nt = "•", *up = "↑", *down = "↓", *left = "←", *right = "→",
-               *ul = "↖", *ur = "↗", *dl = "↙", *dr = "↘";
-    const char *directions[DIR_STATE_COUNT] = {
-        nt,    // 0x00 neutral
-        up,    // 0x01
-        down,  // 0x02
-        nt,    // 0x03 (↑↓ cancel)
-        left,  // 0x04
-        ul,    // 0x05
-        dl,    // 0x06
-        left,  // 0x07 (↑↓+←)
-        right, // 0x08
-        ur,    // 0x09
-        dr,    // 0x0A
-        right, // 0x0B (↑↓+→)
-        nt,    // 0x0C (←→ cancel)
-        up,    // 0x0D (←→+↑)
-        down,  // 0x0E (←→+↓)
-        nt     // 0x0F (↑↓←→ cancel)
-    };
-    for (int i = 0; i < DIR_STATE_COUNT; i++)
+    for (int m = 0; m < t->motion_count; m++)
     {
-        init_cached_text(&dir_cache[i], directions[i]);
-    }
-
-    for (int i = 0; i < BTN_STATE_COUNT; i++)
-    {
-        int len = 0;
-        char b[8] = "";
-        if (i & 0x1)
-            b[len++] = 'A';
-        if (i & 0x2)
-            b[len++] = 'B';
-        if (i & 0x4)
-            b[len++] = 'C';
-        if (i & 0x8)
-            b[len++] = 'D';
-        b[len] = '\0';
-        init_cached_text(&button_cache[i], b);
+        MotionLabel *label = &motion_labels[m];
+        float offset_x = 0;
+        label->quad_count = 0;
+        for (const char *s = t->motions[m].label; *s;)
+        {
+            int len = (*s & 0x80) == 0 ? 1 : (*s & 0xE0) == 0xC0 ? 2 : (*s & 0xF0) == 0xE0 ? 3 : 4;
+            const CachedText *glyph = NULL;
+            for (int g = 0; g < BAKED_GLYPH_COUNT && !glyph; g++)
+                if (strncmp(baked_glyph_texts[g].text, s, len) == 0 && baked_glyph_texts[g].text[len] == '\0')
+                    glyph = &baked_glyph_texts[g];
+            if (!glyph)
+            {
+                fprintf(stderr, "[error] motion %s: no glyph for '%.*s' in the font atlas\n", t->motions[m].name, len, s);
+                return false;
+            }
+            for (int q = 0; q < glyph->quad_count && label->quad_count < MOTION_LABEL_MAX; q++)
+            {
+                GlyphQuad quad = glyph->quads[q];
+                quad.dst.x = (quad.dst.x + offset_x) * MOTION_LABEL_SCALE;
+                quad.dst.y *= MOTION_LABEL_SCALE;
+                quad.dst.width *= MOTION_LABEL_SCALE;
+                quad.dst.height *= MOTION_LABEL_SCALE;
+                label->quads[label->quad_count++] = quad;
+            }
+            offset_x += glyph->width + 2;
+            s += strnlen(s, len);
+        }
+        label->width = offset_x > 0 ? (offset_x - 2) * MOTION_LABEL_SCALE : 0;
     }
+    return true;
 }
 
-static void cleanup_codepoint_cache()
+/**
+ * @brief 入力ログの行にコマンドの表示文字列を添える。下端をログの文字にそろえる。
+ */
+static void draw_motion_label(DrawList *list, unsigned motion, int x, int y, int align)
 {
-    for (int i = 0; i < COUNT_CACHE_SIZE; i++)
-        if (count_cache[i].codepoints)
-            UnloadCodepoints(count_cache[i].codepoints);
-    for (int i = 0; i < DIR_STATE_COUNT; i++)
-        if (dir_cache[i].codepoints)
-            UnloadCodepoints(dir_cache[i].codepoints);
-    for (int i = 0; i < BTN_STATE_COUNT; i++)
-        if (button_cache[i].codepoints)
-            UnloadCodepoints(button_cache[i].codepoints);
+    if (!motions || motion == 0 || motion > (unsigned)motions->motion_count)
+        return;
+    const MotionLabel *label = &motion_labels[motion - 1];
+    float base_x = align == RIGHT ? x - label->width : x;
+    draw_list_glyphs(list, label->quads, label->quad_count, base_x, y + FONT_SIZE * (1 - MOTION_LABEL_SCALE),
+                     to_draw_color(MOTION_LABEL_COLOR));
 }
 
-static pthread_mutex_t input_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
-
-// 状態更新スレッドと入力検知スレッド用の中間バッファ
-static InputState realtime_state1 = {0}, realtime_state2 = {0};
-static bool cur_debug_state = false;
-
-// 描画スレッドと状態更新スレッド用の中間バッファ
-// 軌跡と入力ログは固定長配列。
-// 添え字が少ないほど最新のもので入力ログの最新データはカウントアップされていく。
-// フラグにより1P、2Pそれぞれの描画有無を制御する。
-// 一定時間入力がない場合はデータ初期化のうえ描画を抑制して可視性をよくする。
-static unsigned int drawable_traj1[MAX_TRAJECTORY] = {0}; // 1P 軌跡データ
-static unsigned int drawable_traj2[MAX_TRAJECTORY] = {0}; // 2P 軌跡データ
-static LogState drawable_log1[MAX_LOG] = {0};             // 1P 入力ログデータ
-static LogState drawable_log2[MAX_LOG] = {0};             // 2P 入力ログデータ
-static bool drawable1, drawable2;                         // 描画するかどうかのbool値
-
 /**
- * @brief 文字表示用のユーティリティです。
+ * @brief フレームカウントの表示文字列を返す。tenthsは1/10フレーム単位の継続時間（0なら不明）。
  */
-static void draw_text(const CachedText *c, int x, int y, int align)
+static const CachedText *count_text(unsigned count, uint32_t tenths)
 {
-    if (!c || !c->codepoints || c->codepoint_count <= 0)
-        return;
-    Vector2 sizeVec = MeasureTextEx(font, c->text, FONT_SIZE, 1);
-    int base_x = x;
-    if (align == CENTER)
-        base_x = x - sizeVec.x / 2;
-    else if (align == RIGHT)
-        base_x = x - sizeVec.x;
-    DrawTextCodepoints(font, c->codepoints, c->codepoint_count, (Vector2){base_x, y}, FONT_SIZE, 2, WHITE);
+    if (subframe_counts && tenths > 0 && tenths < SUBFRAME_CACHE_SIZE)
+        return &subframe_cache[tenths];
+    return &count_cache[count];
 }
 
 /**
  * @brief レバーとボタンおよびフレームカウントの入力ログを表示する。
+ *        最新行のフレームカウントは描画する時点で変わるため draw_top_count で別に表示する。
  */
-static void draw_logs(const LogState *log, int x, int baseY, int align_right, int len)
+static void draw_logs(DrawList *list, const LogState *log, const uint16_t *tenths, int x, int baseY, int align_right, int len)
 {
     for (int i = 0; i < len; ++i)
     {
-        if (log[i].count == 0)
+        if (!log[i].used)
             continue;
 
-        CachedText *direction = &dir_cache[log[i].dir_index];
-        CachedText *buttons = &button_cache[log[i].btn_index];
+        const CachedText *direction = &dir_cache[log[i].dir_index];
+        const CachedText *buttons = &button_cache[log[i].btn_index];
         int y = baseY + i * LINE_HEIGHT;
+        bool with_count = i > 0;
 
         if (align_right)
         {
             int dx = x - LOG_X_FIX;
-            Vector2 btnSize = MeasureTextEx(font, buttons->text, FONT_SIZE, 1);
-            draw_text(direction, dx - btnSize.x, y, RIGHT);     // 方向
-            draw_text(buttons, dx, y, RIGHT);                   // ボタン
-            draw_text(&count_cache[log[i].count], x, y, RIGHT); // フレームカウント
+            draw_text(list, direction, dx - buttons->width, y, RIGHT); // 方向
+            draw_text(list, buttons, dx, y, RIGHT);                    // ボタン
+            draw_motion_label(list, log[i].motion, dx - buttons->width - direction->width - MOTION_LABEL_GAP, y, RIGHT); // コマンド
+            if (with_count)
+                draw_text(list, count_text(log_count_from_tenths(tenths[i]), tenths[i]), x, y, RIGHT); // フレームカウント
         }
         else
         {
-            draw_text(&count_cache[log[i].count], x, y, LEFT); // フレームカウント
-            draw_text(direction, x + LOG_X_FIX, y, LEFT);      // 方向
-            Vector2 dirSize = MeasureTextEx(font, direction->text, FONT_SIZE, 1);
-            draw_text(buttons, x + LOG_X_FIX + dirSize.x, y, LEFT); // ボタン
+            if (with_count)
+                draw_text(list, count_text(log_count_from_tenths(tenths[i]), tenths[i]), x, y, LEFT); // フレームカウント
+            draw_text(list, direction, x + LOG_X_FIX, y, LEFT);                  // 方向
+            draw_text(list, buttons, x + LOG_X_FIX + direction->width, y, LEFT); // ボタン
+            draw_motion_label(list, log[i].motion, x + LOG_X_FIX + direction->width + buttons->width + MOTION_LABEL_GAP, y,
+                              LEFT); // コマンド
         }
     }
 }
 
+/**
+ * @brief 最新行のフレームカウントを表示する。毎フレーム、パネルに重ねて描画する。
+ *        継続中のログは開始時刻と描画する時点の時刻からカウントを求めるため、tickの遅れに影響されない。
+ */
+static void draw_top_count(DrawList *list, const PlayerDrawable *pd, double frame_ns, uint64_t now_ns, int x, int baseY, int align_right)
+{
+    if (!pd->log[0].used)
+        return;
+    uint32_t tenths = pd->tenths[0];
+    if (pd->top_open)
+        tenths = log_duration_tenths(now_ns > pd->top_start_ns ? now_ns - pd->top_start_ns : 0, frame_ns);
+    draw_text(list, count_text(log_count_from_tenths(tenths), tenths), x, baseY, align_right ? RIGHT : LEFT);
+}
+
 // 非アクティブ時のボタンの色
 // ネオジオのボタン色と配置にあわせたものにしている。
 static Color BTN_COL_INACTIVE = (Color){0x80, 0x80, 0x80, 0xFF}; // #808080FF
@@ -393,25 +400,48 @@ static Color BTN_COL_B2 = (Color){0x60, 0x60, 0, 0xFF};          // #606000FF
 static Color BTN_COL_C2 = (Color){0, 0x60, 0, 0xFF};             // #006000FF
 static Color BTN_COL_D2 = (Color){0, 0x60, 0x60, 0xFF};          // #006060FF
 
+// レバーとボタン表示の分割済み図形
+// 位置は描画時の平行移動で決めるため、表示位置を原点とした形状を全プレイヤーで共有する。
+// ボタンは押下中と非押下の色ごとに用意し、毎フレームは状態に応じて選ぶだけにする。
+#define STATUS_CIRCLE_SEGMENTS 36 // DrawCircleVと同じ分割数
+#define STATUS_BOX_SEGMENTS 8
+#define STATUS_BOX_VERTICES ((5 * 2 + 4 * STATUS_BOX_SEGMENTS) * 3)
+#define STATUS_CIRCLE_VERTICES (STATUS_CIRCLE_SEGMENTS * 3)
+#define STATUS_BUTTONS 4
+typedef struct
+{
+    DrawTriangles box;
+    DrawTriangles stick;
+    DrawTriangles buttons[STATUS_BUTTONS][2]; // [ボタン][押下中]
+    DrawVertex box_vertices[STATUS_BOX_VERTICES];
+    DrawVertex stick_vertices[STATUS_CIRCLE_VERTICES];
+    DrawVertex button_vertices[STATUS_BUTTONS][2][STATUS_CIRCLE_VERTICES];
+} StatusShapes;
+
+static StatusShapes status_shapes;
+
+// ボタンのレバー表示からの位置
+static const Vector2 button_offsets[STATUS_BUTTONS] = {{80, 0}, {108, -25}, {144, -32}, {180, -30}};
+
 /**
- * @brief draw_stick_and_buttonsで使用するサブ関数でボタンラベルと円を表示する。
+ * @brief レバー枠、レバー、ボタンの図形を三角形に分割しておく。
  */
-static void draw_button_label(int btn_index, int btn, int x, int y)
+static void init_status_shapes(void)
 {
-    bool active = btn & btn_index;
-    Color color = BLACK;
-    if (btn_index == 0x1)
-        color = active ? RED : BTN_COL_A2;
-    else if (btn_index == 0x2)
-        color = active ? GOLD : BTN_COL_B2;
-    else if (btn_index == 0x4)
-        color = active ? LIME : BTN_COL_C2;
-    else if (btn_index == 0x8)
-        color = active ? SKYBLUE : BTN_COL_D2;
-    else
-        return;
-    DrawCircleV((Vector2){x, y}, BTN_SIZE, color);
-    draw_text(&button_cache[btn_index], x, y - BTN_Y_FIX, CENTER);
+    const Color active[STATUS_BUTTONS] = {RED, GOLD, LIME, SKYBLUE};
+    const Color inactive[STATUS_BUTTONS] = {BTN_COL_A2, BTN_COL_B2, BTN_COL_C2, BTN_COL_D2};
+    StatusShapes *m = &status_shapes;
+    m->box = (DrawTriangles){0, STATUS_BOX_VERTICES, m->box_vertices};
+    draw_triangles_add_rect_rounded(&m->box, -45, -45, 90, 90, 0.3f, STATUS_BOX_SEGMENTS, to_draw_color(WHITE));
+    m->stick = (DrawTriangles){0, STATUS_CIRCLE_VERTICES, m->stick_vertices};
+    draw_triangles_add_circle(&m->stick, 0, 0, 14, STATUS_CIRCLE_SEGMENTS, to_draw_color(RED));
+    for (int b = 0; b < STATUS_BUTTONS; b++)
+        for (int on = 0; on < 2; on++)
+        {
+            DrawTriangles *tris = &m->buttons[b][on];
+            *tris = (DrawTriangles){0, STATUS_CIRCLE_VERTICES, m->button_vertices[b][on]};
+            draw_triangles_add_circle(tris, 0, 0, BTN_SIZE, STATUS_CIRCLE_SEGMENTS, to_draw_color(on ? active[b] : inactive[b]));
+        }
 }
 
 /**
@@ -453,105 +483,121 @@ static void init_stick_vector_cache(Vector2 *cache, int cx, int cy, int radius)
     }
 }
 
-static Vector2 stick_vector_cache1[16];
-static Vector2 stick_vector_cache2[16];
-
 /**
- * @brief レバーとボタンの入力状態をビジュアル表現する。
+ * @brief 高解像度軌跡を1本の折れ線として描画する。
+ *        各点はその位置を離れてからの時間で色とアルファを決め、TRAIL_FADE_NS で消える。
  */
-static void draw_stick_and_buttons(const LogState *log, int base_x, int baseY, unsigned int *trajectory, Vector2 *stick_vector_cache)
+static void draw_trail(DrawList *list, const PlayerDrawable *pd, uint64_t now_ns, const Vector2 *stick_vector_cache)
 {
-    int x = base_x + 80;
-    DrawRectangleRounded((Rectangle){base_x - 45, baseY - 45, 90, 90}, 0.3f, 8, WHITE);
-    for (int i = MAX_TRAJECTORY - 1; i > 0; i--)
+    DrawVertex vertices[TRAIL_POINTS];
+    int n = 0;
+    uint64_t left_ns = now_ns; // その点の位置を離れた時刻。最新の点はまだ離れていない
+    for (int k = 0; k < pd->trail_count; k++)
     {
-        Vector2 p1 = stick_vector_cache[trajectory[i]];
-        Vector2 p2 = stick_vector_cache[trajectory[i - 1]];
-        // #FF0080FF ~ #8000FFFF
-        Color c = (Color){0x80 + 0x7F * i / MAX_TRAJECTORY, 0, 0xFF - 0x7F * i / MAX_TRAJECTORY, 0xFF};
-        DrawLineEx(p1, p2, 12, c);
+        const TrailPoint *pt = &pd->trail[k];
+        Vector2 v = stick_vector_cache[pt->dir];
+        float age = now_ns > left_ns ? (float)(now_ns - left_ns) / TRAIL_FADE_NS : 0.0f;
+        left_ns = pt->time_ns;
+        if (age >= 1.0f)
+            break;
+        // #8000FFFF（新しい）～ #FF0080（古い）で、古いほど透明にする
+        DrawColor c = {0x80 + 0x7F * age, 0, 0xFF - 0x7F * age, 0xFF * (1.0f - age)};
+        if (n > 0 && vertices[n - 1].x == v.x && vertices[n - 1].y == v.y)
+            continue; // 同じ画面位置になるレバー状態（ニュートラルと相殺）は1点にまとめる
+        vertices[n++] = (DrawVertex){v.x, v.y, c};
     }
-    DrawCircleV(stick_vector_cache[log->dir_index], 14, RED);
-    draw_button_label(0x1, log->btn_index, x, baseY);
-    draw_button_label(0x2, log->btn_index, x + 28, baseY - 25);
-    draw_button_label(0x4, log->btn_index, x + 64, baseY - 32);
-    draw_button_label(0x8, log->btn_index, x + 100, baseY - 30);
+    draw_list_polyline(list, vertices, n, 12);
 }
 
 /**
- * @brief コードポイントから重複するものを取り除いてユニークなもののみをにして返す。
+ * @brief レバーとボタンの入力状態をビジュアル表現する。図形だけを描き、ボタンの文字は draw_button_labels で描く。
+ *        分割済みの図形と軌跡だけなので、続けて描けばraylibでは1回のドローコールにまとまる。
  */
-static int *codepoint_remove_duplicates(int *codepoints, int codepoint_count, int *codepoints_result_count)
+static void draw_stick_and_buttons(DrawList *list, const PlayerDrawable *pd, int base_x, int baseY, uint64_t now_ns, const Vector2 *stick_vector_cache)
 {
-    if (!codepoints || codepoint_count <= 0 || !codepoints_result_count)
-        return NULL;
-
-    int *codepoints_no_dups = (int *)calloc(codepoint_count, sizeof(int));
-    if (!codepoints_no_dups)
-        return NULL;
-
-    int unique_count = 0;
-    for (int i = 0; i < codepoint_count; i++)
+    const LogState *log = &pd->log[0];
+    draw_list_triangles(list, &status_shapes.box, base_x, baseY);
+    draw_trail(list, pd, now_ns, stick_vector_cache);
+    Vector2 stick = stick_vector_cache[log->dir_index];
+    draw_list_triangles(list, &status_shapes.stick, stick.x, stick.y);
+    for (int b = 0; b < STATUS_BUTTONS; b++)
     {
-        bool duplicate = false;
-        for (int j = 0; j < unique_count; j++)
-        {
-            if (codepoints[i] == codepoints_no_dups[j])
-            {
-                duplicate = true;
-                break;
-            }
-        }
-        if (!duplicate)
-        {
-            codepoints_no_dups[unique_count++] = codepoints[i];
-        }
+        bool active = log->btn_index & (1 << b);
+        draw_list_triangles(list, &status_shapes.buttons[b][active], base_x + button_offsets[b].x, baseY + button_offsets[b].y);
     }
-
-    *codepoints_result_count = unique_count;
-    return codepoints_no_dups;
 }
 
 /**
- * @brief 4ビットで上下左右状態を表現したデータを返す。
+ * @brief ボタンの文字を描画する。文字はフォントテクスチャを使うため、図形とは分けてまとめて描く。
  */
-static inline unsigned char conv_dir_index(const InputState *state)
+static void draw_button_labels(DrawList *list, int base_x, int baseY)
 {
-    unsigned char dir_index = 0;
-    if (state->up)
-        dir_index |= 0x1;
-    if (state->down)
-        dir_index |= 0x2;
-    if (state->left)
-        dir_index |= 0x4;
-    if (state->right)
-        dir_index |= 0x8;
-    return dir_index;
+    for (int b = 0; b < STATUS_BUTTONS; b++)
+        draw_text(list, &button_cache[1 << b], base_x + button_offsets[b].x, baseY + button_offsets[b].y - BTN_Y_FIX, CENTER);
 }
 
 /**
- * @brief 4ビットでABCDボタン状態を表現したデータを返す。
+ * @brief エッジを時刻つきでキューに積む。
  */
-static inline unsigned char conv_button_index(const InputState *state)
+static inline void push_edge(uint8_t player, uint16_t word)
 {
-    unsigned char btn_index = 0;
-    if (state->a)
-        btn_index |= 0x1;
-    if (state->b)
-        btn_index |= 0x2;
-    if (state->c)
-        btn_index |= 0x4;
-    if (state->d)
-        btn_index |= 0x8;
-    return btn_index;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    InputEdge e = {
+        .time_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec,
+        .word = word,
+        .player = player};
+    edge_queue_push(&edge_queue, &e);
 }
 
+// raylibバックエンドのキー割り当て
+// evdevバックエンドのkey_mapと同じ割り当てで、slotはプレイヤー番号もしくはRAYLIB_SYSTEM_SLOT。
+// キーボード1台で扱うのは1P/2Pまで。
+#define RAYLIB_SYSTEM_SLOT INPUT_MAX_PLAYERS
+
+typedef struct
+{
+    int key;
+    uint8_t slot;
+    uint16_t bit;
+} RaylibKeyMapping;
+
+static const RaylibKeyMapping raylib_key_map[] = {
+    // 1P
+    {KEY_W, 0, INPUT_BIT_UP},
+    {KEY_S, 0, INPUT_BIT_DOWN},
+    {KEY_A, 0, INPUT_BIT_LEFT},
+    {KEY_D, 0, INPUT_BIT_RIGHT},
+    {KEY_N, 0, INPUT_BIT_A},
+    {KEY_M, 0, INPUT_BIT_B},
+    {KEY_COMMA, 0, INPUT_BIT_C},
+    {KEY_PERIOD, 0, INPUT_BIT_D},
+    {KEY_ONE, 0, INPUT_BIT_START},
+    {KEY_FIVE, 0, INPUT_BIT_SELECT},
+    // 2P
+    {KEY_UP, 1, INPUT_BIT_UP},
+    {KEY_DOWN, 1, INPUT_BIT_DOWN},
+    {KEY_LEFT, 1, INPUT_BIT_LEFT},
+    {KEY_RIGHT, 1, INPUT_BIT_RIGHT},
+    {KEY_KP_1, 1, INPUT_BIT_A},
+    {KEY_KP_2, 1, INPUT_BIT_B},
+    {KEY_KP_3, 1, INPUT_BIT_C},
+    {KEY_KP_4, 1, INPUT_BIT_D},
+    {KEY_TWO, 1, INPUT_BIT_START},
+    {KEY_SIX, 1, INPUT_BIT_SELECT},
+    // DELキー、履歴のスクロール
+    {KEY_DELETE, RAYLIB_SYSTEM_SLOT, INPUT_SYS_DELETE},
+    {KEY_PAGE_UP, RAYLIB_SYSTEM_SLOT, INPUT_SYS_SCROLL_BACK},
+    {KEY_PAGE_DOWN, RAYLIB_SYSTEM_SLOT, INPUT_SYS_SCROLL_FORWARD},
+};
+
 /**
- * @brief 最新の入力データを1000FPSでメモリに記録して状態管理スレッドに移譲する。
+ * @brief 最新の入力データを1000FPSで確認し、変化があればエッジとして状態管理スレッドに移譲する。
  */
 static void *input_thread(void *arg)
 {
     struct timespec interval = {.tv_sec = 0, .tv_nsec = 1000000}; // 1ms
+    uint16_t prev_words[INPUT_MAX_PLAYERS + 1] = {0};
 
     printf("[info] state_thread started\n");
 
@@ -562,251 +608,1491 @@ static void *input_thread(void *arg)
     {
         pthread_testcancel();
 
-        // トグル用：1+5 or 2+6 が同時押し
-        bool switch_debug = false;
-        if ((IsKeyDown(KEY_ONE) && IsKeyDown(KEY_FIVE)) ||
-            (IsKeyDown(KEY_TWO) && IsKeyDown(KEY_SIX)))
+        // 割り当て表の順にキー状態をワードへ詰める
+        uint16_t words[INPUT_MAX_PLAYERS + 1] = {0};
+        for (size_t i = 0; i < sizeof(raylib_key_map) / sizeof(raylib_key_map[0]); i++)
         {
-            switch_debug = true;
+            const RaylibKeyMapping *m = &raylib_key_map[i];
+            words[m->slot] |= -(uint16_t)IsKeyDown(m->key) & m->bit;
         }
 
-        struct timespec frame_start, frame_end;
-        clock_gettime(CLOCK_MONOTONIC, &frame_start);
-
-        // 1P
-        bool up1 = IsKeyDown(KEY_W);
-        bool down1 = IsKeyDown(KEY_S);
-        bool left1 = IsKeyDown(KEY_A);
-        bool right1 = IsKeyDown(KEY_D);
-        bool a1 = IsKeyDown(KEY_N);
-        bool b1 = IsKeyDown(KEY_M);
-        bool c1 = IsKeyDown(KEY_COMMA);
-        bool d1 = IsKeyDown(KEY_PERIOD);
-
-        // 2P
-        bool up2 = IsKeyDown(KEY_UP);
-        bool down2 = IsKeyDown(KEY_DOWN);
-        bool left2 = IsKeyDown(KEY_LEFT);
-        bool right2 = IsKeyDown(KEY_RIGHT);
-        bool a2 = IsKeyDown(KEY_KP_1);
-        bool b2 = IsKeyDown(KEY_KP_2);
-        bool c2 = IsKeyDown(KEY_KP_3);
-        bool d2 = IsKeyDown(KEY_KP_4);
-
-        // 状態更新スレッドへ値連携
-        if (pthread_mutex_lock(&input_lock) == 0)
-        {
-            realtime_state1 = (InputState){
-                up1, down1, left1, right1,
-                a1, b1, c1, d1};
-            realtime_state2 = (InputState){
-                up2, down2, left2, right2,
-                a2, b2, c2, d2};
-            rt_debug_state = switch_debug;
-
-            pthread_mutex_unlock(&input_lock);
-        }
-        else
+        // 状態更新スレッドへ変化分だけ連携
+        for (int slot = 0; slot <= RAYLIB_SYSTEM_SLOT; slot++)
         {
-            fprintf(stderr, "pthread_mutex_lock input_lock failed: %s\n", strerror(errno));
-            exit(EXIT_FAILURE);
+            if (words[slot] != prev_words[slot])
+                push_edge(slot == RAYLIB_SYSTEM_SLOT ? INPUT_PLAYER_SYSTEM : slot, words[slot]);
+            prev_words[slot] = words[slot];
         }
 
+        uint64_t before = latency_trace_now_ns();
         nanosleep(&interval, NULL);
+        uint64_t slept = latency_trace_now_ns() - before;
+        wake_histogram_add(&wake_input, slept > (uint64_t)interval.tv_nsec ? slept - interval.tv_nsec : 0);
     }
     return NULL;
 }
 
 /**
- * @brief 直前の入力データと比較して同値ならフレームカウンタを更新し、異なればログを追加する。
- *        LogState *log : 更新対象のログ（log_1 や log_2）配列
- *        const LogState *new_log : 新しい入力データ
- *        unsigned int *no_op_count : 継続カウント用変数
- *        // 呼び出し例（state_thread内）
- *        update_log_and_count(log_1, &new_log1, &no_op_count1);
- *        update_log_and_count(log_2, &new_log2, &no_op_count2);
+ * @brief evdevバックエンド用の入力検知スレッド。
+ *        ポーリングせずepollでイベントを待ち、カーネルの時刻つきのエッジをそのまま状態管理スレッドに移譲する。
+ *        タイムアウトは終了要求の確認用。
  */
-static inline void update_log_and_count(LogState *log, const LogState *new_log, unsigned int *no_op_count)
+static void *evdev_input_thread(void *arg)
 {
+    EvdevInput *ev = arg;
+    InputEdge edges[64];
+
+    printf("[info] evdev_input_thread started\n");
+
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
 
-    if (is_equal_state(new_log, &log[0]))
+    while (!exit_requested)
     {
-        if (is_neutral(new_log))
+        pthread_testcancel();
+
+        int n = evdev_input_wait(ev, 100, edges, sizeof(edges) / sizeof(edges[0]));
+        if (n < 0)
         {
-            // ニュートラル継続によるリセットカウントを加算
-            if (*no_op_count != -1 && *no_op_count < RESET_FRAME_COUNT)
-                (*no_op_count)++;
+            perror("epoll_wait");
+            exit(EXIT_FAILURE);
         }
-
-        // 継続カウントを加算
-        if (log[0].count < MAX_FRAME_COUNT)
-            log[0].count++;
-    }
-    else
-    {
-        // 入力変更によるログ記録とカウンタリセット
-        memmove(&log[1], &log[0], sizeof(LogState) * (MAX_LOG - 1));
-        log[0] = *new_log;
-        *no_op_count = 1;
+        if (n > 0)
+        {
+            uint64_t now = latency_trace_now_ns();
+            wake_histogram_add(&wake_input, now > edges[0].time_ns ? now - edges[0].time_ns : 0);
+        }
+        for (int i = 0; i < n; i++)
+            edge_queue_push(&edge_queue, &edges[i]);
     }
+    return NULL;
 }
 
+// 状態管理スレッドのtickスケジューラ。周期は起動オプションで選ぶ
+static TickScheduler tick_scheduler;
+
+// セッション記録。--record 指定時だけ開く
+static SessionRecorder session_recorder;
+
+// 状態管理スレッドの状態。起動オプションにあわせてスレッド開始前に初期化する
+static StateContext state_context;
+
+// 他プロセス向けの共有メモリ配信。--live-feed 指定時だけ開く
+static LiveFeedWriter live_feed;
+
+// 描画したフレームの共有メモリ配信。--frame-export 指定時だけ開く
+static FrameFeedWriter frame_feed;
+
+// 稼働状況カウンタは常に更新し、--health-textfile / --health-socket 指定時だけ書き出しスレッドで出力する
+static HealthCounters health;
+static HealthExporter health_exporter;
+static uint64_t health_start_ns;
+
+_Static_assert(LIVE_FEED_MAX_PLAYERS == INPUT_MAX_PLAYERS && LIVE_FEED_LOG_ROWS == MAX_LOG &&
+                   LIVE_FEED_TRAJECTORY == MAX_TRAJECTORY,
+               "live feed layout follows the drawable set");
+
 /**
- * @brief 描画スレッドへの値引き渡し関数です。
+ * @brief 描画スレッドへ渡す状態を共有メモリへ書き込む。読み出し側は待たない。
  */
-static inline void copy_drawable_set(
-    unsigned int *dest_traj, const unsigned int *src_traj,
-    LogState *dest_log, const LogState *src_log,
-    bool *active_flag, int no_op_count)
+static void publish_live_feed(const DrawableSet *set)
 {
-    memcpy(dest_traj, src_traj, MAX_TRAJECTORY * sizeof(unsigned int)); // 軌跡
-    memcpy(dest_log, src_log, MAX_LOG * sizeof(LogState));              // 入力ログ
-    *active_flag = (no_op_count != -1);                                 // 描画可否を渡す
+    LiveFeedFrame *f = live_feed_write_begin(&live_feed);
+    f->tick = set->tick;
+    f->publish_ns = latency_trace_now_ns();
+    f->player_count = set->player_count;
+    f->scroll = set->scroll;
+    for (int p = 0; p < set->player_count; p++)
+    {
+        const PlayerDrawable *pd = &set->players[p];
+        LiveFeedPlayer *out = &f->players[p];
+        out->word = pd->word;
+        out->drawable = pd->drawable;
+        out->history = pd->history;
+        for (int i = 0; i < MAX_TRAJECTORY; i++)
+            out->trajectory[i] = traj_at(pd->traj, i);
+        for (int i = 0; i < MAX_LOG; i++)
+            out->log[i] = (LiveFeedLogEntry){pd->log[i].dir_index, pd->log[i].btn_index,
+                                             pd->log[i].used ? log_count_from_tenths(pd->tenths[i]) : 0};
+    }
+    live_feed_write_end(&live_feed);
 }
 
 /**
- * https://wiki.neogeodev.org/index.php?title=Framerate
- * ネオジオの周波数に合わせた定数を準備しておく。
+ * @brief 1tick分のエッジを状態に反映し、描画スレッドと共有メモリへ公開する。
  */
-static struct timespec INTERVAL_MVS = {.tv_sec = 0, .tv_nsec = 16896002}; // 59.1856
-static struct timespec INTERVAL_AES = {.tv_sec = 0, .tv_nsec = 16778805}; // 59.599
-static struct timespec INTERVAL_60  = {.tv_sec = 0, .tv_nsec = 16666666}; // 60FPS
+static void run_state_tick(StateContext *st, InputEdge *edges, int edge_count, bool recording)
+{
+    for (int i = 0; i < edge_count; i++)
+    {
+        InputEdge *e = &edges[i];
+        e->tick = st->tick;
+        if (recording)
+            session_recorder_push(&session_recorder, e);
+        if (e->player != INPUT_PLAYER_SYSTEM)
+            latency_trace_capture(&latency_trace, e);
+    }
+
+    state_context_tick(st, edges, edge_count, latency_trace_now_ns());
+    if (latency_trace.enabled && edge_count > 0)
+        latency_trace_fold(&latency_trace, latency_trace_now_ns());
+
+    // 描画スレッドへ値連携
+    DrawableSet *set = &drawable_sets[triple_buffer_write_index(&drawable_buffer)];
+    state_context_publish(st, set);
+    if (latency_trace.enabled)
+        set->trace_end = latency_trace_publish(&latency_trace, latency_trace_now_ns());
+    if (live_feed.segment)
+        publish_live_feed(set);
+    triple_buffer_publish(&drawable_buffer);
+    health_add(&health.edges, edge_count);
+    health_set(&health.log_resets, st->log_resets);
+    health_set(&health.published_ns, st->now_ns);
+    if (tick_event_fd >= 0)
+    {
+        uint64_t one = 1;
+        if (write(tick_event_fd, &one, sizeof(one)) < 0)
+            perror("[warn] tick eventfd");
+    }
+}
 
 /**
- * @brief 入力データを60FPSで状態保存する。
+ * @brief 入力データを選択したtickレート（既定はMVSの59.1856Hz）で状態保存する。
  */
 void *state_thread(void *arg)
 {
-    struct timespec interval = INTERVAL_MVS;
-
-    int no_op_count1 = -1, no_op_count2 = -1;
-    InputState current_state1 = {0}, current_state2 = {0};
-    LogState new_log1 = {0}, new_log2 = {0};
-    unsigned int trajectory1[MAX_TRAJECTORY] = {0};
-    unsigned int trajectory2[MAX_TRAJECTORY] = {0};
-    LogState log_1[MAX_LOG] = {0};
-    LogState log_2[MAX_LOG] = {0};
+    TickScheduler *scheduler = arg;
+    StateContext *st = &state_context;
+    static InputEdge tick_edges[EDGE_QUEUE_SIZE];
+    bool recording = session_recorder.fp != NULL;
 
     printf("[info] state_thread started\n");
 
     pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
     pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
 
+    tick_scheduler_start(scheduler);
+    if (recording)
+        session_recorder_start(&session_recorder, scheduler->epoch_ns);
     while (!exit_requested)
     {
         pthread_testcancel();
 
-        struct timespec frame_start, frame_end;
-        clock_gettime(CLOCK_MONOTONIC, &frame_start);
+        // 入力検知スレッドからtick間のエッジをすべて受け取る
+        int edge_count = 0;
+        while (edge_count < EDGE_QUEUE_SIZE && edge_queue_pop(&edge_queue, &tick_edges[edge_count]))
+            edge_count++;
 
-        // 入力検知スレッドから値連携
-        if (pthread_mutex_lock(&input_lock) == 0)
+        run_state_tick(st, tick_edges, edge_count, recording);
+
+        // 次のtickの絶対時刻まで待つ
+        wake_histogram_add(&wake_state, tick_scheduler_wait(scheduler));
+    }
+    return NULL;
+}
+
+/**
+ * @brief evdevバックエンド用のイベントループ（--event-loop）。入力検知と状態管理を1スレッドで行う。
+ *        デバイスとtickの期限を設定したtimerfdを同じepollで待ち、届いたエッジはtickまで手元に溜める。
+ *        エッジキューを使わず、スレッドの切り替えは描画スレッドへの受け渡しだけになる。
+ */
+static void *event_loop_thread(void *arg)
+{
+    EvdevInput *ev = arg;
+    TickScheduler *scheduler = &tick_scheduler;
+    StateContext *st = &state_context;
+    static InputEdge tick_edges[EDGE_QUEUE_SIZE];
+    bool recording = session_recorder.fp != NULL;
+
+    printf("[info] event_loop_thread started\n");
+
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd == -1 || !evdev_input_add_timer(ev, timer_fd))
+    {
+        perror("timerfd_create");
+        exit(EXIT_FAILURE);
+    }
+
+    tick_scheduler_start(scheduler);
+    if (recording)
+        session_recorder_start(&session_recorder, scheduler->epoch_ns);
+    run_state_tick(st, tick_edges, 0, recording);
+    tick_scheduler_arm(scheduler, timer_fd);
+
+    int edge_count = 0;
+    while (!exit_requested)
+    {
+        pthread_testcancel();
+
+        // 溜めたエッジが上限に達したら、次のtickまではタイマーだけを待ち、残りのイベントはカーネル側に残す
+        int n = evdev_input_wait(ev, 100, &tick_edges[edge_count], EDGE_QUEUE_SIZE - edge_count);
+        if (n < 0)
+        {
+            perror("epoll_wait");
+            exit(EXIT_FAILURE);
+        }
+        if (n > 0)
         {
-            current_state1 = realtime_state1;
-            current_state2 = realtime_state2;
-            cur_debug_state = rt_debug_state;
+            uint64_t now = latency_trace_now_ns();
+            InputEdge *first = &tick_edges[edge_count];
+            wake_histogram_add(&wake_input, now > first->time_ns ? now - first->time_ns : 0);
+            edge_count += n;
+        }
+        if (!ev->timer_fired)
+            continue;
 
-            pthread_mutex_unlock(&input_lock);
+        ev->timer_fired = false;
+        wake_histogram_add(&wake_state, tick_scheduler_expired(scheduler));
+        run_state_tick(st, tick_edges, edge_count, recording);
+        edge_count = 0;
+        tick_scheduler_arm(scheduler, timer_fd);
+    }
+    close(timer_fd);
+    return NULL;
+}
+
+// グラデーション用カラー
+static const Color BG_COL1 = (Color){0xC8, 0xC8, 0xC8, 0x30}; // #C8C8C830
+static const Color BG_COL2 = (Color){0xC8, 0xC8, 0xC8, 0x18}; // #C8C8C818
+static const Color BG_COL3 = (Color){0xC8, 0xC8, 0xC8, 0x00}; // #C8C8C800
+
+#define PANEL_WIDTH 320 // プレイヤーごとのパネルキャッシュの幅。グラデーションとログ表示が収まる幅にする
+
+// プレイヤーごとの表示位置
+// 1P, 3P...は左寄せ、2P, 4P...は右寄せで、画面の端から内側へ順に列を並べる。
+// 2人のときは従来どおり1Pが左端、2Pが右端になる。列の間隔は左右それぞれ画面の半分に収まるように詰める。
+typedef struct
+{
+    int side;                       // LEFT/RIGHT 寄せ方向
+    int panel_x;                    // パネルの左端
+    int log_x;                      // ログ表示の基準位置
+    int status_x;                   // レバーとボタン表示の左端
+    Vector2 stick_vector_cache[16]; // レバー位置キャッシュ
+} PlayerLayout;
 
-            // ロック外でログ状態構造体へ変換
-            new_log1 = (LogState){
-                conv_dir_index(&current_state1),
-                conv_button_index(&current_state1),
-                1};
-            new_log2 = (LogState){
-                conv_dir_index(&current_state2),
-                conv_button_index(&current_state2),
-                1};
+static PlayerLayout player_layouts[INPUT_MAX_PLAYERS];
+
+/**
+ * @brief プレイヤー数にあわせて表示位置とレバー位置キャッシュを作る。
+ */
+static void init_player_layouts(int player_count)
+{
+    int columns = (player_count + 1) / 2;
+    int pitch = PANEL_WIDTH;
+    if (pitch * columns > SCREEN_WIDTH / 2)
+        pitch = SCREEN_WIDTH / 2 / columns;
+    for (int p = 0; p < player_count; p++)
+    {
+        PlayerLayout *l = &player_layouts[p];
+        int shift = (p / 2) * pitch;
+        l->side = p % 2 == 0 ? LEFT : RIGHT;
+        if (l->side == LEFT)
+        {
+            l->panel_x = shift;
+            l->log_x = LOG_X1 + shift;
+            l->status_x = STATUS_X1 + shift;
         }
         else
         {
-            fprintf(stderr, "pthread_mutex_lock input_lock failed: %s\n", strerror(errno));
-            exit(EXIT_FAILURE);
+            l->panel_x = SCREEN_WIDTH - PANEL_WIDTH - shift;
+            l->log_x = LOG_X2 - shift;
+            l->status_x = STATUS_X2 - shift;
         }
+        init_stick_vector_cache(l->stick_vector_cache, l->status_x, STATUS_Y, LINE_HEIGHT);
+    }
+    init_status_shapes();
+}
+
+/**
+ * @brief プレイヤーのパネルの背景グラデーションと、最新行のフレームカウントを除いた入力ログを描画する。
+ */
+static void draw_panel_static(DrawList *list, const PlayerLayout *l, const PlayerDrawable *pd)
+{
+    if (l->side == LEFT)
+    {
+        int x = l->panel_x;
+        draw_list_gradient_h(list, x, 0, BG1_WIDTH, SCREEN_HEIGHT, to_draw_color(BG_COL1), to_draw_color(BG_COL2));
+        draw_list_gradient_h(list, x + BG1_WIDTH, 0, BG2_WIDTH, SCREEN_HEIGHT, to_draw_color(BG_COL2), to_draw_color(BG_COL3));
+    }
+    else
+    {
+        int x = l->panel_x + PANEL_WIDTH;
+        draw_list_gradient_h(list, x - BG1_WIDTH, 0, BG1_WIDTH, SCREEN_HEIGHT, to_draw_color(BG_COL2), to_draw_color(BG_COL1));
+        draw_list_gradient_h(list, x - BG1_WIDTH - BG2_WIDTH, 0, BG2_WIDTH, SCREEN_HEIGHT, to_draw_color(BG_COL3), to_draw_color(BG_COL2));
+    }
+    draw_logs(list, pd->log, pd->tenths, l->log_x, LOG_Y, l->side == RIGHT, MAX_LOG);
+}
+
+// プレイヤーごとのパネルの描画キャッシュ
+// 最新行のフレームカウント以外のログ表示はログが追加されるまで変わらないため、
+// 背景グラデーションとあわせた描画命令列をレイヤーとして保持し、毎フレームはそれを合成するだけにする。
+// ログの世代番号、描画可否、最新行の表示有無のいずれかが変わったときだけ組み立て直す。
+typedef struct
+{
+    DrawList list;
+    bool valid;
+    unsigned long log_gen;
+    bool top_visible;
+} PanelCache;
+
+_Static_assert(INPUT_MAX_PLAYERS <= DRAW_LIST_MAX_LAYERS, "one layer per player panel");
+
+static PanelCache panel_cache[INPUT_MAX_PLAYERS];             // レイヤー番号はプレイヤー番号
+static RenderTexture2D panel_targets[INPUT_MAX_PLAYERS];      // raylibで描画するときのレイヤーの実体
+
+/**
+ * @brief 必要であればパネルの描画命令列を組み立て直す。組み立て直したときは真値を返す。
+ */
+static bool update_panel_cache(PanelCache *cache, const PlayerLayout *layout, const PlayerDrawable *pd)
+{
+    bool top_visible = pd->log[0].used;
+    if (cache->valid && cache->log_gen == pd->log_gen && cache->top_visible == top_visible)
+        return false;
+
+    draw_list_reset(&cache->list);
+    draw_panel_static(&cache->list, layout, pd);
+    cache->valid = true;
+    cache->log_gen = pd->log_gen;
+    cache->top_visible = top_visible;
+    return true;
+}
+
+/**
+ * @brief パネルの描画命令列をレンダーテクスチャに描画する。
+ *        アルファを正しく合成するため乗算済みアルファで保持し、貼るときも乗算済みとして合成する。
+ */
+static void render_panel_target(const PanelCache *cache, RenderTexture2D target, const PlayerLayout *layout)
+{
+    BeginTextureMode(target);
+    ClearBackground(BLANK);
+    rlPushMatrix();
+    rlTranslatef(-layout->panel_x, 0, 0);
+    draw_list_execute_raylib(&cache->list, font_texture, NULL, true);
+    rlPopMatrix();
+    EndTextureMode();
+}
+
+/**
+ * @brief 全プレイヤーのパネルキャッシュを更新する。非表示になったパネルは次に表示するときに描き直す。
+ *        targetsを渡したときは組み立て直したパネルをレンダーテクスチャにも描画する。
+ */
+static void update_panel_caches(const DrawableSet *set, const RenderTexture2D *targets)
+{
+    for (int p = 0; p < set->player_count; p++)
+    {
+        const PlayerDrawable *pd = &set->players[p];
+        if (!pd->drawable)
+            panel_cache[p].valid = false;
+        else if (update_panel_cache(&panel_cache[p], &player_layouts[p], pd) && targets)
+            render_panel_target(&panel_cache[p], targets[p], &player_layouts[p]);
+    }
+}
+
+/**
+ * @brief ソフトウェアラスタライザに渡すレイヤーの描画命令列をパネルキャッシュから集める。
+ */
+static void panel_layer_lists(const DrawList **layers)
+{
+    for (int i = 0; i < DRAW_LIST_MAX_LAYERS; i++)
+        layers[i] = i < INPUT_MAX_PLAYERS ? &panel_cache[i].list : NULL;
+}
+
+/**
+ * @brief 1フレーム分の描画命令列を組み立てる。now_nsは継続中のログのカウントを求める時刻。
+ *        パネルキャッシュを使うときは各プレイヤーのパネルをプレイヤー番号のレイヤーとして合成する。
+ *        ドローコールをまとめるため、パネル、全員の図形、全員の文字の順に描く。
+ */
+static void build_frame(DrawList *frame, const DrawableSet *set, bool cached, uint64_t now_ns)
+{
+    draw_list_reset(frame);
+
+    // 背景色
+    // フレームを配信するときはキーカラーではなく透明にして、アルファつきのまま渡す
+    draw_list_clear(frame, to_draw_color(frame_feed.header ? BLANK : BLACK)); // #000000 キーカラー
+
+    // 背景グラデーション
+    // レバー位置とボタン状態の描画
+    // キーログの描画
+    for (int p = 0; p < set->player_count; p++)
+    {
+        const PlayerDrawable *pd = &set->players[p];
+        const PlayerLayout *l = &player_layouts[p];
+        if (!pd->drawable)
+            continue;
+        if (cached)
+            draw_list_layer(frame, p, l->panel_x, 0, PANEL_WIDTH, SCREEN_HEIGHT);
+        else
+            draw_panel_static(frame, l, pd);
+    }
+    for (int p = 0; p < set->player_count; p++)
+    {
+        const PlayerLayout *l = &player_layouts[p];
+        if (set->players[p].drawable)
+            draw_stick_and_buttons(frame, &set->players[p], l->status_x, STATUS_Y, now_ns, l->stick_vector_cache);
+    }
+    for (int p = 0; p < set->player_count; p++)
+    {
+        const PlayerDrawable *pd = &set->players[p];
+        const PlayerLayout *l = &player_layouts[p];
+        if (!pd->drawable)
+            continue;
+        draw_top_count(frame, pd, set->frame_ns, now_ns, l->log_x, LOG_Y, l->side == RIGHT);
+        draw_button_labels(frame, l->status_x, STATUS_Y);
+    }
+}
+
+static DrawList frame_list; // 1フレーム分の描画命令列
 
-        // trajectoryとログ、カウント更新、DELによるリセット処理をここで統合
+// 描画時間の計測値
+// 描画命令の発行から溜まった頂点をGPUへ送り出す（rlDrawRenderBatchActive）までの時間で、
+// EndDrawingでの垂直同期待ちは含めない。送り出しにかかった時間は別にも集計する。
+// ドローコール数の見積もりは描画命令列から求めた値で、デバッグ表示の文字とパネルの描き直しは含めない。
+// 実測のドローコール数（gl_draw_calls）はそれらも含む。
+typedef struct
+{
+    unsigned long frames;
+    double total_us;
+    double max_us;
+    double flush_total_us;    // 送り出しにかかった時間の合計
+    double flush_max_us;
+    unsigned long draw_calls; // 全フレームのドローコール数（見積もり）の合計
+    int last_draw_calls;      // 直前のフレームのドローコール数（見積もり）
+    unsigned long gl_draw_calls; // 全フレームの実測のドローコール数の合計
+    int last_gl_draw_calls;      // 直前のフレームの実測のドローコール数
+    unsigned long last_tick;  // 直前のフレームで描いた状態のtick番号
+    unsigned long repeated;   // 直前のフレームと同じ状態を描いたフレーム数
+    unsigned long skipped;    // 一度も描かずに次の状態に置き換わった状態の数
+} RenderStats;
+
+static RenderStats render_stats;
+
+// フレーム配信の読み出し時間
+// glReadPixelsは描画の完了を待ってから返るため、溜まっていた描画の実行時間も含む。
+// 百分位数は直近 READBACK_SAMPLES フレームから求める。
+#define READBACK_SAMPLES 4096
+
+typedef struct
+{
+    unsigned long frames;
+    double total_us;
+    double max_us;
+    uint64_t samples_ns[READBACK_SAMPLES];
+} ReadbackStats;
+
+static ReadbackStats readback_stats;
+static RenderTexture2D export_target; // 配信するフレームの描画先
+
+// raylibは描画先の画素を呼び出し側のバッファへ直接読む関数を持たないため、
+// raylibが読み込んだOpenGL（ES）の実装からglReadPixelsを取り出して共有メモリへ直接読み出す。
+typedef void (*ReadPixelsFn)(int x, int y, int width, int height, unsigned format, unsigned type, void *pixels);
+static ReadPixelsFn gl_read_pixels;
+#define READBACK_GL_RGBA 0x1908
+#define READBACK_GL_UNSIGNED_BYTE 0x1401
+
+// 実際のドローコール数を数えるため、raylibが呼ぶglDrawElementsとglDrawArraysを数える関数で包む。
+// raylibがglad経由でOpenGLを呼ぶ場合は関数ポインタ（glad_glDrawElements など）を差し替え、
+// GLES2を直接リンクしている場合は同じ名前の関数をここで定義して、数えてから本来の実装（dlsymのRTLD_NEXT）を呼ぶ。
+// どちらでもなければ数えられないため、見積もりだけを表示する。
+typedef void (*DrawElementsFn)(unsigned mode, int count, unsigned type, const void *indices);
+typedef void (*DrawArraysFn)(unsigned mode, int first, int count);
+extern DrawElementsFn glad_glDrawElements __attribute__((weak));
+extern DrawArraysFn glad_glDrawArrays __attribute__((weak));
+static DrawElementsFn gl_draw_elements;
+static DrawArraysFn gl_draw_arrays;
+static unsigned long gl_draw_calls; // 起動からのドローコール数（描画スレッドだけが更新する）
+static bool gl_draw_counted;        // 実際のドローコールを数えられている
+
+static void count_draw_elements(unsigned mode, int count, unsigned type, const void *indices)
+{
+    gl_draw_calls++;
+    gl_draw_elements(mode, count, type, indices);
+}
 
-        // DELキーで状態初期化
-        bool delkey = IsKeyPressed(KEY_DELETE);
-        if (delkey || no_op_count1 >= RESET_FRAME_COUNT)
+static void count_draw_arrays(unsigned mode, int first, int count)
+{
+    gl_draw_calls++;
+    gl_draw_arrays(mode, first, count);
+}
+
+void glDrawElements(unsigned mode, int count, unsigned type, const void *indices)
+{
+    if (!gl_draw_elements)
+        gl_draw_elements = (DrawElementsFn)dlsym(RTLD_NEXT, "glDrawElements");
+    gl_draw_counted = true;
+    count_draw_elements(mode, count, type, indices);
+}
+
+void glDrawArrays(unsigned mode, int first, int count)
+{
+    if (!gl_draw_arrays)
+        gl_draw_arrays = (DrawArraysFn)dlsym(RTLD_NEXT, "glDrawArrays");
+    gl_draw_counted = true;
+    count_draw_arrays(mode, first, count);
+}
+
+/**
+ * @brief raylibがglad経由でOpenGLを呼ぶ場合に、ドローコールの関数ポインタを数える関数に差し替える。
+ *        OpenGLの関数はウィンドウの初期化で読み込まれるため、InitWindowの後に呼ぶ。
+ */
+static void hook_gl_draw_calls(void)
+{
+    if (!&glad_glDrawElements || !&glad_glDrawArrays || !glad_glDrawElements || !glad_glDrawArrays)
+        return;
+    gl_draw_elements = glad_glDrawElements;
+    gl_draw_arrays = glad_glDrawArrays;
+    glad_glDrawElements = count_draw_elements;
+    glad_glDrawArrays = count_draw_arrays;
+    gl_draw_counted = true;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief 直近の読み出し時間の百分位数を求める。
+ */
+static double readback_percentile_us(const ReadbackStats *stats, double q)
+{
+    static uint64_t sorted[READBACK_SAMPLES];
+    size_t n = stats->frames < READBACK_SAMPLES ? stats->frames : READBACK_SAMPLES;
+    if (n == 0)
+        return 0;
+    memcpy(sorted, stats->samples_ns, n * sizeof(uint64_t));
+    qsort(sorted, n, sizeof(uint64_t), compare_u64);
+    return sorted[(size_t)((n - 1) * q)] / 1e3;
+}
+
+/**
+ * @brief 配信用の描画先に描いたフレームを共有メモリの次の枚へ読み出して公開する。
+ *        OpenGLの行の順のまま（下から上）読み出し、上下の反転はしない。
+ */
+static void export_frame(unsigned long tick)
+{
+    rlDrawRenderBatchActive(); // 溜まっている描画命令を描画先に送ってから読む
+    uint64_t start_ns = latency_trace_now_ns();
+    uint8_t *pixels = frame_feed_write_begin(&frame_feed);
+    gl_read_pixels(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, READBACK_GL_RGBA, READBACK_GL_UNSIGNED_BYTE, pixels);
+    uint64_t end_ns = latency_trace_now_ns();
+    frame_feed_write_end(&frame_feed, tick, end_ns);
+
+    uint64_t ns = end_ns - start_ns;
+    readback_stats.samples_ns[readback_stats.frames % READBACK_SAMPLES] = ns;
+    readback_stats.frames++;
+    readback_stats.total_us += ns / 1e3;
+    if (ns / 1e3 > readback_stats.max_us)
+        readback_stats.max_us = ns / 1e3;
+}
+
+/**
+ * @brief 描画した状態のtick番号から、同じ状態を続けて描いた回数と描かずに飛ばした状態の数を数える。
+ *        tickと描画の周期がずれていると、数秒おきにどちらかが起きる。
+ */
+static void count_rendered_tick(RenderStats *stats, unsigned long tick)
+{
+    if (stats->frames > 0)
+    {
+        if (tick == stats->last_tick)
+            stats->repeated++;
+        else if (tick > stats->last_tick + 1)
+            stats->skipped += tick - stats->last_tick - 1;
+    }
+    stats->last_tick = tick;
+}
+
+// 起動オプション
+typedef struct
+{
+    bool use_evdev;                          // 入力をevdevから直接読む
+    const char *devices[EVDEV_MAX_DEVICES];  // --device で指定されたデバイス（未指定なら自動検出）
+    int device_count;
+    const char *fixtures[EVDEV_MAX_DEVICES]; // --fixture で指定されたデバイス代わりのファイル
+    int fixture_count;
+    double tick_period_ns;                   // 状態管理スレッドのtick周期
+    bool panel_cache;                        // パネルの描画キャッシュを使う
+    int headless_frames;                     // 画面なしで描画を計測するフレーム数（0なら通常起動）
+    const char *headless_dump;               // 画面なしで描画した最終フレームの出力先
+    const char *headless_check;              // 画面なしで描画した最終フレームと比べる基準画像
+    bool headless_update;                    // 基準画像と比べずに書き直す
+    const char *trace_path;                  // SIGUSR1で遅延トレースを書き出す先（NULLならトレースしない）
+    const char *record_path;                 // セッション記録の出力先
+    const char *replay_path;                 // 再生するセッション記録
+    bool replay_max;                         // 実時間を待たずに画面なしで再生する
+    SocdPolicy socd_policy;                  // レバーの同時入力の解決方式
+    int players;                             // プレイヤー数
+    const char *live_feed_name;              // 状態を配信する共有メモリ名（NULLなら配信しない）
+    bool rt;                                 // リアルタイム動作（全スレッドをSCHED_FIFO、メモリをロック）
+    int rt_cpus[3];                          // 入力検知・状態管理・描画スレッドを固定するCPU（-1なら固定しない）
+    bool event_loop;                         // 入力検知と状態管理を1スレッドのイベントループで行う（evdevのみ）
+    double count_period_ns;                  // フレームカウントの1フレームの長さ（0ならtick周期）
+    bool startup_time;                       // 最初のフレームを表示したら起動時間を出力して終了する
+    bool render_sync;                        // 描画を固定フレームレートではなく状態の公開にあわせる
+    const char *health_textfile;             // 稼働状況を書き出すPrometheusのテキストファイル
+    const char *health_socket;               // 稼働状況を返すUnixドメインソケット
+    unsigned health_interval_ms;             // 稼働状況のテキストファイルの書き出し間隔
+    bool motions;                            // コマンドを認識して入力ログに添える
+    const char *motion_file;                 // コマンド定義のファイル（NULLなら既定の定義）
+    const char *frame_export_name;           // 描画したフレームを配信する共有メモリ名（NULLなら配信しない）
+    int frame_export_slots;                  // フレーム配信のリングの枚数
+} Options;
+
+#define HEADLESS_CHECK_FRAMES 90 // 基準画像の確認ではログが3回増えるまで描き、パネルの更新も通す
+
+static Options options = {.tick_period_ns = 16896002.0, .panel_cache = true, .players = INPUT_DEFAULT_PLAYERS,
+                          .rt_cpus = {-1, -1, -1}, .frame_export_slots = FRAME_FEED_DEFAULT_SLOTS}; // 既定はMVS
+static EvdevInput evdev;
+
+static void print_usage(const char *prog)
+{
+    printf("usage: %s [options]\n"
+           "  --input raylib|evdev   input backend (default: raylib)\n"
+           "  --device PATH          evdev device to read, repeatable (default: scan /dev/input/event*)\n"
+           "  --fixture PATH         replay a fixture file as an evdev device, repeatable\n"
+           "  --rate mvs|aes|60|HZ   state tick rate (default: mvs = 59.1856 Hz)\n"
+           "  --socd cancel|last|up  opposing direction resolution (default: cancel)\n"
+           "  --count-unit mvs|aes|60|HZ\n"
+           "                         frame length for the log counts (default: the tick rate)\n"
+           "  --subframe             show counts under 100 frames in tenths of a frame\n"
+           "  --players N            number of players, 1-8 (default: 2; evdev devices serve two players each)\n"
+           "  --no-panel-cache       redraw both log panels from scratch every frame\n"
+           "  --headless-bench N     render N frames with the software rasterizer and report the cost\n"
+           "  --headless-dump PATH   write the last headless frame as a PAM image\n"
+           "  --headless-check PATH  render the sample frame with the check font and compare it with the golden PAM\n"
+           "  --headless-update      rewrite the --headless-check golden instead of comparing\n"
+           "  --trace PATH           record per-edge latency, write a Chrome/Perfetto trace to PATH on SIGUSR1\n"
+           "  --record PATH          record every input edge to a session file\n"
+           "  --replay PATH          replay a session file instead of reading input\n"
+           "  --replay-speed realtime|max\n"
+           "                         replay at recorded timing (default) or headless as fast as possible\n"
+           "  --live-feed NAME       publish the state to POSIX shared memory NAME (e.g. " LIVE_FEED_DEFAULT_NAME ")\n"
+           "  --rt                   real-time mode: SCHED_FIFO for all threads, lock and prefault memory\n"
+           "  --rt-cpus I,S,R        pin the input, state and render threads to CPUs (implies --rt)\n"
+           "  --event-loop           run evdev input and the state tick in one epoll/timerfd thread\n"
+           "  --startup-time         report the time to the first frame and exit\n"
+           "  --render-sync          render once per published state tick instead of at a fixed 60 fps\n"
+           "  --health-textfile PATH write health counters in Prometheus text format to PATH (node_exporter textfile)\n"
+           "  --health-socket PATH   serve health counters on a Unix domain socket\n"
+           "  --health-interval MS   textfile update interval (default: 5000)\n"
+           "  --motions              recognise special-move motions (236, 623, charge, 360...) and tag them in the log\n"
+           "  --motion-file PATH     load motion definitions from PATH (implies --motions)\n"
+           "  --frame-export NAME    render with a transparent background and publish RGBA frames to shared memory NAME\n"
+           "                         (e.g. " FRAME_FEED_DEFAULT_NAME ")\n"
+           "  --frame-export-slots N number of frames in the shared memory ring, 2-8 (default: 3)\n"
+           "  -h, --help             show this help\n",
+           prog);
+}
+
+/**
+ * @brief 起動オプションを解析する。--device/--fixture を指定した場合はevdevバックエンドを使う。
+ */
+static void parse_options(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"input", required_argument, NULL, 'i'},
+        {"device", required_argument, NULL, 'd'},
+        {"fixture", required_argument, NULL, 'f'},
+        {"rate", required_argument, NULL, 'r'},
+        {"socd", required_argument, NULL, 's'},
+        {"count-unit", required_argument, NULL, 'u'},
+        {"subframe", no_argument, NULL, 'F'},
+        {"players", required_argument, NULL, 'n'},
+        {"no-panel-cache", no_argument, NULL, 'P'},
+        {"headless-bench", required_argument, NULL, 'B'},
+        {"headless-dump", required_argument, NULL, 'D'},
+        {"headless-check", required_argument, NULL, 'G'},
+        {"headless-update", no_argument, NULL, 'g'},
+        {"trace", required_argument, NULL, 'T'},
+        {"record", required_argument, NULL, 'R'},
+        {"replay", required_argument, NULL, 'p'},
+        {"replay-speed", required_argument, NULL, 'S'},
+        {"live-feed", required_argument, NULL, 'L'},
+        {"rt", no_argument, NULL, 'x'},
+        {"rt-cpus", required_argument, NULL, 'c'},
+        {"event-loop", no_argument, NULL, 'E'},
+        {"startup-time", no_argument, NULL, 'Z'},
+        {"render-sync", no_argument, NULL, 'Y'},
+        {"health-textfile", required_argument, NULL, 'H'},
+        {"health-socket", required_argument, NULL, 'U'},
+        {"health-interval", required_argument, NULL, 'I'},
+        {"motions", no_argument, NULL, 'M'},
+        {"motion-file", required_argument, NULL, 'm'},
+        {"frame-export", required_argument, NULL, 'X'},
+        {"frame-export-slots", required_argument, NULL, 'N'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1)
+    {
+        switch (opt)
         {
-            memset(trajectory1, 0, sizeof(trajectory1));
-            memset(log_1, 0, sizeof(log_1));
-            no_op_count1 = delkey ? 0 : -1;
-        }
-        if (delkey || no_op_count2 >= RESET_FRAME_COUNT)
+        case 'i':
+            if (strcmp(optarg, "evdev") == 0)
+                options.use_evdev = true;
+            else if (strcmp(optarg, "raylib") == 0)
+                options.use_evdev = false;
+            else
+            {
+                fprintf(stderr, "[error] unknown input backend: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'd':
+        case 'f':
         {
-            memset(trajectory2, 0, sizeof(trajectory2));
-            memset(log_2, 0, sizeof(log_2));
-            no_op_count2 = delkey ? 0 : -1;
+            bool fixture = opt == 'f';
+            int *count = fixture ? &options.fixture_count : &options.device_count;
+            if (*count >= EVDEV_MAX_DEVICES)
+            {
+                fprintf(stderr, "[error] too many devices\n");
+                exit(EXIT_FAILURE);
+            }
+            (fixture ? options.fixtures : options.devices)[(*count)++] = optarg;
+            options.use_evdev = true;
+            break;
         }
+        case 'r':
+            if (!tick_scheduler_parse_rate(optarg, &options.tick_period_ns))
+            {
+                fprintf(stderr, "[error] invalid rate: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's':
+            if (!socd_parse_policy(optarg, &options.socd_policy))
+            {
+                fprintf(stderr, "[error] unknown socd policy: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'u':
+            if (!tick_scheduler_parse_rate(optarg, &options.count_period_ns))
+            {
+                fprintf(stderr, "[error] invalid count unit: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'F':
+            subframe_counts = true;
+            break;
+        case 'Z':
+            options.startup_time = true;
+            break;
+        case 'Y':
+            options.render_sync = true;
+            break;
+        case 'M':
+            options.motions = true;
+            break;
+        case 'm':
+            options.motions = true;
+            options.motion_file = optarg;
+            break;
+        case 'X':
+            options.frame_export_name = optarg;
+            break;
+        case 'N':
+            options.frame_export_slots = atoi(optarg);
+            if (options.frame_export_slots < 2 || options.frame_export_slots > FRAME_FEED_MAX_SLOTS)
+            {
+                fprintf(stderr, "[error] invalid frame export slots: %s (2-%d)\n", optarg, FRAME_FEED_MAX_SLOTS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'H':
+            options.health_textfile = optarg;
+            break;
+        case 'U':
+            options.health_socket = optarg;
+            break;
+        case 'I':
+            options.health_interval_ms = atoi(optarg);
+            if (options.health_interval_ms < 100)
+            {
+                fprintf(stderr, "[error] invalid health interval: %s (minimum 100 ms)\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'n':
+            options.players = atoi(optarg);
+            if (options.players < 1 || options.players > INPUT_MAX_PLAYERS)
+            {
+                fprintf(stderr, "[error] invalid player count: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'P':
+            options.panel_cache = false;
+            break;
+        case 'B':
+            options.headless_frames = atoi(optarg);
+            if (options.headless_frames <= 0)
+            {
+                fprintf(stderr, "[error] invalid frame count: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'D':
+            options.headless_dump = optarg;
+            if (options.headless_frames == 0)
+                options.headless_frames = 1;
+            break;
+        case 'G':
+            options.headless_check = optarg;
+            if (options.headless_frames == 0)
+                options.headless_frames = HEADLESS_CHECK_FRAMES;
+            break;
+        case 'g':
+            options.headless_update = true;
+            break;
+        case 'T':
+            options.trace_path = optarg;
+            break;
+        case 'R':
+            options.record_path = optarg;
+            break;
+        case 'p':
+            options.replay_path = optarg;
+            break;
+        case 'S':
+            if (strcmp(optarg, "max") == 0)
+                options.replay_max = true;
+            else if (strcmp(optarg, "realtime") == 0)
+                options.replay_max = false;
+            else
+            {
+                fprintf(stderr, "[error] unknown replay speed: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'L':
+            options.live_feed_name = optarg;
+            break;
+        case 'x':
+            options.rt = true;
+            break;
+        case 'c':
+            if (sscanf(optarg, "%d,%d,%d", &options.rt_cpus[0], &options.rt_cpus[1], &options.rt_cpus[2]) != 3)
+            {
+                fprintf(stderr, "[error] invalid cpu list: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            options.rt = true;
+            break;
+        case 'E':
+            options.event_loop = true;
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
 
-        // レバー軌跡更新
-        memmove(&trajectory1[1], &trajectory1[0], sizeof(unsigned int) * (MAX_TRAJECTORY - 1));
-        trajectory1[0] = new_log1.dir_index;
-        memmove(&trajectory2[1], &trajectory2[0], sizeof(unsigned int) * (MAX_TRAJECTORY - 1));
-        trajectory2[0] = new_log2.dir_index;
+/**
+ * @brief evdevバックエンドのデバイスを開く。1つも開けなければ終了する。
+ */
+static void open_evdev_or_exit(void)
+{
+    if (!evdev_input_init(&evdev, options.players))
+        exit(EXIT_FAILURE);
 
-        // 最新ログのフレームカウント加算かログ更新
-        update_log_and_count(log_1, &new_log1, &no_op_count1);
-        update_log_and_count(log_2, &new_log2, &no_op_count2);
+    int opened = 0;
+    for (int i = 0; i < options.device_count; i++)
+        if (evdev_input_add_device(&evdev, options.devices[i]) >= 0)
+            opened++;
+    if (options.device_count == 0 && options.fixture_count == 0)
+        opened += evdev_input_scan_devices(&evdev);
+    for (int i = 0; i < options.fixture_count; i++)
+        if (evdev_input_add_fixture(&evdev, options.fixtures[i]) >= 0)
+            opened++;
+
+    if (opened == 0)
+    {
+        fprintf(stderr, "[error] no evdev input device available\n");
+        exit(EXIT_FAILURE);
+    }
+}
 
-        // デバッグフラグ更新
-        if (cur_debug_state && !prev_debug_state && !debug_triggered)
+/**
+ * @brief ビルド時に生成したアルファだけのフォントアトラスを、白一色の画像に展開して返す。
+ *        formatはGPU用のPIXELFORMAT_UNCOMPRESSED_GRAY_ALPHAかCPU描画用のPIXELFORMAT_UNCOMPRESSED_R8G8B8A8。
+ */
+static Image load_baked_font_atlas(int format)
+{
+    int channels = format == PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA ? 2 : 4;
+    int pixels = BAKED_FONT_ATLAS_WIDTH * BAKED_FONT_ATLAS_HEIGHT;
+    unsigned char *data = malloc((size_t)pixels * channels);
+    if (!data)
+        return (Image){0};
+    for (int i = 0; i < pixels; i++)
+    {
+        unsigned char *px = data + (size_t)i * channels;
+        memset(px, 0xFF, channels - 1);
+        px[channels - 1] = baked_font_atlas_alpha[i];
+    }
+    return (Image){data, BAKED_FONT_ATLAS_WIDTH, BAKED_FONT_ATLAS_HEIGHT, 1, format};
+}
+
+/**
+ * @brief 画面なしの計測用に、ログが埋まった決まった内容の描画データを作る。
+ *        継続中のログのカウントを求めるための描画時刻を返す。
+ */
+static uint64_t fill_sample_drawable_set(DrawableSet *set, unsigned long frame, int player_count)
+{
+    static const unsigned char dirs[] = {0x0, 0x2, 0xA, 0x8, 0x9, 0x1, 0x5, 0x4, 0x6};
+    // プレイヤーごとに内容を変えるための係数。1P/2Pは従来の内容と同じになる
+    static const unsigned btn_mul[INPUT_MAX_PLAYERS] = {1, 7, 3, 5, 11, 13, 9, 15};
+    static const unsigned count_mul[INPUT_MAX_PLAYERS] = {37, 53, 41, 59, 43, 61, 47, 67};
+    unsigned long shift = frame / 30; // 30フレームごとにログが1行増える想定
+    memset(set, 0, sizeof(*set));
+    set->player_count = player_count;
+    set->frame_ns = options.count_period_ns;
+    uint64_t now = (uint64_t)((frame + 30) * set->frame_ns);
+    for (int p = 0; p < player_count; p++)
+    {
+        PlayerDrawable *pd = &set->players[p];
+        for (int i = 0; i < MAX_LOG; i++)
         {
-            show_debug ^= 1;
-            debug_triggered = true;
+            unsigned long n = i + shift;
+            unsigned count = (n * count_mul[p]) % (MAX_FRAME_COUNT - 1) + 1;
+            pd->log[i] = (LogState){.dir_index = dirs[(n + 4 * p) % 9], .btn_index = (n * btn_mul[p]) % 16, .used = 1};
+            if (motions && n % 5 == 0) // コマンドの表示は5行に1行
+                pd->log[i].motion = (n / 5) % motions->motion_count + 1;
+            pd->tenths[i] = i > 0 ? count * 10 - (n * 3) % 10 : 0; // 切り上げるとカウントになる値
         }
-        if (!cur_debug_state)
-            debug_triggered = false;
-        prev_debug_state = cur_debug_state;
+        // 最新行は描画時刻でカウントが frame % 30 + 1 になるように開始時刻を置く
+        pd->top_open = true;
+        pd->top_start_ns = now - (uint64_t)((frame % 30 + 0.5) * set->frame_ns);
+        pd->traj = 0;
+        for (int i = MAX_TRAJECTORY - 1; i >= 0; i--)
+            pd->traj = traj_push(pd->traj, dirs[(i + frame + 4 * p) % 9]);
+        // 高解像度軌跡は約8msごとに位置が変わる早い回転入力とする
+        pd->trail_count = TRAIL_POINTS;
+        for (int i = 0; i < TRAIL_POINTS; i++)
+            pd->trail[i] = (TrailPoint){now - 8000000ULL * (i + 1), dirs[(i + frame + 4 * p) % 9]};
+        pd->drawable = true;
+        pd->log_gen = shift;
+    }
+    return now;
+}
+
+// 基準画像の確認用フォント
+// 焼き込んだアトラスはraylibの版でグリフの形がわずかに変わるため、基準画像との比較には使わない。
+// 代わりに表示に使う文字ごとに決まった縞模様を描いた等幅のフォントを作り、文字列キャッシュも同じ文字列で作り直す。
+// 文字の取り違えや位置のずれは模様の違いとして基準画像に現れる。
+#define CHECK_GLYPH_WIDTH 16
+#define CHECK_GLYPH_HEIGHT 24
+#define CHECK_GLYPH_ADVANCE 18
+#define CHECK_GLYPH_Y 4 // 焼き込んだフォントの数字とおおよそ同じ高さに置く
+#define CHECK_TILE 16   // 基準画像は CHECK_TILE 画素四方の平均値を1画素にした縮小画像
+#define CHECK_TOLERANCE 2 // 縮小画像の画素ごとに許す差。浮動小数点の丸めの違いによる縁の1画素の差を吸収する
+
+static TextCaches check_text_caches;
+
+/**
+ * @brief UTF-8の1文字のバイト数を返す。
+ */
+static inline int utf8_length(const char *s)
+{
+    return (*s & 0x80) == 0 ? 1 : (*s & 0xE0) == 0xC0 ? 2 : (*s & 0xF0) == 0xE0 ? 3 : 4;
+}
+
+/**
+ * @brief 表示に使う文字の中での番号を返す。見つからなければ-1。
+ */
+static int check_glyph_index(const char *s, int len)
+{
+    int index = 0;
+    for (const char *c = TEXT_CACHE_CHARSET; *c; c += utf8_length(c), index++)
+        if (utf8_length(c) == len && strncmp(c, s, len) == 0)
+            return index;
+    return -1;
+}
+
+static void layout_check_text(CachedText *c, const char *text, int glyph_count)
+{
+    memset(c, 0, sizeof(*c));
+    memcpy(c->text, text, sizeof(c->text) - 1);
+    float offset_x = 0;
+    for (const char *s = c->text; *s && c->quad_count < CACHED_TEXT_MAX_GLYPHS; s += utf8_length(s))
+    {
+        int index = check_glyph_index(s, utf8_length(s));
+        if (index >= 0)
+            c->quads[c->quad_count++] = (GlyphQuad){
+                .dst = {offset_x, CHECK_GLYPH_Y, CHECK_GLYPH_WIDTH, CHECK_GLYPH_HEIGHT},
+                .uv = {(float)index / glyph_count, 0, 1.0f / glyph_count, 1}};
+        offset_x += CHECK_GLYPH_ADVANCE;
+    }
+    c->width = offset_x > 0 ? offset_x - (CHECK_GLYPH_ADVANCE - CHECK_GLYPH_WIDTH) : 0;
+}
 
-        // 描画スレッドへ値連携
-        if (pthread_mutex_lock(&state_lock) == 0)
+/**
+ * @brief 確認用フォントのアトラスを作り、文字列キャッシュを確認用フォントの表に差し替える。
+ *        文字の模様は外枠と、文字の番号のビットごとの横縞。
+ */
+static Image load_check_font_atlas(void)
+{
+    int glyph_count = 0;
+    for (const char *c = TEXT_CACHE_CHARSET; *c; c += utf8_length(c))
+        glyph_count++;
+    int width = glyph_count * CHECK_GLYPH_WIDTH;
+    unsigned char *data = calloc((size_t)width * CHECK_GLYPH_HEIGHT, 4);
+    if (!data)
+        return (Image){0};
+    for (int g = 0; g < glyph_count; g++)
+    {
+        for (int y = 0; y < CHECK_GLYPH_HEIGHT; y++)
         {
-            copy_drawable_set(
-                drawable_traj1, trajectory1,
-                drawable_log1, log_1,
-                &drawable1, no_op_count1);
-            copy_drawable_set(
-                drawable_traj2, trajectory2,
-                drawable_log2, log_2,
-                &drawable2, no_op_count2);
+            for (int x = 0; x < CHECK_GLYPH_WIDTH; x++)
+            {
+                bool border = x < 2 || x >= CHECK_GLYPH_WIDTH - 2 || y < 2 || y >= CHECK_GLYPH_HEIGHT - 2;
+                int bit = (y - 2) / 4; // 外枠の内側を4画素ずつ5本の縞に分ける
+                bool stripe = x >= 4 && x < CHECK_GLYPH_WIDTH - 4 && bit < 5 && (y - 2) % 4 < 2 && ((g + 1) >> bit & 1);
+                unsigned char *px = data + ((size_t)y * width + g * CHECK_GLYPH_WIDTH + x) * 4;
+                memset(px, 0xFF, 3);
+                px[3] = border || stripe ? 0xFF : 0;
+            }
+        }
+    }
+
+    TextCaches *t = &check_text_caches;
+    for (int i = 0; i < COUNT_CACHE_SIZE; i++)
+        layout_check_text(&t->count[i], baked_text_caches.count[i].text, glyph_count);
+    for (int i = 0; i < SUBFRAME_CACHE_SIZE; i++)
+        layout_check_text(&t->subframe[i], baked_text_caches.subframe[i].text, glyph_count);
+    for (int i = 0; i < DIR_STATE_COUNT; i++)
+        layout_check_text(&t->dir[i], baked_text_caches.dir[i].text, glyph_count);
+    for (int i = 0; i < BTN_STATE_COUNT; i++)
+        layout_check_text(&t->button[i], baked_text_caches.button[i].text, glyph_count);
+    count_cache = t->count;
+    subframe_cache = t->subframe;
+    dir_cache = t->dir;
+    button_cache = t->button;
+    return (Image){data, width, CHECK_GLYPH_HEIGHT, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+}
 
-            pthread_mutex_unlock(&state_lock);
+/**
+ * @brief 最終フレームを縮小して基準画像と比べる。--headless-update では比べずに基準画像を書き直す。
+ */
+static bool check_headless_frame(const SoftCanvas *canvas, const char *path)
+{
+    SoftCanvas tiles, golden;
+    if (!soft_canvas_downsample(canvas, CHECK_TILE, &tiles))
+        return false;
+    if (options.headless_update)
+    {
+        bool ok = soft_canvas_write_pam(&tiles, path);
+        if (ok)
+            printf("[info] wrote golden %s (%dx%d tiles)\n", path, tiles.width, tiles.height);
+        else
+            perror(path);
+        soft_canvas_free(&tiles);
+        return ok;
+    }
+    if (!soft_canvas_read_pam(&golden, path))
+    {
+        fprintf(stderr, "[error] failed to read golden %s\n", path);
+        soft_canvas_free(&tiles);
+        return false;
+    }
+    bool ok = golden.width == tiles.width && golden.height == tiles.height;
+    int mismatched = 0, max_diff = 0;
+    for (int i = 0; ok && i < tiles.width * tiles.height; i++)
+    {
+        int diff = 0;
+        for (int c = 0; c < 4; c++)
+        {
+            int d = abs(tiles.rgba[i * 4 + c] - golden.rgba[i * 4 + c]);
+            diff = d > diff ? d : diff;
         }
+        if (diff > max_diff)
+            max_diff = diff;
+        if (diff > CHECK_TOLERANCE && mismatched++ < 8)
+            printf("[error] tile (%d, %d) at pixel (%d, %d) differs by %d\n", i % tiles.width, i / tiles.width,
+                   i % tiles.width * CHECK_TILE, i / tiles.width * CHECK_TILE, diff);
+    }
+    if (!ok)
+        printf("[error] golden %s is %dx%d tiles, frame is %dx%d\n", path, golden.width, golden.height, tiles.width,
+               tiles.height);
+    else if (mismatched)
+        printf("[error] %d of %d tiles differ from %s by more than %d\n", mismatched, tiles.width * tiles.height, path,
+               CHECK_TOLERANCE);
+    else
+        printf("[info] frame matches %s (max tile difference %d)\n", path, max_diff);
+    soft_canvas_free(&tiles);
+    soft_canvas_free(&golden);
+    return ok && mismatched == 0;
+}
+
+/**
+ * @brief 画面なしで描画するためにフォントと各キャッシュを用意する。
+ */
+static bool headless_init(Image *atlas)
+{
+    *atlas = options.headless_check ? load_check_font_atlas() : load_baked_font_atlas(PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    if (!atlas->data)
+    {
+        fprintf(stderr, "[error] failed to allocate the font atlas\n");
+        return false;
+    }
+    init_player_layouts(options.players);
+    return true;
+}
+
+static void headless_cleanup(Image *atlas)
+{
+    UnloadImage(*atlas);
+}
+
+/**
+ * @brief 画面なしで描画命令列の組み立てとソフトウェアラスタライザでの描画を計測する。
+ *        描画内容はフレーム番号だけで決まるため、出力画像は比較用の基準画像として使える。
+ */
+static int run_headless(void)
+{
+    Image atlas;
+    if (!headless_init(&atlas))
+        return 1;
+
+    SoftTexture glyphs = {atlas.width, atlas.height, atlas.data};
+    SoftCanvas canvas;
+    if (!soft_canvas_init(&canvas, SCREEN_WIDTH, SCREEN_HEIGHT))
+        return 1;
+    const DrawList *layers[DRAW_LIST_MAX_LAYERS];
+    panel_layer_lists(layers);
+
+    // フレームを配信するときは共有メモリの書き込み先に直接描画するため、読み出しのコピーはない
+    uint8_t *canvas_rgba = canvas.rgba;
+    if (options.frame_export_name && !frame_feed_writer_open(&frame_feed, options.frame_export_name, SCREEN_WIDTH,
+                                                             SCREEN_HEIGHT, options.frame_export_slots,
+                                                             FRAME_FEED_PREMULTIPLIED))
+        return 1;
+
+    static DrawableSet set;
+    double build_us = 0, raster_us = 0, raster_max_us = 0;
+    long commands = 0, draw_calls = 0;
+    for (int frame = 0; frame < options.headless_frames; frame++)
+    {
+        uint64_t now = fill_sample_drawable_set(&set, frame, options.players);
+
+        struct timespec t0, t1, t2;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (options.panel_cache)
+            update_panel_caches(&set, NULL);
+        build_frame(&frame_list, &set, options.panel_cache, now);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (frame_feed.header)
+            canvas.rgba = frame_feed_write_begin(&frame_feed);
+        soft_raster_execute(&canvas, &frame_list, &glyphs, layers);
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        if (frame_feed.header)
+            frame_feed_write_end(&frame_feed, frame, (uint64_t)t2.tv_sec * 1000000000ULL + t2.tv_nsec);
+
+        double b = (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+        double r = (t2.tv_sec - t1.tv_sec) * 1e6 + (t2.tv_nsec - t1.tv_nsec) / 1e3;
+        build_us += b;
+        raster_us += r;
+        if (r > raster_max_us)
+            raster_max_us = r;
+        commands += frame_list.count;
+        draw_calls += draw_list_estimate_batches(&frame_list);
+    }
+
+    int frames = options.headless_frames;
+    printf("[bench] headless frames %d, %d players (panel cache %s)\n", frames, options.players,
+           options.panel_cache ? "on" : "off");
+    printf("[bench] commands/frame %.1f, estimated draw calls/frame %.1f, build %.2f us/frame, raster %.1f us/frame (max %.1f us)\n",
+           (double)commands / frames, (double)draw_calls / frames, build_us / frames, raster_us / frames, raster_max_us);
+    if (frame_feed.header)
+        printf("[bench] frame export: %llu frames rasterized in place into %s (no readback)\n",
+               (unsigned long long)frame_feed.frame, options.frame_export_name);
+
+    int result = 0;
+    if (options.headless_dump)
+    {
+        if (soft_canvas_write_pam(&canvas, options.headless_dump))
+            printf("[info] wrote %s\n", options.headless_dump);
         else
         {
-            fprintf(stderr, "pthread_mutex_lock state_lock failed: %s\n", strerror(errno));
-            exit(EXIT_FAILURE);
+            perror(options.headless_dump);
+            result = 1;
         }
+    }
+    if (options.headless_check && !check_headless_frame(&canvas, options.headless_check))
+        result = 1;
+
+    canvas.rgba = canvas_rgba;
+    soft_canvas_free(&canvas);
+    frame_feed_writer_close(&frame_feed);
+    headless_cleanup(&atlas);
+    return result;
+}
 
-        // インターバルのパディング
-        clock_gettime(CLOCK_MONOTONIC, &frame_end);
-        long elapsed_ns = (frame_end.tv_sec - frame_start.tv_sec) * 1000000000L +
-                          (frame_end.tv_nsec - frame_start.tv_nsec);
-        long target_ns = 16666666L;
-        long remaining_ns = target_ns - elapsed_ns;
-        if (remaining_ns > 0)
+/**
+ * @brief 画面なしで最終フレームをソフトウェアラスタライザで描画して書き出す。
+ */
+static bool headless_dump_frame(const Image *atlas, const char *path)
+{
+    SoftTexture glyphs = {atlas->width, atlas->height, atlas->data};
+    SoftCanvas canvas;
+    if (!soft_canvas_init(&canvas, SCREEN_WIDTH, SCREEN_HEIGHT))
+        return false;
+    const DrawList *layers[DRAW_LIST_MAX_LAYERS];
+    panel_layer_lists(layers);
+    soft_raster_execute(&canvas, &frame_list, &glyphs, layers);
+    bool ok = soft_canvas_write_pam(&canvas, path);
+    if (ok)
+        printf("[info] wrote %s\n", path);
+    else
+        perror(path);
+    soft_canvas_free(&canvas);
+    return ok;
+}
+
+static inline uint64_t fnv1a(uint64_t h, uint32_t v)
+{
+    for (int i = 0; i < 4; i++, v >>= 8)
+        h = (h ^ (v & 0xFF)) * 0x100000001b3ULL;
+    return h;
+}
+
+/**
+ * @brief 描画スレッドへ渡す状態の内容をハッシュ値に畳み込む。再生結果が一致するかの確認用。
+ *        2人のときは1P/2P固定だった頃と同じ値になる順に畳み込む。
+ */
+static uint64_t hash_drawable_set(uint64_t h, const DrawableSet *set)
+{
+    for (int i = 0; i < MAX_LOG; i++)
+        for (int p = 0; p < set->player_count; p++)
         {
-            struct timespec sleep_time = {.tv_sec = 0, .tv_nsec = remaining_ns};
-            nanosleep(&sleep_time, NULL);
+            const PlayerDrawable *pd = &set->players[p];
+            const LogState *l = &pd->log[i];
+            unsigned count = l->used ? log_count_from_tenths(pd->tenths[i]) : 0;
+            h = fnv1a(h, l->dir_index | l->btn_index << 4 | count << 8);
         }
+    for (int i = 0; i < MAX_TRAJECTORY; i++)
+    {
+        uint32_t v = 0;
+        for (int p = 0; p < set->player_count; p++)
+            v |= traj_at(set->players[p].traj, i) << (4 * p);
+        h = fnv1a(h, v);
+    }
+    uint32_t drawable = 0;
+    for (int p = 0; p < set->player_count; p++)
+        drawable |= set->players[p].drawable << p;
+    return fnv1a(h, drawable);
+}
+
+/**
+ * @brief セッション記録を実時間を待たずに再生する。
+ *        記録したtick番号ごとにエッジを状態管理スレッドと同じ処理に通し、毎tick描画命令列まで組み立てる。
+ *        tickごとの状態のハッシュ値を出力するので、同じ記録からは常に同じ値になることを確認できる。
+ */
+static int run_replay_max(const SessionRecording *rec)
+{
+    Image atlas;
+    if (!headless_init(&atlas))
+        return 1;
+
+    static StateContext st;
+    static DrawableSet set;
+    state_context_init(&st, options.socd_policy, options.players, options.tick_period_ns, options.count_period_ns);
+    st.motions = motions;
+
+    uint32_t last_tick = rec->count ? rec->edges[rec->count - 1].tick : 0;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    double state_us = 0, build_us = 0;
+    size_t next = 0;
+    struct timespec start, t0, t1, t2, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t tick = 0; tick <= last_tick; tick++)
+    {
+        // 同じtickで受け取ったエッジは記録上で連続している
+        size_t first = next;
+        while (next < rec->count && rec->edges[next].tick == tick)
+            next++;
+
+        // 記録の時刻は記録開始からの経過時間なので、tickの時刻も記録開始を0として求める
+        uint64_t tick_ns = (uint64_t)(tick * rec->period_ns);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        state_context_tick(&st, &rec->edges[first], (int)(next - first), tick_ns);
+        state_context_publish(&st, &set);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (options.panel_cache)
+            update_panel_caches(&set, NULL);
+        build_frame(&frame_list, &set, options.panel_cache, tick_ns);
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+
+        state_us += (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+        build_us += (t2.tv_sec - t1.tv_sec) * 1e6 + (t2.tv_nsec - t1.tv_nsec) / 1e3;
+        hash = hash_drawable_set(hash, &set);
     }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    unsigned long ticks = (unsigned long)last_tick + 1;
+    double wall_s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    double session_s = ticks * rec->period_ns / 1e9;
+    printf("[replay] %zu edges over %lu ticks (%.1f s at %.4f Hz)\n", rec->count, ticks, session_s, 1e9 / rec->period_ns);
+    printf("[replay] state %.3f us/tick, build %.3f us/tick, %.0fx realtime\n",
+           state_us / ticks, build_us / ticks, wall_s > 0 ? session_s / wall_s : 0.0);
+    printf("[replay] state hash %016llx\n", (unsigned long long)hash);
+
+    int result = 0;
+    if (options.headless_dump && !headless_dump_frame(&atlas, options.headless_dump))
+        result = 1;
+    headless_cleanup(&atlas);
+    return result;
+}
+
+/**
+ * @brief セッション記録を実時間で再生する入力検知スレッド。
+ *        記録時と同じ間隔でエッジを積み、以降は通常の入力と同じく状態管理スレッドが処理する。
+ */
+static void *replay_thread(void *arg)
+{
+    const SessionRecording *rec = arg;
+
+    printf("[info] replay_thread started\n");
+
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t start_ns = (uint64_t)start.tv_sec * 1000000000ULL + start.tv_nsec;
+    for (size_t i = 0; i < rec->count && !exit_requested; i++)
+    {
+        uint64_t due = start_ns + rec->edges[i].time_ns;
+        struct timespec ts = {.tv_sec = due / 1000000000ULL, .tv_nsec = due % 1000000000ULL};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+        InputEdge e = rec->edges[i];
+        e.time_ns = latency_trace_now_ns();
+        wake_histogram_add(&wake_input, e.time_ns > due ? e.time_ns - due : 0);
+        e.tick = 0;
+        edge_queue_push(&edge_queue, &e);
+    }
+    printf("[info] replay finished (%zu edges)\n", rec->count);
     return NULL;
 }
 
 /**
- * @brief 状態スレッドからの値引き受け取り関数です。
+ * @brief プロセスが起動してからの経過時間を返す。
+ *        /proc/self/stat の起動時刻（22番目の項目、起動からのクロックティック）を使うため分解能は10ms程度。
+ */
+static bool process_age_ns(uint64_t *age_ns)
+{
+    FILE *fp = fopen("/proc/self/stat", "r");
+    if (!fp)
+        return false;
+    char buf[1024];
+    bool ok = fgets(buf, sizeof(buf), fp) != NULL;
+    fclose(fp);
+    // 2番目の項目（コマンド名）は空白や括弧を含みうるため、最後の ')' の後から数える
+    char *p = ok ? strrchr(buf, ')') : NULL;
+    if (!p)
+        return false;
+    unsigned long long start_ticks = 0;
+    int field = 2;
+    for (char *tok = strtok(p + 1, " "); tok; tok = strtok(NULL, " "))
+        if (++field == 22)
+        {
+            start_ticks = strtoull(tok, NULL, 10);
+            break;
+        }
+    if (field != 22)
+        return false;
+
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    uint64_t now_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    uint64_t start_ns = start_ticks * 1000000000ULL / sysconf(_SC_CLK_TCK);
+    *age_ns = now_ns > start_ns ? now_ns - start_ns : 0;
+    return true;
+}
+
+/**
+ * @brief 最初のフレームを表示するまでの時間を出力する。
+ *        プロセス起動からの時間、main開始からの時間、そのうちのフォント読み込み時間を並べる。
  */
-static inline void recv_drawable_set(
-    unsigned int *dest_traj, const unsigned int *src_traj,
-    LogState *dest_log, const LogState *src_log,
-    bool *active_flag, bool *src_active)
+static void report_startup_time(uint64_t main_start_ns, uint64_t font_ns)
 {
-    memcpy(dest_traj, src_traj, MAX_TRAJECTORY * sizeof(unsigned int)); // 軌跡
-    memcpy(dest_log, src_log, MAX_LOG * sizeof(LogState));              // 入力ログ
-    *active_flag = *src_active == true;                                 // 描画可否を渡す
+    uint64_t since_main = latency_trace_now_ns() - main_start_ns;
+    uint64_t age = 0;
+    if (process_age_ns(&age))
+        printf("[info] startup: first frame %.1f ms after exec (main %.1f ms, font %.2f ms)\n", age / 1e6,
+               since_main / 1e6, font_ns / 1e6);
+    else
+        printf("[info] startup: first frame %.1f ms after main (font %.2f ms)\n", since_main / 1e6, font_ns / 1e6);
+}
+
+/**
+ * @brief 次の状態が公開されるまで待つ。
+ *        終了要求を見落とさないよう、2tick分待っても公開されなければそのまま戻り、偽を返す。
+ */
+static bool wait_for_tick(void)
+{
+    struct pollfd pfd = {.fd = tick_event_fd, .events = POLLIN};
+    int timeout_ms = (int)(options.tick_period_ns * 2 / 1e6) + 1;
+    if (poll(&pfd, 1, timeout_ms) <= 0)
+        return false;
+    uint64_t ticks;
+    if (read(tick_event_fd, &ticks, sizeof(ticks)) < 0)
+        perror("[warn] tick eventfd");
+    return true;
+}
+
+/**
+ * @brief 稼働状況の書き出しスレッドから呼ばれ、各スレッドのカウンタを集める。
+ */
+static void collect_health(HealthSnapshot *snap)
+{
+    uint64_t now = latency_trace_now_ns();
+    uint64_t published = atomic_load_explicit(&health.published_ns, memory_order_relaxed);
+    *snap = (HealthSnapshot){
+        .uptime_ns = now - health_start_ns,
+        .ticks = atomic_load_explicit(&tick_scheduler.ticks, memory_order_relaxed),
+        .ticks_skipped = atomic_load_explicit(&tick_scheduler.skipped, memory_order_relaxed),
+        .ticks_late = atomic_load_explicit(&tick_scheduler.late_ticks, memory_order_relaxed),
+        .tick_late_max_ns = atomic_load_explicit(&tick_scheduler.late_max_ns, memory_order_relaxed),
+        .edges = atomic_load_explicit(&health.edges, memory_order_relaxed),
+        .edges_dropped = edge_queue_overflows(&edge_queue),
+        .recorder_dropped = edge_queue_overflows(&session_recorder.queue),
+        .log_resets = atomic_load_explicit(&health.log_resets, memory_order_relaxed),
+        .snapshot_age_ns = published && now > published ? now - published : 0,
+        .frames = atomic_load_explicit(&health.frames, memory_order_relaxed),
+        .render_overruns = atomic_load_explicit(&health.render_overruns, memory_order_relaxed),
+        .repeated_states = atomic_load_explicit(&health.repeated_states, memory_order_relaxed),
+        .skipped_states = atomic_load_explicit(&health.skipped_states, memory_order_relaxed),
+        .sync_waits = atomic_load_explicit(&health.sync_waits, memory_order_relaxed),
+    };
+}
+
+/**
+ * @brief 開始時点からのプロセス全体のCPU時間とコンテキストスイッチ数を出力する。
+ *        スレッド構成（通常とイベントループ）を比べるために使う。
+ */
+static void report_cpu_usage(const struct rusage *start, uint64_t start_ns)
+{
+    struct rusage end;
+    getrusage(RUSAGE_SELF, &end);
+    double elapsed = (latency_trace_now_ns() - start_ns) / 1e9;
+    double user = (end.ru_utime.tv_sec - start->ru_utime.tv_sec) + (end.ru_utime.tv_usec - start->ru_utime.tv_usec) / 1e6;
+    double sys = (end.ru_stime.tv_sec - start->ru_stime.tv_sec) + (end.ru_stime.tv_usec - start->ru_stime.tv_usec) / 1e6;
+    long voluntary = end.ru_nvcsw - start->ru_nvcsw, involuntary = end.ru_nivcsw - start->ru_nivcsw;
+    printf("[info] cpu (%s): user %.2f s, sys %.2f s, %.1f%% of one core over %.1f s\n",
+           options.event_loop ? "event loop" : "threads", user, sys, elapsed > 0 ? (user + sys) * 100 / elapsed : 0.0, elapsed);
+    printf("[info] context switches: voluntary %ld (%.0f/s), involuntary %ld (%.0f/s)\n", voluntary,
+           elapsed > 0 ? voluntary / elapsed : 0.0, involuntary, elapsed > 0 ? involuntary / elapsed : 0.0);
 }
 
 /**
@@ -815,130 +2101,389 @@ static inline void recv_drawable_set(
  *        SIGINTやウィンドウクローズ要求で終了シーケンスに移行し、
  *        全スレッドキャンセル・ロック解放を行う。
  */
-int main()
+int main(int argc, char **argv)
 {
+    uint64_t main_start_ns = latency_trace_now_ns();
+    health_start_ns = main_start_ns;
+    parse_options(argc, argv);
+
+    // セッション記録の再生は記録時のtick周期で進める
+    static SessionRecording replay;
+    if (options.replay_path)
+    {
+        if (!session_load(options.replay_path, &replay))
+            return 1;
+        options.tick_period_ns = replay.period_ns;
+        options.use_evdev = false;
+        printf("[info] replaying %zu edges from %s\n", replay.count, options.replay_path);
+    }
+    // フレームカウントの単位は指定がなければtick周期にあわせる
+    if (options.count_period_ns == 0)
+        options.count_period_ns = options.tick_period_ns;
+    if (options.motions)
+    {
+        bool loaded = options.motion_file
+                          ? motion_table_load_file(&motion_table, options.motion_file, options.count_period_ns)
+                          : motion_table_load(&motion_table, motion_default_definitions, "default motions",
+                                              options.count_period_ns);
+        if (!loaded)
+            return 1;
+        motions = &motion_table;
+        if (!build_motion_labels(motions))
+            return 1;
+        printf("[info] %d motions, %d patterns, %d automaton states\n", motions->motion_count, motions->pattern_count,
+               motions->state_count);
+    }
+    if (options.replay_path && options.replay_max)
+    {
+        int result = run_replay_max(&replay);
+        session_free(&replay);
+        return result;
+    }
+    if (options.headless_frames > 0)
+        return run_headless();
+    if (options.event_loop && !options.use_evdev)
+    {
+        fprintf(stderr, "[error] --event-loop requires the evdev backend (--input evdev, --device or --fixture)\n");
+        return 1;
+    }
+
     acquire_lock_or_exit();
-    setup_signal_handlers();
+    setup_signal_handlers(options.trace_path != NULL);
 
     SetConfigFlags(FLAG_WINDOW_UNDECORATED | FLAG_FULLSCREEN_MODE);
     InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "input_dispi raylib");
+    hook_gl_draw_calls();
 
-    init_codepoint_cache();
-    int codepoint_count = 0;
-    int *codepoints = LoadCodepoints(text, &codepoint_count);
-    int codepoints_no_dups_count = 0;
-    int *codepoints_no_dups = codepoint_remove_duplicates(codepoints, codepoint_count, &codepoints_no_dups_count);
-    UnloadCodepoints(codepoints);
-    font = LoadFontEx(FONT_PATH, FONT_SIZE, codepoints_no_dups, codepoints_no_dups_count);
-    SetTextureFilter(font.texture, TEXTURE_FILTER_BILINEAR);
-    free(codepoints_no_dups);
-
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
-    pthread_attr_setstacksize(&attr, 1024 * 1024); // スタックサイズ1MB
-    pthread_t tid;
-    if (pthread_create(&tid, &attr, input_thread, NULL) != 0)
+    // フォントはビルド時に展開済みのアトラスをテクスチャに転送するだけ
+    uint64_t font_start_ns = latency_trace_now_ns();
+    Image atlas = load_baked_font_atlas(PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA);
+    font_texture = LoadTextureFromImage(atlas);
+    UnloadImage(atlas);
+    SetTextureFilter(font_texture, TEXTURE_FILTER_BILINEAR);
+    uint64_t font_ns = latency_trace_now_ns() - font_start_ns;
+
+    if (options.use_evdev)
+        open_evdev_or_exit();
+
+    triple_buffer_init(&drawable_buffer);
+    if (options.render_sync)
     {
-        perror("[error] input_thread creation failed\n");
+        tick_event_fd = eventfd(0, EFD_CLOEXEC);
+        if (tick_event_fd < 0)
+        {
+            perror("[error] eventfd");
+            return 1;
+        }
+    }
+    latency_trace_init(&latency_trace, options.trace_path != NULL);
+    state_context_init(&state_context, options.socd_policy, options.players, options.tick_period_ns,
+                       options.count_period_ns);
+    state_context.motions = motions;
+    tick_scheduler_init(&tick_scheduler, options.tick_period_ns);
+
+    if (options.record_path && !session_recorder_open(&session_recorder, options.record_path, options.tick_period_ns))
+        return 1;
+    if (options.live_feed_name && !live_feed_writer_open(&live_feed, options.live_feed_name))
         return 1;
+    if (options.frame_export_name)
+    {
+        gl_read_pixels = (ReadPixelsFn)dlsym(RTLD_DEFAULT, "glReadPixels");
+        if (!gl_read_pixels)
+        {
+            fprintf(stderr, "[error] glReadPixels not found: %s\n", dlerror());
+            return 1;
+        }
+        if (!frame_feed_writer_open(&frame_feed, options.frame_export_name, SCREEN_WIDTH, SCREEN_HEIGHT,
+                                    options.frame_export_slots, FRAME_FEED_PREMULTIPLIED | FRAME_FEED_BOTTOM_UP))
+            return 1;
+        export_target = LoadRenderTexture(SCREEN_WIDTH, SCREEN_HEIGHT);
     }
-    else
+
+    // スレッドの優先度とCPU
+    // 状態管理スレッドは常にSCHED_FIFO。リアルタイム動作では入力検知を最優先にし、描画も含めて全スレッドをSCHED_FIFOにする。
+    static RtThreadConfig input_cfg = {.name = "input_dispi_in", .cpu = -1, .policy = SCHED_OTHER};
+    static RtThreadConfig state_cfg = {.name = "input_dispi_st", .cpu = -1, .policy = SCHED_FIFO, .priority = RT_PRIO_STATE};
+    static RtThreadConfig render_cfg = {.name = "input_dispi_rd", .cpu = -1, .policy = SCHED_OTHER};
+    input_cfg.start = options.replay_path ? replay_thread : options.use_evdev ? evdev_input_thread : input_thread;
+    input_cfg.arg = options.replay_path ? (void *)&replay : (void *)&evdev;
+    state_cfg.start = state_thread;
+    state_cfg.arg = &tick_scheduler;
+    if (options.event_loop)
+    {
+        // イベントループは状態管理スレッドの設定で動かし、入力検知スレッドは作らない
+        state_cfg.name = "input_dispi_ev";
+        state_cfg.start = event_loop_thread;
+        state_cfg.arg = &evdev;
+    }
+    if (options.rt)
+    {
+        input_cfg.policy = render_cfg.policy = SCHED_FIFO;
+        input_cfg.priority = RT_PRIO_INPUT;
+        render_cfg.priority = RT_PRIO_RENDER;
+        input_cfg.cpu = options.rt_cpus[0];
+        state_cfg.cpu = options.rt_cpus[1];
+        render_cfg.cpu = options.rt_cpus[2];
+        input_cfg.prefault = state_cfg.prefault = render_cfg.prefault = true;
+        if (rt_lock_memory())
+            printf("[info] memory locked\n");
+    }
+
+    // CPU使用量はスレッド開始時点からの差分で比べる
+    struct rusage usage_start;
+    getrusage(RUSAGE_SELF, &usage_start);
+    uint64_t usage_start_ns = latency_trace_now_ns();
+
+    pthread_t tid;
+    if (!options.event_loop)
+    {
+        if (!rt_thread_create(&tid, &input_cfg))
+        {
+            perror("[error] input_thread creation failed\n");
+            return 1;
+        }
         printf("[info] input_thread created\n");
+    }
     pthread_t state_tid;
-    if (pthread_create(&state_tid, &attr, state_thread, NULL) != 0)
+    if (!rt_thread_create(&state_tid, &state_cfg))
     {
         perror("[error] state_thread creation failed\n");
         return 1;
     }
     else
         printf("[info] state_thread created\n");
-    pthread_attr_destroy(&attr);
 
-    struct sched_param param;
-    param.sched_priority = 40;
-    pthread_setschedparam(state_tid, SCHED_FIFO, &param);
-
-    SetTargetFPS(60);
+    // 書き出しスレッドは描画スレッドの優先度を設定する前に作り、通常の優先度で動かす
+    health_exporter = (HealthExporter){.textfile_path = options.health_textfile,
+                                       .socket_path = options.health_socket,
+                                       .interval_ms = options.health_interval_ms,
+                                       .collect = collect_health};
+    if (!health_exporter_start(&health_exporter))
+        return 1;
+    if (options.rt)
+        rt_thread_apply_self(&render_cfg);
 
-    unsigned int draw_trajectory1[MAX_TRAJECTORY] = {0};
-    unsigned int draw_trajectory2[MAX_TRAJECTORY] = {0};
-    LogState draw_log1[MAX_LOG] = {0};
-    LogState draw_log2[MAX_LOG] = {0};
-    bool draw1 = true, draw2 = true;
+    // 描画を状態の公開にあわせるときは、raylibのフレームレート調整を使わずにeventfdで待つ
+    SetTargetFPS(options.render_sync ? 0 : TARGET_FPS);
+    uint64_t frame_period_ns = options.render_sync ? (uint64_t)options.tick_period_ns : 1000000000ULL / TARGET_FPS;
 
     printf("[info] main_thread started\n");
 
-    // グラデーション用カラー
-    Color bg1 = (Color){0xC8, 0xC8, 0xC8, 0x30}; // #C8C8C830
-    Color bg2 = (Color){0xC8, 0xC8, 0xC8, 0x18}; // #C8C8C818
-    Color bg3 = (Color){0xC8, 0xC8, 0xC8, 0x00}; // #C8C8C800
+    if (options.panel_cache)
+        for (int p = 0; p < options.players; p++)
+            panel_targets[p] = LoadRenderTexture(PANEL_WIDTH, SCREEN_HEIGHT);
 
-    // レバー位置キャッシュ
-    init_stick_vector_cache(stick_vector_cache1, STATUS_X1, STATUS_Y, LINE_HEIGHT); // 1P
-    init_stick_vector_cache(stick_vector_cache2, STATUS_X2, STATUS_Y, LINE_HEIGHT); // 2P
+    // 表示位置とレバー位置キャッシュ
+    init_player_layouts(options.players);
 
+    TraceStageStats trace_stats[TRACE_STAGE_COUNT] = {0};
+    unsigned long frame_no = 0;
+
+    uint64_t prev_frame_ns = 0;
     while (!WindowShouldClose() && !exit_requested)
     {
+        if (options.render_sync && !wait_for_tick())
+            health_add(&health.sync_waits, 1);
+
         struct timespec frame_start, frame_end;
         clock_gettime(CLOCK_MONOTONIC, &frame_start);
-
-        // 状態更新スレッドから値連携
-        if (pthread_mutex_lock(&state_lock) == 0)
+        uint64_t frame_ns = (uint64_t)frame_start.tv_sec * 1000000000ULL + frame_start.tv_nsec;
+        unsigned long frame_gl_draw_calls = gl_draw_calls;
+        if (prev_frame_ns)
         {
-            recv_drawable_set(
-                draw_trajectory1, drawable_traj1,
-                draw_log1, drawable_log1,
-                &draw1, &drawable1);
-            recv_drawable_set(
-                draw_trajectory2, drawable_traj2,
-                draw_log2, drawable_log2,
-                &draw2, &drawable2);
-
-            pthread_mutex_unlock(&state_lock);
+            uint64_t interval = frame_ns - prev_frame_ns;
+            wake_histogram_add(&wake_render, interval > frame_period_ns ? interval - frame_period_ns : 0);
+            if (interval > frame_period_ns * 3 / 2)
+                health_add(&health.render_overruns, 1);
         }
-        else
+        prev_frame_ns = frame_ns;
+
+        // SIGUSR1で遅延トレースを書き出す
+        if (trace_dump_requested)
         {
-            fprintf(stderr, "pthread_mutex_lock state_lock failed: %s\n", strerror(errno));
-            exit(EXIT_FAILURE);
+            trace_dump_requested = 0;
+            if (latency_trace_write_json(&latency_trace, options.trace_path, options.players))
+                printf("[info] wrote latency trace to %s\n", options.trace_path);
+            else
+                perror(options.trace_path);
         }
 
-        BeginDrawing();
+        // 状態更新スレッドから最新の公開状態を受け取る
+        // 次に受け取るまでは状態更新スレッドが書き換えないため、コピーせずそのまま描画に使う
+        const DrawableSet *set = &drawable_sets[triple_buffer_read_index(&drawable_buffer, NULL)];
+        count_rendered_tick(&render_stats, set->tick);
+        health_add(&health.frames, 1);
+        health_set(&health.repeated_states, render_stats.repeated);
+        health_set(&health.skipped_states, render_stats.skipped);
+
+        if (options.panel_cache)
+            update_panel_caches(set, panel_targets);
 
-        // 背景色
-        ClearBackground(BLACK); // #000000 キーカラー
+        build_frame(&frame_list, set, options.panel_cache, latency_trace_now_ns());
 
-        // 背景グラデーション
-        // レバー位置とボタン状態の描画
-        // キーログの描画
-        if (draw1)
+        if (frame_feed.header)
         {
-            DrawRectangleGradientH(0, 0, BG1_WIDTH, SCREEN_HEIGHT, bg1, bg2);
-            DrawRectangleGradientH(BG1_WIDTH, 0, BG2_WIDTH, SCREEN_HEIGHT, bg2, bg3);
-            draw_stick_and_buttons(&draw_log1[0], STATUS_X1, STATUS_Y, draw_trajectory1, stick_vector_cache1);
-            draw_logs(draw_log1, LOG_X1, LOG_Y, LEFT, MAX_LOG);
+            // 透明な描画先に描いて配信し、画面には同じフレームを黒の上に重ねて表示する
+            BeginTextureMode(export_target);
+            draw_list_execute_raylib(&frame_list, font_texture, panel_targets, true);
+            export_frame(set->tick);
+            EndTextureMode();
+            BeginDrawing();
+            ClearBackground(BLACK);
+            BeginBlendMode(BLEND_ALPHA_PREMULTIPLY);
+            DrawTextureRec(export_target.texture, (Rectangle){0, 0, SCREEN_WIDTH, -SCREEN_HEIGHT}, (Vector2){0, 0}, WHITE);
+            EndBlendMode();
         }
-        if (draw2)
+        else
+        {
+            BeginDrawing();
+            draw_list_execute_raylib(&frame_list, font_texture, panel_targets, false);
+        }
+
+        // 履歴を遡っている間は遡った行数を表示
+        if (set->scroll > 0)
         {
-            DrawRectangleGradientH(SCREEN_WIDTH - BG1_WIDTH, 0, BG1_WIDTH, SCREEN_HEIGHT, bg2, bg1);
-            DrawRectangleGradientH(SCREEN_WIDTH - BG1_WIDTH - BG2_WIDTH, 0, BG2_WIDTH, SCREEN_HEIGHT, bg3, bg2);
-            draw_stick_and_buttons(&draw_log2[0], STATUS_X2, STATUS_Y, draw_trajectory2, stick_vector_cache2);
-            draw_logs(draw_log2, LOG_X2, LOG_Y, RIGHT, MAX_LOG);
+            uint32_t history = 0;
+            for (int p = 0; p < set->player_count; p++)
+                if (set->players[p].history > history)
+                    history = set->players[p].history;
+            const char *label = TextFormat("HISTORY -%u / %u", set->scroll, history);
+            DrawText(label, (SCREEN_WIDTH - MeasureText(label, 30)) / 2, 10, 30, YELLOW);
         }
 
         // デバッグ表示
-        if (show_debug)
+        if (set->show_debug)
+        {
             DrawFPS(10, 10);
+            DrawText(TextFormat("EDGE OVERFLOW %lu", edge_queue_overflows(&edge_queue)), 10, 40, 20, GREEN);
+            DrawText(TextFormat("TICK %.4f Hz  LATE MAX %.0f us  REPEATED %lu  SKIPPED %lu",
+                                tick_scheduler_measured_hz(&tick_scheduler), atomic_load(&tick_scheduler.late_max_ns) / 1e3,
+                                render_stats.repeated, render_stats.skipped),
+                     10, 64, 20, GREEN);
+            char gl_calls[16] = "N/A";
+            if (gl_draw_counted)
+                snprintf(gl_calls, sizeof(gl_calls), "%d", render_stats.last_gl_draw_calls);
+            DrawText(TextFormat("RENDER %.0f us  FLUSH %.0f us  MAX %.0f us  EST DRAW CALLS %d  GL %s / CMDS %d",
+                                render_stats.frames ? render_stats.total_us / render_stats.frames : 0.0,
+                                render_stats.frames ? render_stats.flush_total_us / render_stats.frames : 0.0,
+                                render_stats.max_us, render_stats.last_draw_calls,
+                                gl_calls, frame_list.count),
+                     10, 88, 20, GREEN);
+            if (latency_trace.enabled)
+            {
+                // 並べ替えが必要なため百分位数は30フレームごとに求め直す
+                if (frame_no % 30 == 0)
+                    latency_trace_stats(&latency_trace, trace_stats);
+                for (int i = 0; i < TRACE_STAGE_COUNT; i++)
+                    DrawText(TextFormat("%-7s P50 %.0f us  P99 %.0f us  MAX %.0f us", latency_trace_stage_name(i),
+                                        trace_stats[i].p50_ns / 1e3, trace_stats[i].p99_ns / 1e3, trace_stats[i].max_ns / 1e3),
+                             10, 112 + 24 * i, 20, GREEN);
+            }
+            // スレッドごとの起床遅れ。百分位数はヒストグラムの区間の上限
+            const WakeHistogram *wakes[] = {&wake_input, &wake_state, &wake_render};
+            int wake_y = latency_trace.enabled ? 112 + 24 * TRACE_STAGE_COUNT : 112;
+            for (int i = 0; i < 3; i++)
+                DrawText(TextFormat("WAKE %-6s P50 <%u us  P99 <%u us  MAX %.0f us", wakes[i]->name,
+                                    wake_histogram_percentile_us(wakes[i], 0.5), wake_histogram_percentile_us(wakes[i], 0.99),
+                                    atomic_load(&wakes[i]->max_ns) / 1e3),
+                         10, wake_y + 24 * i, 20, GREEN);
+            // デバッグ表示は画面にだけ描き、配信するフレームには含めない
+            if (frame_feed.header)
+                DrawText(TextFormat("EXPORT READBACK %.0f us  MAX %.0f us  FRAME %llu",
+                                    readback_stats.total_us / readback_stats.frames, readback_stats.max_us,
+                                    (unsigned long long)frame_feed.frame),
+                         10, wake_y + 72, 20, GREEN);
+        }
+
+        // 溜まっている頂点をここで送り出し、垂直同期待ちを含めない描画時間を計測
+        // EndDrawingは空になったバッチを送るだけになるため、残りはバッファの入れ替えと垂直同期待ち
+        struct timespec flush_start;
+        clock_gettime(CLOCK_MONOTONIC, &flush_start);
+        rlDrawRenderBatchActive();
+        clock_gettime(CLOCK_MONOTONIC, &frame_end);
+        double render_us = (frame_end.tv_sec - frame_start.tv_sec) * 1e6 + (frame_end.tv_nsec - frame_start.tv_nsec) / 1e3;
+        double flush_us = (frame_end.tv_sec - flush_start.tv_sec) * 1e6 + (frame_end.tv_nsec - flush_start.tv_nsec) / 1e3;
+        render_stats.frames++;
+        render_stats.total_us += render_us;
+        render_stats.flush_total_us += flush_us;
+        if (flush_us > render_stats.flush_max_us)
+            render_stats.flush_max_us = flush_us;
+        render_stats.last_draw_calls = draw_list_estimate_batches(&frame_list);
+        render_stats.draw_calls += render_stats.last_draw_calls;
+        render_stats.last_gl_draw_calls = (int)(gl_draw_calls - frame_gl_draw_calls);
+        render_stats.gl_draw_calls += render_stats.last_gl_draw_calls;
+        if (render_us > render_stats.max_us)
+            render_stats.max_us = render_us;
 
         EndDrawing();
+
+        // 受け取った状態までのエッジを画面に送出したものとして記録
+        if (latency_trace.enabled)
+            latency_trace_submit(&latency_trace, set->trace_end, latency_trace_now_ns());
+        if (frame_no == 0)
+        {
+            report_startup_time(main_start_ns, font_ns);
+            if (options.startup_time)
+                exit_requested = 1;
+        }
+        frame_no++;
     }
 
-    pthread_cancel(tid);
+    if (!options.event_loop)
+    {
+        pthread_cancel(tid);
+        pthread_join(tid, NULL);
+    }
     pthread_cancel(state_tid);
-    pthread_join(tid, NULL);
     pthread_join(state_tid, NULL);
+    printf("[info] edge queue overflows: %lu\n", edge_queue_overflows(&edge_queue));
+    health_exporter_stop(&health_exporter);
+    session_recorder_close(&session_recorder);
+    live_feed_writer_close(&live_feed);
+    frame_feed_writer_close(&frame_feed);
+    session_free(&replay);
+    tick_scheduler_report(&tick_scheduler, stdout);
+    report_cpu_usage(&usage_start, usage_start_ns);
+    wake_histogram_report(&wake_input, stdout);
+    wake_histogram_report(&wake_state, stdout);
+    wake_histogram_report(&wake_render, stdout);
+    printf("[info] render time: mean %.1f us, max %.1f us over %lu frames (panel cache %s)\n",
+           render_stats.frames ? render_stats.total_us / render_stats.frames : 0.0, render_stats.max_us,
+           render_stats.frames, options.panel_cache ? "on" : "off");
+    printf("[info] batch flush: mean %.1f us, max %.1f us (included in the render time)\n",
+           render_stats.frames ? render_stats.flush_total_us / render_stats.frames : 0.0, render_stats.flush_max_us);
+    printf("[info] estimated draw calls: mean %.1f per frame\n",
+           render_stats.frames ? (double)render_stats.draw_calls / render_stats.frames : 0.0);
+    if (gl_draw_counted)
+        printf("[info] GL draw calls: mean %.1f per frame (including the debug overlay and panel redraws)\n",
+               render_stats.frames ? (double)render_stats.gl_draw_calls / render_stats.frames : 0.0);
+    else
+        printf("[info] GL draw calls: not counted (raylib's glDrawElements/glDrawArrays could not be wrapped)\n");
+    printf("[info] rendered states: %lu repeated, %lu skipped over %lu frames (render sync %s)\n", render_stats.repeated,
+           render_stats.skipped, render_stats.frames, options.render_sync ? "on" : "off");
+    if (readback_stats.frames)
+        printf("[info] frame export readback: mean %.1f us, p99 %.1f us, max %.1f us over %lu frames (%.1f MB/frame)\n",
+               readback_stats.total_us / readback_stats.frames, readback_percentile_us(&readback_stats, 0.99),
+               readback_stats.max_us, readback_stats.frames, SCREEN_WIDTH * SCREEN_HEIGHT * 4 / 1048576.0);
+    if (tick_event_fd >= 0)
+        close(tick_event_fd);
+    if (latency_trace.enabled)
+    {
+        latency_trace_stats(&latency_trace, trace_stats);
+        for (int i = 0; i < TRACE_STAGE_COUNT; i++)
+            printf("[info] latency %-7s p50 %.0f us, p99 %.0f us, max %.0f us\n", latency_trace_stage_name(i),
+                   trace_stats[i].p50_ns / 1e3, trace_stats[i].p99_ns / 1e3, trace_stats[i].max_ns / 1e3);
+    }
+
+    if (options.use_evdev)
+        evdev_input_close(&evdev);
 
-    UnloadFont(font);
-    cleanup_codepoint_cache();
+    if (options.panel_cache)
+        for (int p = 0; p < options.players; p++)
+            UnloadRenderTexture(panel_targets[p]);
+    if (options.frame_export_name)
+        UnloadRenderTexture(export_target);
+    UnloadTexture(font_texture);
     CloseWindow();
 
     reset_terminal_mode();
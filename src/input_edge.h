@@ -0,0 +1,50 @@
+#ifndef INPUT_EDGE_H
+#define INPUT_EDGE_H
+
+#include <stdint.h>
+
+// 入力ワードのビット構成
+// 下位ニブルがレバー状態、次のニブルがボタン状態でLogStateのdir_index/btn_indexと同じ並びにしている。
+// 0000 00 00 0000 0000
+//         |  |    |
+//         |  |    `---- 0x000F レバー  UP/DOWN/LEFT/RIGHT
+//         |  `--------- 0x00F0 ボタン  A/B/C/D
+//         `------------ 0x0300 スタート/セレクト
+#define INPUT_BIT_UP 0x0001
+#define INPUT_BIT_DOWN 0x0002
+#define INPUT_BIT_LEFT 0x0004
+#define INPUT_BIT_RIGHT 0x0008
+#define INPUT_BIT_A 0x0010
+#define INPUT_BIT_B 0x0020
+#define INPUT_BIT_C 0x0040
+#define INPUT_BIT_D 0x0080
+#define INPUT_BIT_START 0x0100
+#define INPUT_BIT_SELECT 0x0200
+
+#define INPUT_DIR_MASK 0x000F
+#define INPUT_BTN_SHIFT 4
+#define INPUT_BTN_MASK 0x00F0
+
+// プレイヤー数は起動時に選べ、INPUT_MAX_PLAYERSまでの分を固定長で確保する
+#define INPUT_MAX_PLAYERS 8
+#define INPUT_DEFAULT_PLAYERS 2
+
+// プレイヤーに属さないキー（DELによるリセットなど）はシステム用の擬似プレイヤーとして扱う
+#define INPUT_PLAYER_SYSTEM 0xFF
+#define INPUT_SYS_DELETE 0x0001
+#define INPUT_SYS_SCROLL_BACK 0x0002    // PageUp: ログの履歴を遡る
+#define INPUT_SYS_SCROLL_FORWARD 0x0004 // PageDown: ログの履歴を新しい方へ戻る
+
+// 入力エッジ
+// 1つのキーの押下/解放で変化した後のワード全体と、その変化が起きた時刻を持つ。
+// 時刻はCLOCK_MONOTONICのナノ秒で、evdevの場合はカーネルが付与したタイムスタンプになる。
+typedef struct
+{
+    uint64_t time_ns; // 変化時刻（CLOCK_MONOTONIC）
+    uint16_t word;    // 変化後の入力ワード
+    uint8_t player;   // 0=1P 1=2P ... もしくは INPUT_PLAYER_SYSTEM
+    uint8_t device;   // 発生元デバイスの番号
+    uint32_t tick;    // 状態管理スレッドが受け取ったtick番号（セッション記録用。入力検知スレッドは0のまま）
+} InputEdge;
+
+#endif
@@ -0,0 +1,202 @@
+#include "latency_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const stage_names[TRACE_STAGE_COUNT] = {"queue", "publish", "render", "total"};
+
+void latency_trace_init(LatencyTrace *t, bool enabled)
+{
+    memset(t, 0, sizeof(*t));
+    t->enabled = enabled;
+    t->next = 1;
+    t->submitted = 1;
+    atomic_store(&t->head, 1);
+}
+
+/**
+ * @brief 状態管理スレッドが受け取ったエッジに番号を振り、取得時刻を記録する。
+ *        公開するまではidを0にしておき、書き込み途中の記録を読まれないようにする。
+ */
+void latency_trace_capture(LatencyTrace *t, const InputEdge *e)
+{
+    if (!t->enabled)
+        return;
+    TraceRecord *r = &t->records[t->next & LATENCY_TRACE_MASK];
+    atomic_store_explicit(&r->id, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    r->capture_ns = e->time_ns;
+    r->fold_ns = r->publish_ns = 0;
+    r->word = e->word;
+    r->player = e->player;
+    r->device = e->device;
+    t->next++;
+}
+
+/**
+ * @brief 未公開のエッジに状態への畳み込み時刻を記録する。
+ */
+void latency_trace_fold(LatencyTrace *t, uint64_t now_ns)
+{
+    if (!t->enabled)
+        return;
+    for (uint64_t id = atomic_load_explicit(&t->head, memory_order_relaxed); id < t->next; id++)
+        t->records[id & LATENCY_TRACE_MASK].fold_ns = now_ns;
+}
+
+/**
+ * @brief 未公開のエッジに公開時刻を記録して公開する。
+ *        戻り値は公開済みの次の番号で、描画スレッドへ渡す状態に含める。
+ */
+uint64_t latency_trace_publish(LatencyTrace *t, uint64_t now_ns)
+{
+    if (!t->enabled)
+        return 0;
+    for (uint64_t id = atomic_load_explicit(&t->head, memory_order_relaxed); id < t->next; id++)
+    {
+        TraceRecord *r = &t->records[id & LATENCY_TRACE_MASK];
+        r->publish_ns = now_ns;
+        atomic_store_explicit(&r->id, id, memory_order_release);
+    }
+    atomic_store_explicit(&t->head, t->next, memory_order_release);
+    return t->next;
+}
+
+static inline uint64_t span_ns(uint64_t from, uint64_t to)
+{
+    return to > from ? to - from : 0;
+}
+
+/**
+ * @brief 記録を読み出す。状態管理スレッドが書き換え中なら偽を返す。
+ */
+static bool read_record(LatencyTrace *t, uint64_t id, TraceRecord *out)
+{
+    TraceRecord *r = &t->records[id & LATENCY_TRACE_MASK];
+    if (atomic_load_explicit(&r->id, memory_order_acquire) != id)
+        return false;
+    out->capture_ns = r->capture_ns;
+    out->fold_ns = r->fold_ns;
+    out->publish_ns = r->publish_ns;
+    out->word = r->word;
+    out->player = r->player;
+    out->device = r->device;
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&r->id, memory_order_relaxed) == id;
+}
+
+/**
+ * @brief 描画スレッドがフレームを送出した後に呼ぶ。endは送出した状態に含まれていた公開済みの次の番号。
+ *        トリプルバッファで読み飛ばした状態のエッジも、このフレームで送出したものとして扱う。
+ */
+void latency_trace_submit(LatencyTrace *t, uint64_t end, uint64_t now_ns)
+{
+    if (!t->enabled || end <= t->submitted)
+        return;
+    uint64_t id = t->submitted;
+    if (end - id > LATENCY_TRACE_CAPACITY)
+        id = end - LATENCY_TRACE_CAPACITY;
+    for (; id < end; id++)
+    {
+        TraceRecord r;
+        if (!read_record(t, id, &r))
+            continue; // 状態管理スレッドが一周して上書きした。別のエッジの時刻と組にしないよう捨てる
+        t->submit_ids[id & LATENCY_TRACE_MASK] = id;
+        t->submit_ns[id & LATENCY_TRACE_MASK] = now_ns;
+
+        unsigned pos = t->window_pos;
+        t->window[TRACE_STAGE_QUEUE][pos] = span_ns(r.capture_ns, r.fold_ns);
+        t->window[TRACE_STAGE_PUBLISH][pos] = span_ns(r.fold_ns, r.publish_ns);
+        t->window[TRACE_STAGE_RENDER][pos] = span_ns(r.publish_ns, now_ns);
+        t->window[TRACE_STAGE_TOTAL][pos] = span_ns(r.capture_ns, now_ns);
+        t->window_pos = (pos + 1) % LATENCY_TRACE_WINDOW;
+        if (t->window_count < LATENCY_TRACE_WINDOW)
+            t->window_count++;
+    }
+    t->submitted = end;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief 直近の区間の長さから区間ごとの中央値、99パーセンタイル、最大値を求める。描画スレッドから呼ぶ。
+ */
+void latency_trace_stats(const LatencyTrace *t, TraceStageStats stats[TRACE_STAGE_COUNT])
+{
+    uint64_t sorted[LATENCY_TRACE_WINDOW];
+    unsigned n = t->window_count;
+    for (int s = 0; s < TRACE_STAGE_COUNT; s++)
+    {
+        stats[s] = (TraceStageStats){0};
+        if (n == 0)
+            continue;
+        memcpy(sorted, t->window[s], n * sizeof(uint64_t));
+        qsort(sorted, n, sizeof(uint64_t), compare_u64);
+        stats[s].p50_ns = sorted[(n - 1) * 50 / 100];
+        stats[s].p99_ns = sorted[(n - 1) * 99 / 100];
+        stats[s].max_ns = sorted[n - 1];
+    }
+}
+
+static void write_async(FILE *fp, const char *name, char ph, uint64_t id, int player, uint64_t ts_ns)
+{
+    fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"edge\",\"ph\":\"%c\",\"id\":%llu,\"pid\":1,\"tid\":%d,\"ts\":%.3f}",
+            name, ph, (unsigned long long)id, player, ts_ns / 1e3);
+}
+
+/**
+ * @brief 保持している記録をChrome/Perfettoのトレース形式（JSON）で書き出す。描画スレッドから呼ぶ。
+ *        エッジごとに取得から送出までを非同期イベントとし、その中に区間ごとのイベントを入れ子にする。
+ *        プレイヤーごとのトラックには player_count 人分の名前（1P, 2P, ...）をつける。
+ */
+bool latency_trace_write_json(LatencyTrace *t, const char *path, int player_count)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return false;
+
+    uint64_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+    uint64_t first_id = head > LATENCY_TRACE_CAPACITY ? head - LATENCY_TRACE_CAPACITY : 1;
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    fprintf(fp, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"input_dispi\"}}");
+    for (int p = 0; p < player_count; p++)
+        fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%dP\"}}", p + 1,
+                p + 1);
+
+    for (uint64_t id = first_id; id < head; id++)
+    {
+        TraceRecord r;
+        if (!read_record(t, id, &r))
+            continue;
+        int tid = r.player + 1;
+        uint64_t submit_ns = t->submit_ids[id & LATENCY_TRACE_MASK] == id ? t->submit_ns[id & LATENCY_TRACE_MASK] : 0;
+        uint64_t end_ns = submit_ns ? submit_ns : r.publish_ns;
+        char name[32];
+        snprintf(name, sizeof(name), "edge %dP 0x%03X", tid, r.word);
+
+        write_async(fp, name, 'b', id, tid, r.capture_ns);
+        write_async(fp, stage_names[TRACE_STAGE_QUEUE], 'b', id, tid, r.capture_ns);
+        write_async(fp, stage_names[TRACE_STAGE_QUEUE], 'e', id, tid, r.fold_ns);
+        write_async(fp, stage_names[TRACE_STAGE_PUBLISH], 'b', id, tid, r.fold_ns);
+        write_async(fp, stage_names[TRACE_STAGE_PUBLISH], 'e', id, tid, r.publish_ns);
+        if (submit_ns)
+        {
+            write_async(fp, stage_names[TRACE_STAGE_RENDER], 'b', id, tid, r.publish_ns);
+            write_async(fp, stage_names[TRACE_STAGE_RENDER], 'e', id, tid, submit_ns);
+        }
+        write_async(fp, name, 'e', id, tid, end_ns);
+    }
+    fprintf(fp, "\n]}\n");
+    return fclose(fp) == 0;
+}
+
+const char *latency_trace_stage_name(TraceStage stage)
+{
+    return stage_names[stage];
+}
@@ -0,0 +1,80 @@
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "edge_queue.h"
+#include "input_edge.h"
+
+#define LATENCY_TRACE_CAPACITY 4096 // 2のべき乗。保持するエッジの記録数。古いものから上書きする
+#define LATENCY_TRACE_MASK (LATENCY_TRACE_CAPACITY - 1)
+#define LATENCY_TRACE_WINDOW 512    // 百分位数を求める直近の区間数
+
+// エッジが通過する区間
+typedef enum
+{
+    TRACE_STAGE_QUEUE,   // 取得 → 状態への畳み込み（キュー待ちとtick待ち）
+    TRACE_STAGE_PUBLISH, // 畳み込み → 描画スレッドへの公開
+    TRACE_STAGE_RENDER,  // 公開 → フレームの送出（EndDrawingの完了）
+    TRACE_STAGE_TOTAL,   // 取得 → フレームの送出
+    TRACE_STAGE_COUNT,
+} TraceStage;
+
+// 1エッジ分の時刻の記録
+// 状態管理スレッドだけが書き、idを書き込んだ時点で公開される。
+// 読み出し側はidを読み直して、読んでいる間に一周して上書きされなかったかを確かめる。
+typedef struct
+{
+    atomic_uint_fast64_t id; // 記録番号（0は未使用）
+    uint64_t capture_ns;     // 入力を取得した時刻（evdevならカーネルの時刻）
+    uint64_t fold_ns;        // 状態に畳み込んだ時刻
+    uint64_t publish_ns;     // トリプルバッファで公開した時刻
+    uint16_t word;
+    uint8_t player;
+    uint8_t device;
+} TraceRecord;
+
+// エッジの遅延の記録
+// 記録はリングバッファに置き、どのスレッドもロックで待たない。
+// 状態管理スレッドは畳み込んだエッジに番号を振り、公開時にheadを進める。
+// 描画スレッドはフレームを送出するたびに、受け取った状態までの番号に送出時刻を付ける。
+// 送出時刻は記録とは別に描画スレッドだけが持ち、記録番号と組にして置く。上書きされた記録と組にならないよう、
+// 記録を読み出せなかった番号には送出時刻を付けない。
+typedef struct
+{
+    bool enabled;
+    _Alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t head; // 公開済みの次の番号（状態管理スレッド）
+    uint64_t next;                                       // 次に振る番号（状態管理スレッド）
+    _Alignas(CACHE_LINE_SIZE) uint64_t submitted;        // 送出済みの次の番号（描画スレッド）
+    uint64_t submit_ids[LATENCY_TRACE_CAPACITY];          // 送出時刻を付けた記録番号（描画スレッド）
+    uint64_t submit_ns[LATENCY_TRACE_CAPACITY];           // 描画スレッドがフレームを送出した時刻（描画スレッド）
+    uint64_t window[TRACE_STAGE_COUNT][LATENCY_TRACE_WINDOW]; // 直近の区間の長さ（描画スレッド）
+    unsigned window_count, window_pos;
+    TraceRecord records[LATENCY_TRACE_CAPACITY];
+} LatencyTrace;
+
+// 区間の長さの統計値
+typedef struct
+{
+    uint64_t p50_ns, p99_ns, max_ns;
+} TraceStageStats;
+
+static inline uint64_t latency_trace_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void latency_trace_init(LatencyTrace *t, bool enabled);
+void latency_trace_capture(LatencyTrace *t, const InputEdge *e);
+void latency_trace_fold(LatencyTrace *t, uint64_t now_ns);
+uint64_t latency_trace_publish(LatencyTrace *t, uint64_t now_ns);
+void latency_trace_submit(LatencyTrace *t, uint64_t end, uint64_t now_ns);
+void latency_trace_stats(const LatencyTrace *t, TraceStageStats stats[TRACE_STAGE_COUNT]);
+bool latency_trace_write_json(LatencyTrace *t, const char *path, int player_count);
+const char *latency_trace_stage_name(TraceStage stage);
+
+#endif
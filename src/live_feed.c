@@ -0,0 +1,134 @@
+#include "live_feed.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READ_ATTEMPTS 1000 // live_feed_read で読み直す回数の上限
+
+/**
+ * @brief 共有メモリを作成してヘッダを書き込む。同名の古い共有メモリがあれば作り直す。
+ */
+bool live_feed_writer_open(LiveFeedWriter *w, const char *name)
+{
+    memset(w, 0, sizeof(*w));
+    snprintf(w->name, sizeof(w->name), "%s", name);
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd == -1)
+    {
+        fprintf(stderr, "[error] shm_open %s: %s\n", name, strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, sizeof(LiveFeedSegment)) == -1)
+    {
+        fprintf(stderr, "[error] ftruncate %s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    void *p = mmap(NULL, sizeof(LiveFeedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        fprintf(stderr, "[error] mmap %s: %s\n", name, strerror(errno));
+        shm_unlink(name);
+        return false;
+    }
+
+    LiveFeedSegment *seg = p;
+    memcpy(seg->magic, LIVE_FEED_MAGIC, 4);
+    seg->version = LIVE_FEED_VERSION;
+    seg->frame_size = sizeof(LiveFeedFrame);
+    atomic_store(&seg->seq, 0);
+    seg->frame.checksum = live_feed_checksum(&seg->frame);
+    w->segment = seg;
+    printf("[info] live feed: /dev/shm%s (%zu bytes)\n", name, sizeof(LiveFeedSegment));
+    return true;
+}
+
+/**
+ * @brief 共有メモリを解放して名前を削除する。読み出し側の割り当ては閉じるまで有効なまま残る。
+ */
+void live_feed_writer_close(LiveFeedWriter *w)
+{
+    if (!w->segment)
+        return;
+    munmap(w->segment, sizeof(LiveFeedSegment));
+    shm_unlink(w->name);
+    w->segment = NULL;
+}
+
+/**
+ * @brief 共有メモリを読み取り専用で開き、形式を確認する。
+ */
+bool live_feed_reader_open(LiveFeedReader *r, const char *name)
+{
+    r->segment = NULL;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1)
+    {
+        fprintf(stderr, "[error] shm_open %s: %s\n", name, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(LiveFeedSegment))
+    {
+        fprintf(stderr, "[error] %s: segment too small\n", name);
+        close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, sizeof(LiveFeedSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        fprintf(stderr, "[error] mmap %s: %s\n", name, strerror(errno));
+        return false;
+    }
+
+    const LiveFeedSegment *seg = p;
+    if (memcmp(seg->magic, LIVE_FEED_MAGIC, 4) != 0 || seg->version != LIVE_FEED_VERSION ||
+        seg->frame_size != sizeof(LiveFeedFrame))
+    {
+        fprintf(stderr, "[error] %s: not a live feed segment of version %d\n", name, LIVE_FEED_VERSION);
+        munmap(p, sizeof(LiveFeedSegment));
+        return false;
+    }
+    r->segment = seg;
+    return true;
+}
+
+void live_feed_reader_close(LiveFeedReader *r)
+{
+    if (r->segment)
+        munmap((void *)r->segment, sizeof(LiveFeedSegment));
+    r->segment = NULL;
+}
+
+/**
+ * @brief 書き込みと重ならなかった完全な内容をコピーして返す。
+ *        書き込み中なら他のスレッドに譲って読み直し、上限回数まで揃わなければ偽値を返す。
+ *        retries には読み直した回数を加算する（NULL可）。
+ */
+bool live_feed_read(const LiveFeedReader *r, LiveFeedFrame *out, unsigned *retries)
+{
+    for (int attempt = 0; attempt < READ_ATTEMPTS; attempt++)
+    {
+        unsigned seq = live_feed_read_begin(r);
+        if (!(seq & 1))
+        {
+            memcpy(out, &r->segment->frame, sizeof(*out));
+            if (!live_feed_read_retry(r, seq))
+                return true;
+        }
+        if (retries)
+            (*retries)++;
+        sched_yield();
+    }
+    return false;
+}
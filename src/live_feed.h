@@ -0,0 +1,144 @@
+#ifndef LIVE_FEED_H
+#define LIVE_FEED_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 他プロセス向けの状態配信
+// 状態管理スレッドがtickごとに描画用の状態を POSIX 共有メモリへ書き込み、
+// 配信用のオーバーレイや集計ツールなどの別プロセスがそれを直接読む。
+// 書き込み側はシーケンス番号（seqlock）で書き込み中を示すだけで、読み出し側を一切待たない。
+// 読み出し側は書き込み前後のシーケンス番号が一致した場合だけ読んだ内容を採用し、違えば読み直す。
+//
+// このヘッダは input_dispi の他のヘッダに依存しないため、読み出し側のプログラムはこれだけを取り込めばよい。
+// 共有メモリ名の既定は "/input_dispi"（/dev/shm/input_dispi）。
+
+#define LIVE_FEED_MAGIC "IDLF"
+#define LIVE_FEED_VERSION 1
+#define LIVE_FEED_DEFAULT_NAME "/input_dispi"
+#define LIVE_FEED_MAX_PLAYERS 8
+#define LIVE_FEED_LOG_ROWS 22   // 入力ログの表示行数（MAX_LOG）
+#define LIVE_FEED_TRAJECTORY 15 // 軌跡の点数（MAX_TRAJECTORY）
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+// 入力ログ1行。dir/btn は入力ワードと同じビット構成のニブル
+typedef struct
+{
+    uint8_t dir;    // レバー状態（SOCD解決済み）
+    uint8_t btn;    // ボタン状態 A/B/C/D
+    uint16_t count; // 継続フレーム数（0なら空行）
+} LiveFeedLogEntry;
+
+// 1プレイヤー分の状態
+typedef struct
+{
+    uint16_t word;                               // 現在の入力ワード（スタート/セレクトを含む）
+    uint8_t drawable;                            // 1なら画面に表示中
+    uint8_t reserved;
+    uint32_t history;                            // 保持している入力ログの件数
+    uint8_t trajectory[LIVE_FEED_TRAJECTORY + 1]; // 新しい順のレバー軌跡（末尾は予約）
+    LiveFeedLogEntry log[LIVE_FEED_LOG_ROWS];    // 新しい順の入力ログ
+} LiveFeedPlayer;
+
+// 1tick分の配信内容
+typedef struct
+{
+    uint64_t tick;                               // 状態管理スレッドのtick番号
+    uint64_t publish_ns;                         // 書き込んだ時刻（CLOCK_MONOTONIC）
+    uint32_t player_count;
+    uint32_t scroll;                             // 履歴を遡って表示している行数
+    LiveFeedPlayer players[LIVE_FEED_MAX_PLAYERS];
+    uint32_t checksum;                           // ここより前の内容の live_feed_checksum
+} LiveFeedFrame;
+
+// 共有メモリの全体
+// シーケンス番号は奇数の間が書き込み中。内容とは別のキャッシュラインに置く。
+typedef struct
+{
+    char magic[4];      // "IDLF"
+    uint16_t version;   // LIVE_FEED_VERSION
+    uint16_t reserved;
+    uint32_t frame_size; // sizeof(LiveFeedFrame)
+    _Alignas(CACHE_LINE_SIZE) atomic_uint seq;
+    _Alignas(CACHE_LINE_SIZE) LiveFeedFrame frame;
+} LiveFeedSegment;
+
+/**
+ * @brief 配信内容の checksum より前の部分のハッシュ値（32bit単位のFNV-1a）。
+ *        読み出し側が整合性を確かめるために使う。
+ */
+static inline uint32_t live_feed_checksum(const LiveFeedFrame *f)
+{
+    const uint32_t *w = (const uint32_t *)f;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < offsetof(LiveFeedFrame, checksum) / sizeof(uint32_t); i++)
+        h = (h ^ w[i]) * 16777619u;
+    return h;
+}
+
+// 書き込み側（input_dispi）
+typedef struct
+{
+    LiveFeedSegment *segment;
+    char name[64];
+} LiveFeedWriter;
+
+bool live_feed_writer_open(LiveFeedWriter *w, const char *name);
+void live_feed_writer_close(LiveFeedWriter *w);
+
+/**
+ * @brief 書き込みを開始する。シーケンス番号を奇数にしてから内容の書き込み先を返す。
+ */
+static inline LiveFeedFrame *live_feed_write_begin(LiveFeedWriter *w)
+{
+    unsigned seq = atomic_load_explicit(&w->segment->seq, memory_order_relaxed);
+    atomic_store_explicit(&w->segment->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return &w->segment->frame;
+}
+
+/**
+ * @brief 書き込みを終える。チェックサムを付けてからシーケンス番号を偶数に戻して公開する。
+ */
+static inline void live_feed_write_end(LiveFeedWriter *w)
+{
+    LiveFeedFrame *f = &w->segment->frame;
+    f->checksum = live_feed_checksum(f);
+    unsigned seq = atomic_load_explicit(&w->segment->seq, memory_order_relaxed);
+    atomic_store_explicit(&w->segment->seq, seq + 1, memory_order_release);
+}
+
+// 読み出し側
+typedef struct
+{
+    const LiveFeedSegment *segment;
+} LiveFeedReader;
+
+bool live_feed_reader_open(LiveFeedReader *r, const char *name);
+void live_feed_reader_close(LiveFeedReader *r);
+bool live_feed_read(const LiveFeedReader *r, LiveFeedFrame *out, unsigned *retries);
+
+/**
+ * @brief コピーせずに読むときの開始処理。戻り値を live_feed_read_retry に渡す。
+ *        読む内容は r->segment->frame を直接参照する。
+ */
+static inline unsigned live_feed_read_begin(const LiveFeedReader *r)
+{
+    return atomic_load_explicit((atomic_uint *)&r->segment->seq, memory_order_acquire);
+}
+
+/**
+ * @brief 読んでいる間に書き込みがあったかを返す。真値なら読んだ内容を捨てて読み直す。
+ */
+static inline bool live_feed_read_retry(const LiveFeedReader *r, unsigned seq)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return (seq & 1) || atomic_load_explicit((atomic_uint *)&r->segment->seq, memory_order_relaxed) != seq;
+}
+
+#endif
@@ -0,0 +1,178 @@
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "live_feed.h"
+
+// 共有メモリ配信の確認用プログラム
+// 配信中の共有メモリを1kHzで読み、チェックサムの不一致やtickの逆行がないかを数える。
+// --self-feed を指定すると自分で共有メモリを作り、実際のtickより高い頻度で書き込むスレッドを動かして
+// input_dispi なしで読み出し中の書き込みが起きる状況を確かめる。
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// 自前の書き込みスレッド
+// 内容はすべて通し番号から決まる値で埋める。
+static LiveFeedWriter self_writer;
+static atomic_bool self_running;
+
+static void *self_feed_thread(void *arg)
+{
+    (void)arg;
+    const struct timespec pace = {.tv_sec = 0, .tv_nsec = 50000}; // 50us
+    for (uint64_t tick = 1; atomic_load(&self_running); tick++)
+    {
+        LiveFeedFrame *f = live_feed_write_begin(&self_writer);
+        f->tick = tick;
+        f->publish_ns = now_ns();
+        f->player_count = LIVE_FEED_MAX_PLAYERS;
+        f->scroll = 0;
+        for (int p = 0; p < LIVE_FEED_MAX_PLAYERS; p++)
+        {
+            LiveFeedPlayer *pl = &f->players[p];
+            pl->word = (tick + p) & 0x3FF;
+            pl->drawable = 1;
+            pl->history = tick;
+            for (int i = 0; i < LIVE_FEED_TRAJECTORY; i++)
+                pl->trajectory[i] = (tick + i) & 0xF;
+            for (int i = 0; i < LIVE_FEED_LOG_ROWS; i++)
+                pl->log[i] = (LiveFeedLogEntry){(tick + i) & 0xF, (tick >> 4) & 0xF, tick % 1000};
+        }
+        live_feed_write_end(&self_writer);
+        nanosleep(&pace, NULL);
+    }
+    return NULL;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options] [NAME]\n"
+            "  NAME            shared memory name (default: " LIVE_FEED_DEFAULT_NAME ")\n"
+            "  --seconds N     read for N seconds (default: 5)\n"
+            "  --self-feed     create the segment and write it from a background thread\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"seconds", required_argument, NULL, 's'},
+        {"self-feed", no_argument, NULL, 'f'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    int seconds = 5;
+    bool self_feed = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'f':
+            self_feed = true;
+            break;
+        default:
+            print_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    const char *name = optind < argc ? argv[optind] : LIVE_FEED_DEFAULT_NAME;
+    if (seconds <= 0)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    pthread_t writer;
+    if (self_feed)
+    {
+        if (!live_feed_writer_open(&self_writer, name))
+            return 1;
+        atomic_store(&self_running, true);
+        pthread_create(&writer, NULL, self_feed_thread, NULL);
+    }
+
+    LiveFeedReader reader;
+    if (!live_feed_reader_open(&reader, name))
+        return 1;
+
+    // 1msごとの絶対時刻で読む
+    int total = seconds * 1000;
+    uint64_t *ages = malloc(total * sizeof(uint64_t));
+    unsigned long reads = 0, unchanged = 0, busy = 0, corrupt = 0, backwards = 0;
+    unsigned retries = 0;
+    uint64_t last_tick = 0;
+    static LiveFeedFrame frame;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (int i = 0; i < total; i++)
+    {
+        next.tv_nsec += 1000000;
+        if (next.tv_nsec >= 1000000000)
+        {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        if (!live_feed_read(&reader, &frame, &retries))
+        {
+            busy++;
+            continue;
+        }
+        uint64_t t = now_ns();
+        if (frame.checksum != live_feed_checksum(&frame) || frame.player_count > LIVE_FEED_MAX_PLAYERS)
+            corrupt++;
+        if (frame.tick < last_tick)
+            backwards++;
+        else if (frame.tick == last_tick)
+            unchanged++;
+        last_tick = frame.tick;
+        ages[reads++] = t > frame.publish_ns ? t - frame.publish_ns : 0;
+    }
+
+    if (self_feed)
+    {
+        atomic_store(&self_running, false);
+        pthread_join(writer, NULL);
+    }
+    live_feed_reader_close(&reader);
+    if (self_feed)
+        live_feed_writer_close(&self_writer);
+
+    printf("[info] %lu reads over %d s from %s (last tick %llu)\n", reads, seconds, name, (unsigned long long)last_tick);
+    printf("[info] retries %u, unchanged %lu, gave up %lu\n", retries, unchanged, busy);
+    if (reads > 0)
+    {
+        qsort(ages, reads, sizeof(uint64_t), compare_u64);
+        printf("[info] snapshot age p50 %.1f us, p99 %.1f us, max %.1f us\n", ages[(reads - 1) / 2] / 1e3,
+               ages[(reads - 1) * 99 / 100] / 1e3, ages[reads - 1] / 1e3);
+    }
+    free(ages);
+    if (corrupt || backwards)
+    {
+        printf("[error] inconsistent snapshots: %lu corrupt, %lu tick went backwards\n", corrupt, backwards);
+        return 1;
+    }
+    printf("[info] all snapshots consistent\n");
+    return 0;
+}
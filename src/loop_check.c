@@ -0,0 +1,327 @@
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "edge_queue.h"
+#include "evdev_input.h"
+#include "state_engine.h"
+#include "tick_scheduler.h"
+
+// 入力検知と状態管理の構成の比較用プログラム
+// 2スレッド（入力検知スレッドからエッジキューで状態管理スレッドへ渡す既定の構成）と
+// 1スレッドのイベントループ（--event-loop）で同じフィクスチャを再生し、input_dispi と同じ手順でtickごとに状態へ畳み込む。
+// 構成ごとにCPU時間、コンテキストスイッチ数、起床回数、エッジの時刻からtickで畳み込むまでの遅れを出力する。
+// あわせて1tickに EDGE_QUEUE_SIZE の2倍のエッジが一度に届く場面を再生し、イベントループが溜める領域の上限に
+// 達しても空回りせず（tickあたりの起床回数が増えず）、残りのエッジを失わずに次のtickへ持ち越すかを確かめる。
+
+#define CHECK_PERIOD_NS 16896002.0      // MVSのtick周期
+#define CHECK_TAIL_NS 200000000ULL      // 最後のイベントの後に回し続ける時間
+#define BURST_OFFSET_US 100000          // 一度に届くエッジの時刻
+#define BURST_EVENTS (EDGE_QUEUE_SIZE * 2)
+#define BURST_WAKE_LIMIT 8 // 一度に届く場面で許すtickあたりの起床回数
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// 1回の再生の結果
+typedef struct
+{
+    unsigned long edges;      // 状態に畳み込んだエッジ数
+    unsigned long overflows;  // エッジキューが満杯で捨てたエッジ数
+    unsigned long wakeups;    // 待ちから戻った回数（全スレッドの合計）
+    unsigned long max_wakeups_per_tick;
+    unsigned long ticks;
+    double cpu_ms;
+    long voluntary, involuntary;
+    uint64_t *latency_ns; // エッジごとの時刻から畳み込みまでの遅れ
+} RunResult;
+
+// 再生中の状態
+static EvdevInput evdev;
+static EdgeQueue edge_queue;
+static StateContext state;
+static DrawableSet drawable;
+static TickScheduler scheduler;
+static InputEdge tick_edges[EDGE_QUEUE_SIZE];
+static atomic_bool input_stop;
+static atomic_ulong input_wakeups;
+
+/**
+ * @brief 1tick分のエッジを畳み込んで公開する。input_dispi の run_state_tick から記録と配信を除いたもの。
+ */
+static void fold_tick(RunResult *r, int edge_count)
+{
+    uint64_t now = now_ns();
+    for (int i = 0; i < edge_count; i++)
+        r->latency_ns[r->edges++] = now > tick_edges[i].time_ns ? now - tick_edges[i].time_ns : 0;
+    state_context_tick(&state, tick_edges, edge_count, now);
+    state_context_publish(&state, &drawable);
+    r->ticks++;
+}
+
+static void *input_thread(void *arg)
+{
+    (void)arg;
+    InputEdge edges[64];
+    while (!atomic_load(&input_stop))
+    {
+        int n = evdev_input_wait(&evdev, 100, edges, sizeof(edges) / sizeof(edges[0]));
+        atomic_fetch_add(&input_wakeups, 1);
+        for (int i = 0; i < n; i++)
+            edge_queue_push(&edge_queue, &edges[i]);
+    }
+    return NULL;
+}
+
+/**
+ * @brief 既定の構成で再生する。入力検知スレッドとtickごとに眠る状態管理スレッド（呼び出し元）の2つで動かす。
+ */
+static void run_threads(RunResult *r, uint64_t end_ns)
+{
+    pthread_t tid;
+    atomic_store(&input_stop, false);
+    atomic_store(&input_wakeups, 0);
+    pthread_create(&tid, NULL, input_thread, NULL);
+    tick_scheduler_start(&scheduler);
+    while (now_ns() < end_ns)
+    {
+        int edge_count = 0;
+        while (edge_count < EDGE_QUEUE_SIZE && edge_queue_pop(&edge_queue, &tick_edges[edge_count]))
+            edge_count++;
+        fold_tick(r, edge_count);
+        tick_scheduler_wait(&scheduler);
+        r->wakeups++;
+    }
+    atomic_store(&input_stop, true);
+    pthread_join(tid, NULL);
+    r->wakeups += atomic_load(&input_wakeups);
+    r->overflows = edge_queue_overflows(&edge_queue);
+}
+
+/**
+ * @brief イベントループで再生する。input_dispi の event_loop_thread と同じ手順。
+ */
+static bool run_event_loop(RunResult *r, uint64_t end_ns)
+{
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd == -1 || !evdev_input_add_timer(&evdev, timer_fd))
+    {
+        perror("timerfd_create");
+        return false;
+    }
+    tick_scheduler_start(&scheduler);
+    fold_tick(r, 0);
+    tick_scheduler_arm(&scheduler, timer_fd);
+
+    int edge_count = 0;
+    unsigned long wakeups = 0;
+    while (now_ns() < end_ns)
+    {
+        int n = evdev_input_wait(&evdev, 100, &tick_edges[edge_count], EDGE_QUEUE_SIZE - edge_count);
+        if (n < 0)
+        {
+            perror("epoll_wait");
+            close(timer_fd);
+            return false;
+        }
+        edge_count += n;
+        r->wakeups++;
+        wakeups++;
+        if (!evdev.timer_fired)
+            continue;
+
+        evdev.timer_fired = false;
+        tick_scheduler_expired(&scheduler);
+        fold_tick(r, edge_count);
+        edge_count = 0;
+        if (wakeups > r->max_wakeups_per_tick)
+            r->max_wakeups_per_tick = wakeups;
+        wakeups = 0;
+        tick_scheduler_arm(&scheduler, timer_fd);
+    }
+    close(timer_fd);
+    return true;
+}
+
+/**
+ * @brief フィクスチャを一時ファイルに書き出す。上キーの押下と解放を交互に並べ、1イベントごとに1エッジになるようにする。
+ *        burstが真なら全イベントを同じ時刻に置き、偽なら毎秒rate回の間隔で並べる。
+ */
+static bool write_fixture(char *path, int events, int rate, bool burst)
+{
+    int fd = mkstemp(path);
+    FILE *fp = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!fp)
+    {
+        perror(path);
+        return false;
+    }
+    for (int i = 0; i < events; i++)
+        fprintf(fp, "%llu KEY_W %d\n",
+                burst ? (unsigned long long)BURST_OFFSET_US : (unsigned long long)(i + 1) * 1000000ULL / rate,
+                (i & 1) == 0);
+    return fclose(fp) == 0;
+}
+
+/**
+ * @brief フィクスチャを1つの構成で再生して結果を求める。
+ */
+static bool run_fixture(const char *fixture, int events, uint64_t duration_ns, bool event_loop, RunResult *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->latency_ns = malloc(events * sizeof(uint64_t));
+    memset(&edge_queue, 0, sizeof(edge_queue));
+    state_context_init(&state, SOCD_CANCEL, INPUT_DEFAULT_PLAYERS, CHECK_PERIOD_NS, CHECK_PERIOD_NS);
+    tick_scheduler_init(&scheduler, CHECK_PERIOD_NS);
+    if (!r->latency_ns || !evdev_input_init(&evdev, INPUT_DEFAULT_PLAYERS))
+        return false;
+    // フィクスチャは登録した時点から再生が始まる
+    if (evdev_input_add_fixture(&evdev, fixture) < 0)
+    {
+        evdev_input_close(&evdev);
+        return false;
+    }
+    uint64_t end_ns = now_ns() + duration_ns;
+
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    bool ok = true;
+    if (event_loop)
+        ok = run_event_loop(r, end_ns);
+    else
+        run_threads(r, end_ns);
+    getrusage(RUSAGE_SELF, &after);
+    evdev_input_close(&evdev);
+
+    r->cpu_ms = (after.ru_utime.tv_sec - before.ru_utime.tv_sec) * 1e3 +
+                (after.ru_utime.tv_usec - before.ru_utime.tv_usec) / 1e3 +
+                (after.ru_stime.tv_sec - before.ru_stime.tv_sec) * 1e3 +
+                (after.ru_stime.tv_usec - before.ru_stime.tv_usec) / 1e3;
+    r->voluntary = after.ru_nvcsw - before.ru_nvcsw;
+    r->involuntary = after.ru_nivcsw - before.ru_nivcsw;
+    return ok;
+}
+
+static void report(const char *scenario, const char *mode, const RunResult *r, int events)
+{
+    printf("[info] %-6s %-10s %lu/%d edges, %lu lost in the queue, %lu ticks, cpu %.1f ms, "
+           "%ld voluntary / %ld involuntary switches, %lu wakeups",
+           scenario, mode, r->edges, events, r->overflows, r->ticks, r->cpu_ms, r->voluntary, r->involuntary,
+           r->wakeups);
+    if (r->max_wakeups_per_tick)
+        printf(" (max %lu per tick)", r->max_wakeups_per_tick);
+    printf("\n");
+    if (r->edges == 0)
+        return;
+    qsort(r->latency_ns, r->edges, sizeof(uint64_t), compare_u64);
+    printf("[info] %-6s %-10s edge to tick p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", scenario, mode,
+           r->latency_ns[(r->edges - 1) / 2] / 1e6, r->latency_ns[(r->edges - 1) * 99 / 100] / 1e6,
+           r->latency_ns[r->edges - 1] / 1e6);
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --seconds N  length of the steady fixture (default: 5)\n"
+            "  --rate N     events per second in the steady fixture (default: 400)\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"seconds", required_argument, NULL, 's'},
+        {"rate", required_argument, NULL, 'r'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    int seconds = 5, rate = 400;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'r':
+            rate = atoi(optarg);
+            break;
+        default:
+            print_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    int steady_events = seconds * rate;
+    if (seconds <= 0 || rate <= 0 || steady_events > EVDEV_MAX_FIXTURE)
+    {
+        fprintf(stderr, "[error] the steady fixture must have 1-%d events\n", EVDEV_MAX_FIXTURE);
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    char steady[] = "/tmp/input_dispi_loop_steady.XXXXXX";
+    char burst[] = "/tmp/input_dispi_loop_burst.XXXXXX";
+    if (!write_fixture(steady, steady_events, rate, false) || !write_fixture(burst, BURST_EVENTS, 0, true))
+        return 1;
+
+    // 同じフィクスチャを両方の構成で順に再生する
+    uint64_t steady_ns = (uint64_t)seconds * 1000000000ULL + CHECK_TAIL_NS;
+    uint64_t burst_ns = BURST_OFFSET_US * 1000ULL + CHECK_TAIL_NS;
+    RunResult results[4];
+    bool ok = run_fixture(steady, steady_events, steady_ns, false, &results[0]) &&
+              run_fixture(steady, steady_events, steady_ns, true, &results[1]) &&
+              run_fixture(burst, BURST_EVENTS, burst_ns, false, &results[2]) &&
+              run_fixture(burst, BURST_EVENTS, burst_ns, true, &results[3]);
+    unlink(steady);
+    unlink(burst);
+    if (!ok)
+        return 1;
+
+    int result = 0;
+    report("steady", "threads", &results[0], steady_events);
+    report("steady", "event-loop", &results[1], steady_events);
+    report("burst", "threads", &results[2], BURST_EVENTS);
+    report("burst", "event-loop", &results[3], BURST_EVENTS);
+    for (int i = 0; i < 2; i++)
+        if (results[i].edges != (unsigned long)steady_events)
+        {
+            printf("[error] steady %s folded %lu of %d edges\n", i ? "event-loop" : "threads", results[i].edges,
+                   steady_events);
+            result = 1;
+        }
+    if (results[3].edges != BURST_EVENTS)
+    {
+        printf("[error] burst event-loop folded %lu of %d edges\n", results[3].edges, BURST_EVENTS);
+        result = 1;
+    }
+    if (results[3].max_wakeups_per_tick > BURST_WAKE_LIMIT)
+    {
+        printf("[error] burst event-loop woke %lu times in one tick (limit %d): it spins while the edge buffer is full\n",
+               results[3].max_wakeups_per_tick, BURST_WAKE_LIMIT);
+        result = 1;
+    }
+    for (int i = 0; i < 4; i++)
+        free(results[i].latency_ns);
+    if (result == 0)
+        printf("[info] all edges folded, no spinning while the edge buffer is full\n");
+    return result;
+}
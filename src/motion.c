@@ -0,0 +1,447 @@
+#include "motion.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "text_cache.h"
+
+// 既定のコマンド定義
+// 1回転は上下左右の4方向を順に通ればよく、間の斜めは省略できる（開始位置と回転方向の8通り）。
+const char *const motion_default_definitions =
+    "# 名前     表示   受付F  入力\n"
+    "360        360    30     63?21?47?8|21?47?89?6|47?89?63?2|89?63?21?4|69?87?41?2|87?41?23?6|41?23?69?8|23?69?87?4\n"
+    "hcf        41236  25     41?236\n"
+    "hcb        63214  25     63?214\n"
+    "dp         623    15     623|6323\n"
+    "rdp        421    15     421|4121\n"
+    "qcf        236    15     236\n"
+    "qcb        214    15     214\n"
+    "charge_bf  [4]6   10     [147]{45}[369]\n"
+    "charge_du  [2]8   10     [123]{45}[789]\n";
+
+// 記法を読んだ1方向分の要素
+typedef struct
+{
+    uint16_t set;  // とりうる方向の集合（テンキー表記のビット）
+    bool optional; // 省略してもよい
+} MotionElement;
+
+// 読み込み中の作業領域
+typedef struct
+{
+    MotionTable *t;
+    uint16_t pattern_state[MOTION_MAX_PATTERNS]; // 入力列の最後の方向でたどり着く状態
+    uint16_t fail[MOTION_MAX_STATES];            // 失敗時の遷移先
+    const char *source;
+    int line;
+} MotionBuilder;
+
+/**
+ * @brief 1つの入力列（| で区切った1つ）を要素の列にする。
+ *        溜めの指定は先頭の要素にだけ書ける。
+ */
+static bool parse_elements(MotionBuilder *b, const char *s, const char *end, MotionElement *el, int *count,
+                           unsigned *charge_frames)
+{
+    const char *start = s;
+    int n = 0;
+    *charge_frames = 0;
+    while (s < end)
+    {
+        MotionElement e = {0};
+        if (*s >= '1' && *s <= '9')
+        {
+            e.set = 1u << (*s - '0');
+            s++;
+        }
+        else if (*s == '[')
+        {
+            for (s++; s < end && *s >= '1' && *s <= '9'; s++)
+                e.set |= 1u << (*s - '0');
+            if (s >= end || *s != ']' || e.set == 0)
+                goto invalid;
+            s++;
+        }
+        else
+            goto invalid;
+        if (s < end && *s == '{')
+        {
+            char *num_end;
+            unsigned long frames = strtoul(s + 1, &num_end, 10);
+            if (n != 0 || num_end >= end || *num_end != '}' || frames == 0)
+                goto invalid;
+            *charge_frames = frames;
+            s = num_end + 1;
+        }
+        if (s < end && *s == '?')
+        {
+            if (n == 0 && *charge_frames)
+                goto invalid;
+            e.optional = true;
+            s++;
+        }
+        if (n >= MOTION_MAX_LENGTH)
+        {
+            fprintf(stderr, "[error] %s:%d: motion longer than %d directions\n", b->source, b->line, MOTION_MAX_LENGTH);
+            return false;
+        }
+        el[n++] = e;
+    }
+    *count = n;
+    return n > 0;
+
+invalid:
+    fprintf(stderr, "[error] %s:%d: invalid motion pattern '%.*s'\n", b->source, b->line, (int)(end - start), start);
+    return false;
+}
+
+/**
+ * @brief 入力列をトライに追加する。
+ */
+static bool add_pattern(MotionBuilder *b, const MotionPattern *p, const uint8_t *dirs)
+{
+    MotionTable *t = b->t;
+    if (t->pattern_count >= MOTION_MAX_PATTERNS)
+    {
+        fprintf(stderr, "[error] %s:%d: too many motion patterns (max %d)\n", b->source, b->line, MOTION_MAX_PATTERNS);
+        return false;
+    }
+    int state = 0;
+    for (int i = 0; i < p->length; i++)
+    {
+        uint16_t *next = &t->next[state][dirs[i] - 1];
+        if (*next == 0)
+        {
+            if (t->state_count >= MOTION_MAX_STATES)
+            {
+                fprintf(stderr, "[error] %s:%d: too many motion states (max %d)\n", b->source, b->line, MOTION_MAX_STATES);
+                return false;
+            }
+            *next = t->state_count++;
+        }
+        state = *next;
+    }
+    b->pattern_state[t->pattern_count] = state;
+    t->patterns[t->pattern_count++] = *p;
+    return true;
+}
+
+/**
+ * @brief 省略できる方向といずれか1方向の記法を展開し、できた入力列をすべて追加する。
+ */
+static bool expand(MotionBuilder *b, MotionPattern *p, const MotionElement *el, int count, int i, uint8_t *dirs)
+{
+    if (i == count)
+        return p->length == 0 || add_pattern(b, p, dirs);
+    if (el[i].optional && !expand(b, p, el, count, i + 1, dirs))
+        return false;
+    for (int d = 1; d <= 9; d++)
+    {
+        if (!(el[i].set & (1u << d)))
+            continue;
+        dirs[p->length++] = d;
+        bool ok = expand(b, p, el, count, i + 1, dirs);
+        p->length--;
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 表示文字列のうちフォントアトラスにない最初の文字を返し、lenにそのバイト数を入れる。すべてあればNULLを返す。
+ *        アトラスには TEXT_CACHE_CHARSET の文字だけが入っているため、それ以外の文字は描けない。
+ */
+static const char *find_missing_glyph(const char *label, int *len)
+{
+    for (const char *s = label; *s; s += *len)
+    {
+        *len = (*s & 0x80) == 0 ? 1 : (*s & 0xE0) == 0xC0 ? 2 : (*s & 0xF0) == 0xE0 ? 3 : 4;
+        *len = strnlen(s, *len);
+        bool found = false;
+        for (const char *c = TEXT_CACHE_CHARSET; *c && !found;)
+        {
+            int c_len = (*c & 0x80) == 0 ? 1 : (*c & 0xE0) == 0xC0 ? 2 : (*c & 0xF0) == 0xE0 ? 3 : 4;
+            found = c_len == *len && strncmp(c, s, c_len) == 0;
+            c += c_len;
+        }
+        if (!found)
+            return s;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 1行分の定義を読む。
+ */
+static bool parse_definition(MotionBuilder *b, const char *line, double frame_ns)
+{
+    MotionTable *t = b->t;
+    char name[MOTION_NAME_MAX], label[MOTION_LABEL_MAX], pattern[256];
+    unsigned window = 0;
+    if (sscanf(line, "%15s %15s %u %255s", name, label, &window, pattern) != 4)
+    {
+        fprintf(stderr, "[error] %s:%d: expected NAME LABEL WINDOW PATTERN\n", b->source, b->line);
+        return false;
+    }
+    if (t->motion_count >= MOTION_MAX)
+    {
+        fprintf(stderr, "[error] %s:%d: too many motions (max %d)\n", b->source, b->line, MOTION_MAX);
+        return false;
+    }
+    // 表示文字列が途中で欠けて描かれないよう、アトラスにない文字を使った定義は読み込まない
+    int len;
+    const char *missing = find_missing_glyph(label, &len);
+    if (missing)
+    {
+        fprintf(stderr, "[error] %s:%d: label %s: '%.*s' is not in the font atlas (%s)\n", b->source, b->line, label,
+                len, missing, TEXT_CACHE_CHARSET);
+        return false;
+    }
+    MotionDef *def = &t->motions[t->motion_count];
+    snprintf(def->name, sizeof(def->name), "%s", name);
+    snprintf(def->label, sizeof(def->label), "%s", label);
+    def->window_ns = (uint64_t)(window * frame_ns);
+
+    for (const char *s = pattern; *s;)
+    {
+        const char *end = strchr(s, '|');
+        if (!end)
+            end = s + strlen(s);
+        MotionElement el[MOTION_MAX_LENGTH];
+        int count = 0;
+        unsigned charge_frames = 0;
+        if (!parse_elements(b, s, end, el, &count, &charge_frames))
+            return false;
+        MotionPattern p = {.motion = t->motion_count};
+        if (charge_frames)
+        {
+            if (count < 2)
+            {
+                fprintf(stderr, "[error] %s:%d: charge needs a direction after it\n", b->source, b->line);
+                return false;
+            }
+            p.charge_set = el[0].set;
+            p.charge_ns = (uint64_t)(charge_frames * frame_ns);
+        }
+        uint8_t dirs[MOTION_MAX_LENGTH];
+        if (!expand(b, &p, el, count, 0, dirs))
+            return false;
+        s = *end ? end + 1 : end;
+    }
+    t->motion_count++;
+    return true;
+}
+
+/**
+ * @brief 失敗時の遷移を埋めて決定性オートマトンにし、各状態で完成する入力列の一覧を作る。
+ *        状態は幅優先で処理するため、失敗時の遷移先の一覧は先にできている。
+ */
+static bool build_automaton(MotionBuilder *b)
+{
+    MotionTable *t = b->t;
+    static uint16_t queue[MOTION_MAX_STATES];
+    int head = 0, tail = 0;
+    queue[tail++] = 0;
+    b->fail[0] = 0;
+    t->output_total = 0;
+    while (head < tail)
+    {
+        int s = queue[head++];
+        for (int sym = 0; sym < MOTION_SYMBOLS; sym++)
+        {
+            int child = t->next[s][sym];
+            int fallback = s == 0 ? 0 : t->next[b->fail[s]][sym];
+            if (child == 0)
+            {
+                t->next[s][sym] = fallback;
+                continue;
+            }
+            b->fail[child] = fallback;
+            queue[tail++] = child;
+        }
+
+        // この状態で終わる入力列と、失敗時の遷移先で完成する入力列を優先度の順に並べる
+        uint16_t first = t->output_total;
+        for (int p = 0; p < t->pattern_count; p++)
+            if (s != 0 && b->pattern_state[p] == s)
+            {
+                if (t->output_total >= MOTION_MAX_OUTPUTS)
+                    goto overflow;
+                t->outputs[t->output_total++] = p;
+            }
+        if (s != 0)
+            for (int i = 0; i < t->output_count[b->fail[s]]; i++)
+            {
+                if (t->output_total >= MOTION_MAX_OUTPUTS)
+                    goto overflow;
+                t->outputs[t->output_total++] = t->outputs[t->output_first[b->fail[s]] + i];
+            }
+        uint16_t *list = &t->outputs[first];
+        int n = t->output_total - first;
+        for (int i = 1; i < n; i++)
+            for (int j = i; j > 0 && t->patterns[list[j - 1]].motion > t->patterns[list[j]].motion; j--)
+            {
+                uint16_t tmp = list[j];
+                list[j] = list[j - 1];
+                list[j - 1] = tmp;
+            }
+        t->output_first[s] = first;
+        t->output_count[s] = n;
+    }
+    return true;
+
+overflow:
+    fprintf(stderr, "[error] %s: too many overlapping motion patterns\n", b->source);
+    return false;
+}
+
+/**
+ * @brief コマンド定義の文字列を読み込んでオートマトンを作る。sourceはエラー表示用の名前。
+ *        frame_nsは受付時間と溜めのフレーム数を時間にするための1フレームの長さ。
+ */
+bool motion_table_load(MotionTable *t, const char *text, const char *source, double frame_ns)
+{
+    static MotionBuilder b;
+    memset(t, 0, sizeof(*t));
+    memset(&b, 0, sizeof(b));
+    t->state_count = 1;
+    b.t = t;
+    b.source = source;
+
+    const char *s = text;
+    while (*s)
+    {
+        const char *eol = strchr(s, '\n');
+        if (!eol)
+            eol = s + strlen(s);
+        char line[512];
+        size_t len = eol - s < (long)sizeof(line) - 1 ? (size_t)(eol - s) : sizeof(line) - 1;
+        memcpy(line, s, len);
+        line[len] = '\0';
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+        b.line++;
+        if (strspn(line, " \t\r") != strlen(line) && !parse_definition(&b, line, frame_ns))
+            return false;
+        s = *eol ? eol + 1 : eol;
+    }
+    if (t->motion_count == 0)
+    {
+        fprintf(stderr, "[error] %s: no motions defined\n", source);
+        return false;
+    }
+    return build_automaton(&b);
+}
+
+/**
+ * @brief コマンド定義のファイルを読み込んでオートマトンを作る。
+ */
+bool motion_table_load_file(MotionTable *t, const char *path, double frame_ns)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "[error] failed to open motion file %s\n", path);
+        return false;
+    }
+    size_t size = 0, capacity = 4096;
+    char *text = malloc(capacity);
+    for (size_t n; text && (n = fread(text + size, 1, capacity - size - 1, fp)) > 0;)
+    {
+        size += n;
+        if (size + 1 == capacity)
+            text = realloc(text, capacity *= 2);
+    }
+    fclose(fp);
+    if (!text)
+        return false;
+    text[size] = '\0';
+    bool ok = motion_table_load(t, text, path, frame_ns);
+    free(text);
+    return ok;
+}
+
+/**
+ * @brief 名前からコマンドの番号を返す。見つからなければ-1を返す。
+ */
+int motion_table_find(const MotionTable *t, const char *name)
+{
+    for (int i = 0; i < t->motion_count; i++)
+        if (strcmp(t->motions[i].name, name) == 0)
+            return i;
+    return -1;
+}
+
+/**
+ * @brief 認識状態を初期化する。ログのリセットにあわせて呼ぶ。
+ */
+void motion_tracker_reset(MotionTracker *m)
+{
+    m->state = 0;
+    m->numpad = 0;
+    m->count = 0;
+}
+
+static inline uint8_t dir_back(const MotionTracker *m, uint32_t back)
+{
+    return m->dirs[(m->count - 1 - back) & (MOTION_HISTORY - 1)];
+}
+
+static inline uint64_t time_back(const MotionTracker *m, uint32_t back)
+{
+    return m->times_ns[(m->count - 1 - back) & (MOTION_HISTORY - 1)];
+}
+
+/**
+ * @brief 溜めの方向の範囲にとどまっていた時間が足りているかを返す。
+ *        溜めの方向から履歴を遡り、範囲内（4→1→4など）が続いた最初の時刻から範囲を出た時刻までを数える。
+ */
+static bool charged(const MotionTracker *m, const MotionPattern *p, uint32_t available)
+{
+    uint32_t k = p->length - 1;
+    uint32_t j = k;
+    while (j + 1 < available && (p->charge_set & (1u << dir_back(m, j + 1))))
+        j++;
+    uint64_t start = time_back(m, j), end = time_back(m, k - 1);
+    return end >= start && end - start >= p->charge_ns;
+}
+
+/**
+ * @brief レバー状態を1つ進め、この入力で完成したコマンドの番号+1を返す（なければ0）。
+ *        向きが変わらなければ何もしない。遷移は表を1回引くだけで、確認するのはこの状態で完成する入力列だけ。
+ *        MotionTracker *m : プレイヤーの認識状態
+ *        const MotionTable *t : コマンドのオートマトン
+ *        uint8_t dir_index : SOCDの方式で解決したレバー状態のビット値
+ *        uint64_t time_ns : その向きに入った時刻
+ */
+int motion_tracker_feed(MotionTracker *m, const MotionTable *t, uint8_t dir_index, uint64_t time_ns)
+{
+    uint8_t numpad = motion_numpad[dir_index & 0xF];
+    if (numpad == m->numpad)
+        return 0;
+    m->numpad = numpad;
+    if (m->count > 0 && time_ns < time_back(m, 0)) // 同じtickでリセットした後のエッジ
+        time_ns = time_back(m, 0);
+    m->dirs[m->count & (MOTION_HISTORY - 1)] = numpad;
+    m->times_ns[m->count & (MOTION_HISTORY - 1)] = time_ns;
+    m->count++;
+    m->state = t->next[m->state][numpad - 1];
+
+    uint32_t available = m->count < MOTION_HISTORY ? m->count : MOTION_HISTORY;
+    const uint16_t *outputs = &t->outputs[t->output_first[m->state]];
+    for (int i = 0; i < t->output_count[m->state]; i++)
+    {
+        const MotionPattern *p = &t->patterns[outputs[i]];
+        if (p->length > available)
+            continue;
+        uint32_t first = p->charge_set ? p->length - 2u : p->length - 1u; // 受付時間を数え始める方向
+        if (time_ns - time_back(m, first) > t->motions[p->motion].window_ns)
+            continue;
+        if (p->charge_set && !charged(m, p, available))
+            continue;
+        return p->motion + 1;
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 必殺技コマンド（236、623、41236、溜め、1回転など）の認識
+// 定義の読み込み時に全コマンドの入力列を1つの決定性オートマトン（Aho-Corasick法）にまとめ、
+// レバーの向きが変わるたびに遷移表を1回引くだけで、その時点で完成したコマンドを求める。
+// 遷移の手間は定義の数によらず一定で、受付時間と溜めの確認は完成した候補にだけ行う。
+//
+// [定義の書式] 1行に1コマンド。# 以降は注釈
+// 名前 表示 受付フレーム 入力
+//   表示         : 入力ログに添える文字列（フォントアトラスにある文字だけ）
+//   受付フレーム : 最初の入力から最後の入力までの上限（溜めの入力は含めない）
+//   入力         : テンキー表記（右向き）。次の記法が使える
+//                  [123]  いずれか1方向
+//                  3?     省略してもよい方向
+//                  [147]{45}  先頭に置き、その方向の範囲に45フレーム以上とどまってから次に入れる（溜め）
+//                  236|2369  いずれかの入力列
+// 先に定義したコマンドほど優先し、同じ方向で複数のコマンドが完成したときは先のものを表示する。
+
+#define MOTION_MAX 63           // 定義できるコマンド数（LogState.motion の6ビット。0は認識なし）
+#define MOTION_MAX_PATTERNS 512 // 記法を展開した後の入力列の総数
+#define MOTION_MAX_STATES 2048  // オートマトンの状態数
+#define MOTION_MAX_OUTPUTS 8192 // 各状態で完成する入力列の一覧の総数
+#define MOTION_MAX_LENGTH 12    // 1つの入力列の方向数
+#define MOTION_HISTORY 16       // 2のべき乗。受付時間と溜めの確認に使う方向の履歴数
+#define MOTION_NAME_MAX 16
+#define MOTION_LABEL_MAX 16
+#define MOTION_SYMBOLS 9 // テンキー表記の1～9
+
+// レバー状態のビット値（上0x1 下0x2 左0x4 右0x8）からテンキー表記への変換表
+// 同時押しの打ち消しは表示の dir_cache と同じ扱いにする。
+static const uint8_t motion_numpad[16] = {5, 8, 2, 5, 4, 7, 1, 4, 6, 9, 3, 6, 5, 8, 2, 5};
+
+// コマンドの定義
+typedef struct
+{
+    char name[MOTION_NAME_MAX];   // 名前（確認用プログラムの期待値に使う）
+    char label[MOTION_LABEL_MAX]; // 入力ログに添える文字列
+    uint64_t window_ns;           // 受付時間
+} MotionDef;
+
+// 記法を展開した1つの入力列
+typedef struct
+{
+    uint8_t motion;      // コマンドの番号（0から）
+    uint8_t length;      // 方向数
+    uint16_t charge_set; // 溜めの方向の集合（テンキー表記のビット。0なら溜めなし）
+    uint64_t charge_ns;  // 溜めに必要な時間
+} MotionPattern;
+
+// 全コマンドをまとめたオートマトン
+// 読み込んだ後は読み出すだけなので、全プレイヤーと描画スレッドで共有する。
+typedef struct
+{
+    int motion_count;
+    MotionDef motions[MOTION_MAX];
+    int pattern_count;
+    MotionPattern patterns[MOTION_MAX_PATTERNS];
+    int state_count;
+    uint16_t next[MOTION_MAX_STATES][MOTION_SYMBOLS]; // 遷移表（失敗時の遷移も展開済み）
+    uint16_t output_first[MOTION_MAX_STATES];         // その状態で完成する入力列の一覧の位置
+    uint16_t output_count[MOTION_MAX_STATES];
+    int output_total;
+    uint16_t outputs[MOTION_MAX_OUTPUTS]; // 入力列の番号。状態ごとに優先度の順
+} MotionTable;
+
+// プレイヤーごとの認識状態
+typedef struct
+{
+    uint16_t state;                   // オートマトンの現在の状態
+    uint8_t numpad;                   // 直前の方向（0なら未入力）
+    uint32_t count;                   // 入力した方向の総数
+    uint8_t dirs[MOTION_HISTORY];     // 方向の履歴
+    uint64_t times_ns[MOTION_HISTORY]; // その方向に入った時刻
+} MotionTracker;
+
+extern const char *const motion_default_definitions;
+
+bool motion_table_load(MotionTable *t, const char *text, const char *source, double frame_ns);
+bool motion_table_load_file(MotionTable *t, const char *path, double frame_ns);
+int motion_table_find(const MotionTable *t, const char *name);
+void motion_tracker_reset(MotionTracker *m);
+int motion_tracker_feed(MotionTracker *m, const MotionTable *t, uint8_t dir_index, uint64_t time_ns);
+
+#endif
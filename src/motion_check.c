@@ -0,0 +1,417 @@
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "motion.h"
+#include "session_record.h"
+#include "state_engine.h"
+
+// コマンド認識の確認用プログラム
+// 入力例と期待する認識結果を並べたコーパスを状態管理の処理にそのまま通し、入力ログに記録されたコマンドを比べる。
+// --session を指定するとセッション記録を再生し、認識したコマンドをtickとプレイヤーつきで出力する。
+// 実際の入力を記録してコーパスの入力例を作るときに使う。
+// --late N を指定すると、tickを毎回ではなくNtickに1回だけ進めて（tickの起床がN-1tick遅れた状態を作って）同じ入力をもう一度通し、
+// 入力ログの向き・ボタン・コマンドと確定したフレームカウントが遅れのない場合と一致するかを確かめる。
+// --session と組み合わせると、記録全体の入力ログのハッシュ値を両方で求めて比べる。
+//
+// [コーパスの書式] 1行に1件。# 以降は注釈
+// 名前: 入力 ... => 期待するコマンドの名前 ...（なければ -）
+//   入力 : テンキー表記の方向に +ABCD でボタン、xN でとどまるフレーム数（既定1、小数可）を続ける
+//          例） 2x2 3 6+Ax4 5x10
+
+#define CHECK_FRAME_NS (1e9 / 60) // コーパスの1フレームの長さ
+#define CHECK_MAX_INPUTS 64
+#define CHECK_MAX_EXPECT 16
+#define CHECK_TAIL_FRAMES 5 // 最後の入力の後に進めるフレーム数
+
+// テンキー表記からレバー状態のビット値への変換表（0は未使用）
+static const uint16_t numpad_word[10] = {
+    0,
+    INPUT_BIT_DOWN | INPUT_BIT_LEFT,  // 1
+    INPUT_BIT_DOWN,                   // 2
+    INPUT_BIT_DOWN | INPUT_BIT_RIGHT, // 3
+    INPUT_BIT_LEFT,                   // 4
+    0,                                // 5
+    INPUT_BIT_RIGHT,                  // 6
+    INPUT_BIT_UP | INPUT_BIT_LEFT,    // 7
+    INPUT_BIT_UP,                     // 8
+    INPUT_BIT_UP | INPUT_BIT_RIGHT,   // 9
+};
+
+static MotionTable table;
+static SocdPolicy socd_policy = SOCD_CANCEL;
+static int late_ticks = 1; // tickを進める間隔（1なら毎tick）
+static DrawableSet drawable; // tickの番号を進めるため、input_dispi と同じく毎tick公開する
+
+/**
+ * @brief 終了した入力ログを、前のログとの開始時刻の差から求めた継続時間とあわせてハッシュ値に畳み込む。
+ *        seenは次に畳み込むログの番号で、畳み込んだ分だけ進める。継続中の最新のログは含めない。
+ */
+static uint64_t hash_closed_log(uint64_t hash, const LogRing *log, uint32_t *seen, double frame_ns)
+{
+    for (; *seen + 1 < log->count; (*seen)++)
+    {
+        uint32_t i = *seen & LOG_HISTORY_MASK;
+        LogState s = log->entries[i];
+        uint32_t tenths = log_duration_tenths(log->start_ns[(i + 1) & LOG_HISTORY_MASK] - log->start_ns[i], frame_ns);
+        uint64_t value = s.dir_index | s.btn_index << 4 | s.motion << 8 | (uint64_t)tenths << 16;
+        hash = (hash ^ value) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief 入力1つ分（例: 6+Ax4）を入力ワードととどまる時間にする。
+ */
+static bool parse_input(const char *token, uint16_t *word, double *frames)
+{
+    if (token[0] < '1' || token[0] > '9')
+        return false;
+    *word = numpad_word[token[0] - '0'];
+    *frames = 1;
+    const char *s = token + 1;
+    if (*s == '+')
+        for (s++; *s >= 'A' && *s <= 'D'; s++)
+            *word |= INPUT_BIT_A << (*s - 'A');
+    if (*s == 'x')
+    {
+        char *end;
+        *frames = strtod(s + 1, &end);
+        if (end == s + 1 || *frames <= 0)
+            return false;
+        s = end;
+    }
+    return *s == '\0';
+}
+
+/**
+ * @brief 入力を時刻つきのエッジにしてtickごとに状態を進め、記録されたコマンドの名前を順に返す。
+ *        lateごとのtickだけ状態を進め、その間に届いたエッジはまとめて畳み込む。log_hashには入力ログのハッシュ値を返す。
+ */
+static int run_inputs(const uint16_t *words, const double *frames, int count, int late, const char **found,
+                      int max_found, uint64_t *log_hash)
+{
+    static StateContext st;
+    state_context_init(&st, socd_policy, 1, CHECK_FRAME_NS, CHECK_FRAME_NS);
+    st.motions = &table;
+
+    InputEdge edges[CHECK_MAX_INPUTS];
+    double total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        edges[i] = (InputEdge){.time_ns = (uint64_t)((1 + total) * CHECK_FRAME_NS), .word = words[i]};
+        total += frames[i];
+    }
+    int ticks = (int)total + 1 + CHECK_TAIL_FRAMES;
+    int next = 0;
+    for (int tick = 0; tick <= ticks; tick++)
+    {
+        if (tick % late != 0 && tick != ticks)
+            continue;
+        uint64_t tick_ns = (uint64_t)(tick * CHECK_FRAME_NS);
+        int first = next;
+        while (next < count && edges[next].time_ns <= tick_ns)
+            next++;
+        state_context_tick(&st, &edges[first], next - first, tick_ns);
+        state_context_publish(&st, &drawable);
+    }
+
+    const LogRing *log = &st.players[0].log;
+    uint32_t seen = 0;
+    *log_hash = hash_closed_log(0xcbf29ce484222325ULL, log, &seen, CHECK_FRAME_NS);
+    int n = 0;
+    for (uint32_t i = log->base; i < log->count && n < max_found; i++)
+    {
+        unsigned motion = log->entries[i & LOG_HISTORY_MASK].motion;
+        if (motion)
+            found[n++] = table.motions[motion - 1].name;
+    }
+    return n;
+}
+
+/**
+ * @brief コーパスの1行を確認する。注釈だけの行は検査数に数えない。
+ */
+static bool check_case(char *line, const char *path, int line_no, int *cases)
+{
+    char *comment = strchr(line, '#');
+    if (comment)
+        *comment = '\0';
+    if (strspn(line, " \t\r\n") == strlen(line))
+        return true;
+    char *colon = strchr(line, ':');
+    char *arrow = strstr(line, "=>");
+    if (!colon || !arrow || arrow < colon)
+    {
+        fprintf(stderr, "[error] %s:%d: expected 'NAME: INPUTS => MOTIONS'\n", path, line_no);
+        return false;
+    }
+    *colon = '\0';
+    *arrow = '\0';
+    char *name = line + strspn(line, " \t");
+    (*cases)++;
+
+    uint16_t words[CHECK_MAX_INPUTS];
+    double frames[CHECK_MAX_INPUTS];
+    int count = 0;
+    for (char *tok = strtok(colon + 1, " \t"); tok; tok = strtok(NULL, " \t"))
+    {
+        if (count >= CHECK_MAX_INPUTS || !parse_input(tok, &words[count], &frames[count]))
+        {
+            fprintf(stderr, "[error] %s:%d: invalid input '%s'\n", path, line_no, tok);
+            return false;
+        }
+        count++;
+    }
+    const char *expect[CHECK_MAX_EXPECT];
+    int expect_count = 0;
+    for (char *tok = strtok(arrow + 2, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n"))
+    {
+        if (strcmp(tok, "-") == 0)
+            continue;
+        if (motion_table_find(&table, tok) < 0 || expect_count >= CHECK_MAX_EXPECT)
+        {
+            fprintf(stderr, "[error] %s:%d: unknown motion '%s'\n", path, line_no, tok);
+            return false;
+        }
+        expect[expect_count++] = tok;
+    }
+
+    const char *found[CHECK_MAX_EXPECT + 1];
+    uint64_t log_hash;
+    int found_count = run_inputs(words, frames, count, 1, found, CHECK_MAX_EXPECT + 1, &log_hash);
+    bool ok = found_count == expect_count;
+    for (int i = 0; ok && i < found_count; i++)
+        ok = strcmp(found[i], expect[i]) == 0;
+    if (ok && late_ticks > 1)
+    {
+        // 遅れたtickでも同じコマンドと同じ入力ログにならなければならない
+        const char *late_found[CHECK_MAX_EXPECT + 1];
+        uint64_t late_hash;
+        int late_count = run_inputs(words, frames, count, late_ticks, late_found, CHECK_MAX_EXPECT + 1, &late_hash);
+        bool same = late_count == found_count && late_hash == log_hash;
+        for (int i = 0; same && i < found_count; i++)
+            same = strcmp(late_found[i], found[i]) == 0;
+        if (!same)
+            fprintf(stderr, "[error] %s:%d: %s: the log differs when ticks are %d late\n", path, line_no, name,
+                    late_ticks - 1);
+        return same;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "[error] %s:%d: %s: expected", path, line_no, name);
+        for (int i = 0; i < expect_count; i++)
+            fprintf(stderr, " %s", expect[i]);
+        fprintf(stderr, "%s, got", expect_count ? "" : " -");
+        for (int i = 0; i < found_count; i++)
+            fprintf(stderr, " %s", found[i]);
+        fprintf(stderr, "%s\n", found_count ? "" : " -");
+    }
+    return ok;
+}
+
+static int check_corpus(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+    {
+        perror(path);
+        return 1;
+    }
+    char line[1024];
+    int line_no = 0, cases = 0, failed = 0;
+    while (fgets(line, sizeof(line), fp))
+        if (!check_case(line, path, ++line_no, &cases))
+            failed++;
+    fclose(fp);
+    printf("[info] %d/%d cases passed (%d motions, %d patterns, %d automaton states)\n", cases - failed, cases,
+           table.motion_count, table.pattern_count, table.state_count);
+    if (late_ticks > 1)
+        printf("[info] logs compared with ticks advanced every %d ticks\n", late_ticks);
+    return failed ? 1 : 0;
+}
+
+/**
+ * @brief 記録のi件目から始まるtick番号tickのエッジにシステム用のエッジがあれば真を返す。
+ */
+static bool has_system_edge(const SessionRecording *rec, size_t i, uint32_t tick)
+{
+    for (; i < rec->count && rec->edges[i].tick == tick; i++)
+        if (rec->edges[i].player == INPUT_PLAYER_SYSTEM)
+            return true;
+    return false;
+}
+
+/**
+ * @brief セッション記録をlateごとのtickで再生し、全プレイヤーの入力ログのハッシュ値を返す。
+ *        無操作リセットは再生するtickの間隔で時期が変わるため止めておく。
+ *        DELなどシステム用のエッジを含むtickとその直前のtickは、リセットの時刻とリセットより前に畳み込むエッジをそろえるため遅らせない。
+ */
+static uint64_t hash_session(const SessionRecording *rec, int late)
+{
+    static StateContext st;
+    state_context_init(&st, socd_policy, INPUT_MAX_PLAYERS, rec->period_ns, rec->period_ns);
+    st.motions = &table;
+    st.idle_ns = UINT64_MAX;
+
+    // 畳み込む順がtickの間隔で変わらないよう、プレイヤーごとに求めてから最後にまとめる
+    uint64_t hashes[INPUT_MAX_PLAYERS];
+    uint32_t seen[INPUT_MAX_PLAYERS] = {0};
+    for (int p = 0; p < INPUT_MAX_PLAYERS; p++)
+        hashes[p] = 0xcbf29ce484222325ULL;
+    uint32_t last_tick = rec->count ? rec->edges[rec->count - 1].tick : 0;
+    size_t first = 0, next = 0;
+    for (uint32_t tick = 0; tick <= last_tick + 1; tick++)
+    {
+        bool system = has_system_edge(rec, next, tick);
+        while (next < rec->count && rec->edges[next].tick == tick)
+            next++;
+        if (tick % late != 0 && tick <= last_tick && !system && !has_system_edge(rec, next, tick + 1))
+            continue;
+        state_context_tick(&st, &rec->edges[first], (int)(next - first), (uint64_t)(tick * rec->period_ns));
+        state_context_publish(&st, &drawable);
+        first = next;
+        // リングが一周する前に畳み込む
+        for (int p = 0; p < INPUT_MAX_PLAYERS; p++)
+            hashes[p] = hash_closed_log(hashes[p], &st.players[p].log, &seen[p], rec->period_ns);
+    }
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int p = 0; p < INPUT_MAX_PLAYERS; p++)
+        hash = (hash ^ hashes[p]) * 0x100000001b3ULL;
+    return hash;
+}
+
+/**
+ * @brief セッション記録を毎tickとlate_ticksごとのtickで再生し、入力ログが一致するか確かめる。
+ */
+static int compare_session(const SessionRecording *rec)
+{
+    uint64_t on_time = hash_session(rec, 1);
+    uint64_t late = hash_session(rec, late_ticks);
+    printf("[info] log hash %016llx every tick, %016llx every %d ticks\n", (unsigned long long)on_time,
+           (unsigned long long)late, late_ticks);
+    if (on_time != late)
+    {
+        printf("[error] the log differs when ticks are %d late\n", late_ticks - 1);
+        return 1;
+    }
+    printf("[info] the log does not depend on tick timing\n");
+    return 0;
+}
+
+/**
+ * @brief セッション記録を再生し、認識したコマンドを出力する。
+ */
+static void print_session(const SessionRecording *rec)
+{
+    static StateContext st;
+    state_context_init(&st, socd_policy, INPUT_MAX_PLAYERS, rec->period_ns, rec->period_ns);
+    st.motions = &table;
+
+    uint32_t seen[INPUT_MAX_PLAYERS] = {0};
+    uint32_t last_tick = rec->count ? rec->edges[rec->count - 1].tick : 0;
+    size_t next = 0;
+    int total = 0;
+    for (uint32_t tick = 0; tick <= last_tick; tick++)
+    {
+        size_t first = next;
+        while (next < rec->count && rec->edges[next].tick == tick)
+            next++;
+        state_context_tick(&st, &rec->edges[first], (int)(next - first), (uint64_t)(tick * rec->period_ns));
+        for (int p = 0; p < INPUT_MAX_PLAYERS; p++)
+        {
+            const LogRing *log = &st.players[p].log;
+            for (uint32_t i = seen[p]; i < log->count; i++)
+            {
+                unsigned motion = log->entries[i & LOG_HISTORY_MASK].motion;
+                if (!motion)
+                    continue;
+                printf("%u %dP %s\n", tick, p + 1, table.motions[motion - 1].name);
+                total++;
+            }
+            seen[p] = log->count;
+        }
+    }
+    printf("[info] %d motions in %u ticks\n", total, last_tick + 1);
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options] CORPUS\n"
+            "       %s [options] --session PATH\n"
+            "  --motion-file PATH     motion definitions (default: the built-in definitions)\n"
+            "  --socd cancel|last|up  opposing direction resolution (default: cancel)\n"
+            "  --session PATH         print the motions recognised in a recorded session\n"
+            "  --late N               also advance the state every N ticks only and compare the logs\n",
+            prog, prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"motion-file", required_argument, NULL, 'm'},
+        {"socd", required_argument, NULL, 's'},
+        {"session", required_argument, NULL, 'p'},
+        {"late", required_argument, NULL, 'l'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    const char *motion_file = NULL, *session_path = NULL;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            motion_file = optarg;
+            break;
+        case 's':
+            if (!socd_parse_policy(optarg, &socd_policy))
+            {
+                fprintf(stderr, "[error] unknown socd policy: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'p':
+            session_path = optarg;
+            break;
+        case 'l':
+            late_ticks = atoi(optarg);
+            if (late_ticks < 1)
+            {
+                fprintf(stderr, "[error] --late must be at least 1\n");
+                return 1;
+            }
+            break;
+        default:
+            print_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!session_path && optind != argc - 1)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // 受付時間はセッション記録ならそのtick周期で、コーパスなら60Hzで数える
+    SessionRecording rec = {0};
+    if (session_path && !session_load(session_path, &rec))
+        return 1;
+    double frame_ns = session_path ? rec.period_ns : CHECK_FRAME_NS;
+    bool loaded = motion_file ? motion_table_load_file(&table, motion_file, frame_ns)
+                              : motion_table_load(&table, motion_default_definitions, "default motions", frame_ns);
+    if (!loaded)
+        return 1;
+    if (!session_path)
+        return check_corpus(argv[optind]);
+    int result = 0;
+    if (late_ticks > 1)
+        result = compare_session(&rec);
+    else
+        print_session(&rec);
+    session_free(&rec);
+    return result;
+}
@@ -0,0 +1,173 @@
+#define _GNU_SOURCE
+#include "rt_thread.h"
+
+#include <malloc.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// ヒストグラムの各区間の上限（マイクロ秒）。最後の区間は上限なし
+static const unsigned wake_bounds_us[WAKE_HIST_BUCKETS - 1] = {10, 20, 50, 100, 200, 500, 1000, 2000, 5000};
+
+/**
+ * @brief スレッドの開始処理。スタックを事前に確保してから本来の処理を呼ぶ。
+ */
+static void *rt_thread_entry(void *arg)
+{
+    RtThreadConfig *cfg = arg;
+    if (cfg->name)
+        pthread_setname_np(pthread_self(), cfg->name);
+    if (cfg->prefault)
+        rt_prefault_stack();
+    return cfg->start(cfg->arg);
+}
+
+/**
+ * @brief 設定どおりのCPUと優先度でスレッドを作成する。
+ *        属性を適用できなければ警告を出し、スタックサイズだけを指定して作り直す。
+ */
+bool rt_thread_create(pthread_t *tid, RtThreadConfig *cfg)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, RT_THREAD_STACK_SIZE);
+    if (cfg->cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cfg->cpu, &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+    if (cfg->policy != SCHED_OTHER)
+    {
+        struct sched_param param = {.sched_priority = cfg->priority};
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, cfg->policy);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+    int rc = pthread_create(tid, &attr, rt_thread_entry, cfg);
+    pthread_attr_destroy(&attr);
+    if (rc == 0)
+        return true;
+
+    fprintf(stderr, "[warn] %s: cpu %d / priority %d not applied (%s), starting as a normal thread\n",
+            cfg->name, cfg->cpu, cfg->priority, strerror(rc));
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, RT_THREAD_STACK_SIZE);
+    rc = pthread_create(tid, &attr, rt_thread_entry, cfg);
+    pthread_attr_destroy(&attr);
+    return rc == 0;
+}
+
+/**
+ * @brief 呼び出したスレッド自身にCPUの固定と優先度を適用する。作成済みのメインスレッド用。
+ */
+void rt_thread_apply_self(const RtThreadConfig *cfg)
+{
+    if (cfg->name)
+        pthread_setname_np(pthread_self(), cfg->name);
+    if (cfg->cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cfg->cpu, &set);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc != 0)
+            fprintf(stderr, "[warn] %s: cpu %d not applied (%s)\n", cfg->name, cfg->cpu, strerror(rc));
+    }
+    if (cfg->policy != SCHED_OTHER)
+    {
+        struct sched_param param = {.sched_priority = cfg->priority};
+        int rc = pthread_setschedparam(pthread_self(), cfg->policy, &param);
+        if (rc != 0)
+            fprintf(stderr, "[warn] %s: priority %d not applied (%s)\n", cfg->name, cfg->priority, strerror(rc));
+    }
+    if (cfg->prefault)
+        rt_prefault_stack();
+}
+
+/**
+ * @brief 現在と今後のメモリをすべてロックし、ヒープを事前に確保して手放さないようにする。
+ *        以降はページフォルトやスワップによる停止が起きない。
+ */
+bool rt_lock_memory(void)
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+    {
+        perror("[warn] mlockall");
+        return false;
+    }
+    // 解放したメモリをOSに返さず、大きな確保もmmapではなくヒープから行う
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    // 直後に解放する領域への書き込みは最適化で消されるため、volatile経由で1ページに1バイトずつ書く
+    volatile unsigned char *heap = malloc(RT_PREFAULT_HEAP);
+    if (heap)
+    {
+        long page = sysconf(_SC_PAGESIZE);
+        for (size_t i = 0; i < RT_PREFAULT_HEAP; i += page)
+            heap[i] = 0;
+        free((void *)heap);
+    }
+    return true;
+}
+
+/**
+ * @brief スタックを事前に触れてページを割り当てておく。
+ *        使われない配列へのmemsetは最適化で消されるため、volatile経由で1ページに1バイトずつ書く。
+ */
+void rt_prefault_stack(void)
+{
+    volatile unsigned char stack[RT_PREFAULT_STACK];
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < sizeof(stack); i += page)
+        stack[i] = 0;
+}
+
+void wake_histogram_add(WakeHistogram *h, uint64_t late_ns)
+{
+    unsigned us = late_ns / 1000;
+    int b = 0;
+    while (b < WAKE_HIST_BUCKETS - 1 && us >= wake_bounds_us[b])
+        b++;
+    atomic_fetch_add_explicit(&h->counts[b], 1, memory_order_relaxed);
+    if (late_ns > atomic_load_explicit(&h->max_ns, memory_order_relaxed))
+        atomic_store_explicit(&h->max_ns, late_ns, memory_order_relaxed);
+}
+
+/**
+ * @brief 割合qの位置が入る区間の上限をマイクロ秒で返す。最後の区間に入るときは最大値を返す。
+ */
+unsigned wake_histogram_percentile_us(const WakeHistogram *h, double q)
+{
+    unsigned long counts[WAKE_HIST_BUCKETS], total = 0;
+    for (int b = 0; b < WAKE_HIST_BUCKETS; b++)
+        total += counts[b] = atomic_load_explicit(&h->counts[b], memory_order_relaxed);
+    unsigned long rank = (unsigned long)(total * q), seen = 0;
+    for (int b = 0; b < WAKE_HIST_BUCKETS - 1; b++)
+    {
+        seen += counts[b];
+        if (seen > rank)
+            return wake_bounds_us[b];
+    }
+    return atomic_load_explicit(&h->max_ns, memory_order_relaxed) / 1000;
+}
+
+/**
+ * @brief ヒストグラムを1行で出力する。
+ */
+void wake_histogram_report(const WakeHistogram *h, FILE *fp)
+{
+    fprintf(fp, "[info] wake %-6s", h->name);
+    for (int b = 0; b < WAKE_HIST_BUCKETS; b++)
+    {
+        unsigned long n = atomic_load(&h->counts[b]);
+        if (b < WAKE_HIST_BUCKETS - 1)
+            fprintf(fp, " <%uus %lu", wake_bounds_us[b], n);
+        else
+            fprintf(fp, " >=%uus %lu", wake_bounds_us[b - 1], n);
+    }
+    fprintf(fp, ", max %.1f us\n", atomic_load(&h->max_ns) / 1e3);
+}
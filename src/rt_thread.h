@@ -0,0 +1,53 @@
+#ifndef RT_THREAD_H
+#define RT_THREAD_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// リアルタイム動作の補助
+// スレッドは作成前に属性でCPUの固定とスケジューリング方針・優先度を決め、
+// 作成直後から通常スレッドとして動く期間がないようにする。
+// 権限がなく属性を適用できない場合は警告を出して通常のスレッドとして作成する。
+
+#define RT_THREAD_STACK_SIZE (1024 * 1024) // スレッドのスタックサイズ1MB
+#define RT_PREFAULT_STACK (256 * 1024)     // 開始時に事前に触れておくスタックの量
+#define RT_PREFAULT_HEAP (4 * 1024 * 1024) // 事前に確保して手放さないヒープの量
+
+// スレッドの作成設定
+// 作成したスレッドが開始するまで参照するため、呼び出し側は静的に持つ。
+typedef struct
+{
+    const char *name;        // スレッド名（top/psで表示、15文字まで）
+    int cpu;                 // 固定するCPU番号（-1なら固定しない）
+    int policy;              // SCHED_FIFO もしくは SCHED_OTHER
+    int priority;            // SCHED_FIFOの優先度
+    bool prefault;           // 開始時にスタックを事前に確保する
+    void *(*start)(void *);
+    void *arg;
+} RtThreadConfig;
+
+bool rt_thread_create(pthread_t *tid, RtThreadConfig *cfg);
+void rt_thread_apply_self(const RtThreadConfig *cfg);
+bool rt_lock_memory(void);
+void rt_prefault_stack(void);
+
+#define WAKE_HIST_BUCKETS 10
+
+// 起床遅れのヒストグラム
+// 予定した時刻から実際に動き出すまでの遅れを対数的な区間で数える。描画スレッドからも読むためアトミックにしている。
+typedef struct
+{
+    const char *name;
+    atomic_ulong counts[WAKE_HIST_BUCKETS];
+    atomic_uint_fast64_t max_ns;
+} WakeHistogram;
+
+void wake_histogram_add(WakeHistogram *h, uint64_t late_ns);
+unsigned wake_histogram_percentile_us(const WakeHistogram *h, double q);
+void wake_histogram_report(const WakeHistogram *h, FILE *fp);
+
+#endif
@@ -0,0 +1,212 @@
+#include "session_record.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WRITE_BATCH 256 // 1回のfwriteでまとめて書くエッジ数
+
+static inline void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = v >> (8 * i);
+}
+
+static inline void put_u64(uint8_t *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = v >> (8 * i);
+}
+
+static inline uint16_t get_u16(const uint8_t *p)
+{
+    return p[0] | (uint16_t)p[1] << 8;
+}
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--)
+        v = v << 8 | p[i];
+    return v;
+}
+
+static inline uint64_t get_u64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = v << 8 | p[i];
+    return v;
+}
+
+/**
+ * @brief キューに溜まったエッジをまとめてファイルへ書き出す。書き出した件数を返す。
+ */
+static size_t flush_queue(SessionRecorder *rec)
+{
+    uint8_t buf[WRITE_BATCH * SESSION_EDGE_SIZE];
+    uint64_t epoch = atomic_load_explicit(&rec->epoch_ns, memory_order_acquire);
+    size_t total = 0, n;
+    InputEdge e;
+    do
+    {
+        for (n = 0; n < WRITE_BATCH && edge_queue_pop(&rec->queue, &e); n++)
+        {
+            uint8_t *p = &buf[n * SESSION_EDGE_SIZE];
+            put_u64(p, e.time_ns > epoch ? e.time_ns - epoch : 0);
+            put_u32(p + 8, e.tick);
+            put_u16(p + 12, e.word);
+            p[14] = e.player;
+            p[15] = e.device;
+        }
+        if (n > 0 && fwrite(buf, SESSION_EDGE_SIZE, n, rec->fp) != n)
+            perror("[error] session record write");
+        total += n;
+    } while (n == WRITE_BATCH);
+    return total;
+}
+
+/**
+ * @brief 書き込みスレッド。キューが空の間は10msごとに確認し、そのときにバッファもフラッシュする。
+ *        停止要求後はキューを空にしてから終わる。
+ */
+static void *writer_thread(void *arg)
+{
+    SessionRecorder *rec = arg;
+    struct timespec interval = {.tv_sec = 0, .tv_nsec = 10000000}; // 10ms
+
+    while (atomic_load(&rec->running))
+    {
+        size_t n = flush_queue(rec);
+        atomic_fetch_add(&rec->written, n);
+        if (n == 0)
+        {
+            fflush(rec->fp);
+            nanosleep(&interval, NULL);
+        }
+    }
+    atomic_fetch_add(&rec->written, flush_queue(rec));
+    return NULL;
+}
+
+/**
+ * @brief 記録ファイルを作成してヘッダを書き、書き込みスレッドを開始する。
+ */
+bool session_recorder_open(SessionRecorder *rec, const char *path, double period_ns)
+{
+    memset(rec, 0, sizeof(*rec));
+    rec->fp = fopen(path, "wb");
+    if (!rec->fp)
+    {
+        perror(path);
+        return false;
+    }
+
+    uint8_t header[SESSION_HEADER_SIZE] = {0};
+    memcpy(header, SESSION_MAGIC, 4);
+    put_u16(header + 4, SESSION_VERSION);
+    uint64_t period_bits;
+    memcpy(&period_bits, &period_ns, sizeof(period_bits));
+    put_u64(header + 8, period_bits);
+    put_u64(header + 16, (uint64_t)time(NULL));
+    if (fwrite(header, sizeof(header), 1, rec->fp) != 1)
+    {
+        perror(path);
+        fclose(rec->fp);
+        return false;
+    }
+
+    atomic_store(&rec->running, true);
+    if (pthread_create(&rec->thread, NULL, writer_thread, rec) != 0)
+    {
+        fprintf(stderr, "[error] session writer thread creation failed\n");
+        fclose(rec->fp);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 書き込みスレッドを止めて残りを書き出し、ファイルを閉じる。
+ */
+void session_recorder_close(SessionRecorder *rec)
+{
+    if (!rec->fp)
+        return;
+    atomic_store(&rec->running, false);
+    pthread_join(rec->thread, NULL);
+    fclose(rec->fp);
+    rec->fp = NULL;
+    printf("[info] session recorded %lu edges (dropped %lu)\n", atomic_load(&rec->written),
+           edge_queue_overflows(&rec->queue));
+}
+
+/**
+ * @brief 記録ファイルをすべてメモリに読み込む。
+ */
+bool session_load(const char *path, SessionRecording *out)
+{
+    memset(out, 0, sizeof(*out));
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        perror(path);
+        return false;
+    }
+
+    uint8_t header[SESSION_HEADER_SIZE];
+    if (fread(header, sizeof(header), 1, fp) != 1 || memcmp(header, SESSION_MAGIC, 4) != 0 ||
+        get_u16(header + 4) != SESSION_VERSION)
+    {
+        fprintf(stderr, "[error] not a session record: %s\n", path);
+        fclose(fp);
+        return false;
+    }
+    uint64_t period_bits = get_u64(header + 8);
+    memcpy(&out->period_ns, &period_bits, sizeof(period_bits));
+
+    size_t capacity = 4096;
+    out->edges = malloc(capacity * sizeof(InputEdge));
+    uint8_t p[SESSION_EDGE_SIZE];
+    while (out->edges && fread(p, sizeof(p), 1, fp) == 1)
+    {
+        if (out->count == capacity)
+        {
+            capacity *= 2;
+            InputEdge *grown = realloc(out->edges, capacity * sizeof(InputEdge));
+            if (!grown)
+            {
+                free(out->edges);
+                out->edges = NULL;
+                break;
+            }
+            out->edges = grown;
+        }
+        out->edges[out->count++] = (InputEdge){
+            .time_ns = get_u64(p),
+            .tick = get_u32(p + 8),
+            .word = get_u16(p + 12),
+            .player = p[14],
+            .device = p[15]};
+    }
+    fclose(fp);
+    if (!out->edges)
+    {
+        fprintf(stderr, "[error] out of memory loading %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+void session_free(SessionRecording *rec)
+{
+    free(rec->edges);
+    rec->edges = NULL;
+    rec->count = 0;
+}
@@ -0,0 +1,73 @@
+#ifndef SESSION_RECORD_H
+#define SESSION_RECORD_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "edge_queue.h"
+#include "input_edge.h"
+
+// セッション記録ファイルの形式（リトルエンディアン）
+// ヘッダ 24バイト
+//   0  char[4]  "IDSR"
+//   4  uint16   形式のバージョン
+//   6  uint16   予約（0）
+//   8  double   記録時のtick周期（ナノ秒）
+//   16 uint64   記録開始時刻（UNIX時刻の秒）
+// エッジ 16バイト × 件数（追記のみ）
+//   0  uint64   tick基準時刻からの経過時間（ナノ秒）
+//   8  uint32   状態管理スレッドが受け取ったtick番号
+//   12 uint16   入力ワード
+//   14 uint8    プレイヤー
+//   15 uint8    デバイス番号
+#define SESSION_MAGIC "IDSR"
+#define SESSION_VERSION 1
+#define SESSION_HEADER_SIZE 24
+#define SESSION_EDGE_SIZE 16
+
+// セッション記録の書き込み
+// 状態管理スレッドはキューにエッジを積むだけで、ファイルへの書き込みは専用のスレッドが行う。
+typedef struct
+{
+    FILE *fp;
+    pthread_t thread;
+    atomic_bool running;
+    atomic_uint_fast64_t epoch_ns; // tick基準時刻。状態管理スレッドが開始時に設定する
+    atomic_ulong written;          // 書き込んだエッジ数
+    EdgeQueue queue;
+} SessionRecorder;
+
+// 読み込んだセッション記録
+typedef struct
+{
+    double period_ns;
+    InputEdge *edges; // time_nsはtick基準時刻からの経過時間
+    size_t count;
+} SessionRecording;
+
+bool session_recorder_open(SessionRecorder *rec, const char *path, double period_ns);
+void session_recorder_close(SessionRecorder *rec);
+
+/**
+ * @brief tick基準時刻を設定する。状態管理スレッドがtickを開始したときに呼ぶ。
+ */
+static inline void session_recorder_start(SessionRecorder *rec, uint64_t epoch_ns)
+{
+    atomic_store_explicit(&rec->epoch_ns, epoch_ns, memory_order_release);
+}
+
+/**
+ * @brief エッジを記録する。書き込みスレッドへ渡すだけでディスクには触れない。
+ */
+static inline void session_recorder_push(SessionRecorder *rec, const InputEdge *e)
+{
+    edge_queue_push(&rec->queue, e);
+}
+
+bool session_load(const char *path, SessionRecording *out);
+void session_free(SessionRecording *rec);
+
+#endif
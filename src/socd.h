@@ -0,0 +1,76 @@
+#ifndef SOCD_H
+#define SOCD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// SOCD（上下・左右の同時入力）の解決
+// レバー状態のニブルを上下（bit0-1）と左右（bit2-3）の軸に分け、軸ごとに64要素の表を引いて解決する。
+// 表の添え字は「前回の生入力（2bit） | 今回の生入力（2bit）<< 2 | 前回の解決結果（2bit）<< 4」で、
+// 後押し優先のように履歴が必要な方式も含めてすべて表引きだけで済むため、分岐なしで解決できる。
+// 軸の2bitは bit0 が上/左、bit1 が下/右。
+typedef enum
+{
+    SOCD_CANCEL,      // 同時入力はニュートラル（従来の表示と同じ）
+    SOCD_LAST_WIN,    // 後から押した方を優先
+    SOCD_UP_PRIORITY, // 上下は上を優先、左右はニュートラル
+    SOCD_POLICY_COUNT,
+} SocdPolicy;
+
+#define SOCD_PREV(i) ((i) & 3)
+#define SOCD_CUR(i) (((i) >> 2) & 3)
+#define SOCD_RES(i) (((i) >> 4) & 3)
+
+// 軸ごとの解決規則。表はコンパイル時にこれらの式から生成する
+#define SOCD_AXIS_CANCEL(i) (SOCD_CUR(i) == 3 ? 0 : SOCD_CUR(i))
+#define SOCD_AXIS_FIRST(i) (SOCD_CUR(i) == 3 ? 1 : SOCD_CUR(i))
+// 両方押されたとき、前回片方だけなら新しく押された側、前回も両方なら前回の結果、前回なしならニュートラル
+#define SOCD_AXIS_LAST(i) \
+    (SOCD_CUR(i) != 3 ? SOCD_CUR(i) : SOCD_PREV(i) == 3 ? SOCD_RES(i) : SOCD_PREV(i) == 0 ? 0 : 3 - SOCD_PREV(i))
+
+#define SOCD_R4(M, n) M(n), M(n + 1), M(n + 2), M(n + 3)
+#define SOCD_R16(M, n) SOCD_R4(M, n), SOCD_R4(M, n + 4), SOCD_R4(M, n + 8), SOCD_R4(M, n + 12)
+#define SOCD_R64(M) SOCD_R16(M, 0), SOCD_R16(M, 16), SOCD_R16(M, 32), SOCD_R16(M, 48)
+
+// [方式][0=上下 1=左右][添え字]
+static const uint8_t socd_axis_tables[SOCD_POLICY_COUNT][2][64] = {
+    [SOCD_CANCEL] = {{SOCD_R64(SOCD_AXIS_CANCEL)}, {SOCD_R64(SOCD_AXIS_CANCEL)}},
+    [SOCD_LAST_WIN] = {{SOCD_R64(SOCD_AXIS_LAST)}, {SOCD_R64(SOCD_AXIS_LAST)}},
+    [SOCD_UP_PRIORITY] = {{SOCD_R64(SOCD_AXIS_FIRST)}, {SOCD_R64(SOCD_AXIS_CANCEL)}},
+};
+
+_Static_assert(SOCD_AXIS_LAST(1 | 3 << 2) == 2, "down pressed after up wins");
+_Static_assert(SOCD_AXIS_LAST(2 | 3 << 2) == 1, "up pressed after down wins");
+_Static_assert(SOCD_AXIS_LAST(3 | 3 << 2 | 2 << 4) == 2, "held pair keeps the previous winner");
+
+/**
+ * @brief レバー状態のニブルを方式に従って解決する。
+ *        prev_raw/prev_resolved は同じプレイヤーの直前の生入力と解決結果。
+ */
+static inline uint8_t socd_resolve(SocdPolicy policy, uint8_t prev_raw, uint8_t raw, uint8_t prev_resolved)
+{
+    const uint8_t(*t)[64] = socd_axis_tables[policy];
+    uint8_t v = t[0][(prev_raw & 3) | (raw & 3) << 2 | (prev_resolved & 3) << 4];
+    uint8_t h = t[1][(prev_raw >> 2 & 3) | (raw >> 2 & 3) << 2 | (prev_resolved >> 2 & 3) << 4];
+    return v | h << 2;
+}
+
+/**
+ * @brief cancel/last/up の名前から方式を選ぶ。
+ */
+static inline bool socd_parse_policy(const char *s, SocdPolicy *policy)
+{
+    static const char *const names[SOCD_POLICY_COUNT] = {"cancel", "last", "up"};
+    for (int i = 0; i < SOCD_POLICY_COUNT; i++)
+    {
+        if (strcmp(s, names[i]) == 0)
+        {
+            *policy = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
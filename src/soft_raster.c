@@ -0,0 +1,379 @@
+#include "soft_raster.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// GPUのない環境で描画命令列をRGBAバッファに描くソフトウェアラスタライザ
+// 描画コストの計測と、出力画像の比較による描画の回帰確認に使う。
+// 画素の中心1点で内外判定する単純な方式で、同じ入力からは常に同じ画素値になる。
+
+bool soft_canvas_init(SoftCanvas *canvas, int width, int height)
+{
+    canvas->width = width;
+    canvas->height = height;
+    canvas->rgba = calloc((size_t)width * height, 4);
+    return canvas->rgba != NULL;
+}
+
+void soft_canvas_free(SoftCanvas *canvas)
+{
+    free(canvas->rgba);
+    canvas->rgba = NULL;
+}
+
+/**
+ * @brief 1画素にアルファ合成する。coverageは0～255の被覆率。
+ */
+static inline void blend_pixel(uint8_t *p, DrawColor c, unsigned coverage)
+{
+    unsigned a = (c.a * coverage + 127) / 255;
+    if (a == 0)
+        return;
+    unsigned ia = 255 - a;
+    p[0] = (c.r * a + p[0] * ia + 127) / 255;
+    p[1] = (c.g * a + p[1] * ia + 127) / 255;
+    p[2] = (c.b * a + p[2] * ia + 127) / 255;
+    p[3] = a + (p[3] * ia + 127) / 255;
+}
+
+/**
+ * @brief 矩形を描画先の範囲に切り詰めた画素範囲を求める。範囲が空なら偽を返す。
+ */
+static bool clip_bounds(const SoftCanvas *canvas, float x0, float y0, float x1, float y1,
+                        int *ix0, int *iy0, int *ix1, int *iy1)
+{
+    *ix0 = x0 < 0 ? 0 : (int)floorf(x0);
+    *iy0 = y0 < 0 ? 0 : (int)floorf(y0);
+    *ix1 = x1 > canvas->width ? canvas->width : (int)ceilf(x1);
+    *iy1 = y1 > canvas->height ? canvas->height : (int)ceilf(y1);
+    return *ix0 < *ix1 && *iy0 < *iy1;
+}
+
+static void raster_clear(SoftCanvas *canvas, DrawColor c)
+{
+    uint8_t *p = canvas->rgba;
+    for (int i = 0; i < canvas->width * canvas->height; i++, p += 4)
+    {
+        p[0] = c.r;
+        p[1] = c.g;
+        p[2] = c.b;
+        p[3] = c.a;
+    }
+}
+
+static void raster_gradient_h(SoftCanvas *canvas, const DrawCmd *cmd)
+{
+    int x0, y0, x1, y1;
+    const DrawRect *r = &cmd->rect;
+    if (!clip_bounds(canvas, r->x, r->y, r->x + r->width, r->y + r->height, &x0, &y0, &x1, &y1))
+        return;
+    for (int x = x0; x < x1; x++)
+    {
+        float t = (x + 0.5f - r->x) / r->width;
+        DrawColor c = {
+            lroundf(cmd->color.r + (cmd->color2.r - cmd->color.r) * t),
+            lroundf(cmd->color.g + (cmd->color2.g - cmd->color.g) * t),
+            lroundf(cmd->color.b + (cmd->color2.b - cmd->color.b) * t),
+            lroundf(cmd->color.a + (cmd->color2.a - cmd->color.a) * t)};
+        for (int y = y0; y < y1; y++)
+            blend_pixel(&canvas->rgba[((size_t)y * canvas->width + x) * 4], c, 255);
+    }
+}
+
+static void raster_rect_rounded(SoftCanvas *canvas, const DrawCmd *cmd)
+{
+    int x0, y0, x1, y1;
+    const DrawRect *r = &cmd->rect;
+    if (!clip_bounds(canvas, r->x, r->y, r->x + r->width, r->y + r->height, &x0, &y0, &x1, &y1))
+        return;
+    // raylibのDrawRectangleRoundedと同じく短辺に対する角丸率から半径を求める
+    float radius = (r->width < r->height ? r->width : r->height) * cmd->param / 2;
+    float ix0 = r->x + radius, ix1 = r->x + r->width - radius;
+    float iy0 = r->y + radius, iy1 = r->y + r->height - radius;
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            float px = x + 0.5f, py = y + 0.5f;
+            float cx = px < ix0 ? ix0 : (px > ix1 ? ix1 : px);
+            float cy = py < iy0 ? iy0 : (py > iy1 ? iy1 : py);
+            float dx = px - cx, dy = py - cy;
+            if (dx * dx + dy * dy <= radius * radius)
+                blend_pixel(&canvas->rgba[((size_t)y * canvas->width + x) * 4], cmd->color, 255);
+        }
+    }
+}
+
+/**
+ * @brief 太さつきの線分を描画する。色は始点のc0から終点のc1へ補間する。
+ */
+static void raster_segment(SoftCanvas *canvas, float ax, float ay, float bx, float by, float half, DrawColor c0, DrawColor c1)
+{
+    bool gradient = memcmp(&c0, &c1, sizeof(c0)) != 0;
+    float dx = bx - ax, dy = by - ay;
+    float len2 = dx * dx + dy * dy;
+    if (len2 <= 0)
+        return;
+    int x0, y0, x1, y1;
+    if (!clip_bounds(canvas, fminf(ax, bx) - half, fminf(ay, by) - half, fmaxf(ax, bx) + half, fmaxf(ay, by) + half,
+                     &x0, &y0, &x1, &y1))
+        return;
+    // DrawLineExと同じく端に丸みのない太さつきの矩形として扱う
+    float len = sqrtf(len2);
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            float px = x + 0.5f - ax, py = y + 0.5f - ay;
+            float t = (px * dx + py * dy) / len2;
+            if (t < 0 || t > 1)
+                continue;
+            float dist = fabsf(px * dy - py * dx) / len;
+            if (dist > half)
+                continue;
+            DrawColor c = c0;
+            if (gradient)
+                c = (DrawColor){lroundf(c0.r + (c1.r - c0.r) * t), lroundf(c0.g + (c1.g - c0.g) * t),
+                                lroundf(c0.b + (c1.b - c0.b) * t), lroundf(c0.a + (c1.a - c0.a) * t)};
+            blend_pixel(&canvas->rgba[((size_t)y * canvas->width + x) * 4], c, 255);
+        }
+    }
+}
+
+static void raster_line(SoftCanvas *canvas, const DrawCmd *cmd)
+{
+    raster_segment(canvas, cmd->rect.x, cmd->rect.y, cmd->rect.width, cmd->rect.height, cmd->param / 2, cmd->color,
+                   cmd->color);
+}
+
+static void raster_polyline(SoftCanvas *canvas, const DrawCmd *cmd)
+{
+    for (int k = 0; k + 1 < cmd->quad_count; k++)
+    {
+        const DrawVertex *a = &cmd->vertices[k], *b = &cmd->vertices[k + 1];
+        raster_segment(canvas, a->x, a->y, b->x, b->y, cmd->param / 2, a->color, b->color);
+    }
+}
+
+static void raster_circle(SoftCanvas *canvas, const DrawCmd *cmd)
+{
+    float cx = cmd->rect.x, cy = cmd->rect.y, radius = cmd->param;
+    int x0, y0, x1, y1;
+    if (!clip_bounds(canvas, cx - radius, cy - radius, cx + radius, cy + radius, &x0, &y0, &x1, &y1))
+        return;
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            float dx = x + 0.5f - cx, dy = y + 0.5f - cy;
+            if (dx * dx + dy * dy <= radius * radius)
+                blend_pixel(&canvas->rgba[((size_t)y * canvas->width + x) * 4], cmd->color, 255);
+        }
+    }
+}
+
+/**
+ * @brief 三角形列を描画する。色は三角形ごとに最初の頂点の色で塗る。
+ */
+static void raster_triangles(SoftCanvas *canvas, const DrawCmd *cmd)
+{
+    const DrawTriangles *tris = cmd->triangles;
+    for (int i = 0; i + 2 < tris->vertex_count; i += 3)
+    {
+        const DrawVertex *v = &tris->vertices[i];
+        float ax = v[0].x + cmd->rect.x, ay = v[0].y + cmd->rect.y;
+        float bx = v[1].x + cmd->rect.x, by = v[1].y + cmd->rect.y;
+        float cx = v[2].x + cmd->rect.x, cy = v[2].y + cmd->rect.y;
+        float area = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+        if (area == 0)
+            continue;
+        int x0, y0, x1, y1;
+        if (!clip_bounds(canvas, fminf(ax, fminf(bx, cx)), fminf(ay, fminf(by, cy)), fmaxf(ax, fmaxf(bx, cx)),
+                         fmaxf(ay, fmaxf(by, cy)), &x0, &y0, &x1, &y1))
+            continue;
+        // 向きによらず内側を正にする
+        float sign = area > 0 ? 1.0f : -1.0f;
+        for (int y = y0; y < y1; y++)
+        {
+            for (int x = x0; x < x1; x++)
+            {
+                float px = x + 0.5f, py = y + 0.5f;
+                float w0 = ((cx - bx) * (py - by) - (cy - by) * (px - bx)) * sign;
+                float w1 = ((ax - cx) * (py - cy) - (ay - cy) * (px - cx)) * sign;
+                float w2 = ((bx - ax) * (py - ay) - (by - ay) * (px - ax)) * sign;
+                // 共有辺上の画素は両側で塗られるが、分割済みの図形は不透明なので結果は変わらない
+                if (w0 < 0 || w1 < 0 || w2 < 0)
+                    continue;
+                blend_pixel(&canvas->rgba[((size_t)y * canvas->width + x) * 4], v[0].color, 255);
+            }
+        }
+    }
+}
+
+/**
+ * @brief フォントアトラスのアルファ値をバイリニア補間で取り出す。
+ */
+static unsigned sample_alpha(const SoftTexture *tex, float u, float v)
+{
+    float tx = u * tex->width - 0.5f, ty = v * tex->height - 0.5f;
+    int ix = (int)floorf(tx), iy = (int)floorf(ty);
+    float fx = tx - ix, fy = ty - iy;
+    float a[4];
+    for (int k = 0; k < 4; k++)
+    {
+        int sx = ix + (k & 1), sy = iy + (k >> 1);
+        sx = sx < 0 ? 0 : (sx >= tex->width ? tex->width - 1 : sx);
+        sy = sy < 0 ? 0 : (sy >= tex->height ? tex->height - 1 : sy);
+        a[k] = tex->rgba[((size_t)sy * tex->width + sx) * 4 + 3];
+    }
+    float top = a[0] + (a[1] - a[0]) * fx;
+    float bottom = a[2] + (a[3] - a[2]) * fx;
+    return (unsigned)lroundf(top + (bottom - top) * fy);
+}
+
+static void raster_glyphs(SoftCanvas *canvas, const DrawCmd *cmd, const SoftTexture *tex)
+{
+    if (!tex || !tex->rgba)
+        return;
+    for (int i = 0; i < cmd->quad_count; i++)
+    {
+        const GlyphQuad *q = &cmd->quads[i];
+        float gx = cmd->rect.x + q->dst.x, gy = cmd->rect.y + q->dst.y;
+        int x0, y0, x1, y1;
+        if (!clip_bounds(canvas, gx, gy, gx + q->dst.width, gy + q->dst.height, &x0, &y0, &x1, &y1))
+            continue;
+        for (int y = y0; y < y1; y++)
+        {
+            float v = q->uv.y + (y + 0.5f - gy) / q->dst.height * q->uv.height;
+            for (int x = x0; x < x1; x++)
+            {
+                float u = q->uv.x + (x + 0.5f - gx) / q->dst.width * q->uv.width;
+                unsigned coverage = sample_alpha(tex, u, v);
+                if (coverage)
+                    blend_pixel(&canvas->rgba[((size_t)y * canvas->width + x) * 4], cmd->color, coverage);
+            }
+        }
+    }
+}
+
+/**
+ * @brief 描画命令列をRGBAバッファに描画する。
+ *        レイヤー合成の命令は、対応するレイヤーの命令列をその位置でそのまま描画する。
+ */
+void soft_raster_execute(SoftCanvas *canvas, const DrawList *list, const SoftTexture *glyphs,
+                         const DrawList *const *layers)
+{
+    for (int i = 0; i < list->count; i++)
+    {
+        const DrawCmd *cmd = &list->cmds[i];
+        switch (cmd->type)
+        {
+        case DRAW_CMD_CLEAR:
+            raster_clear(canvas, cmd->color);
+            break;
+        case DRAW_CMD_GRADIENT_H:
+            raster_gradient_h(canvas, cmd);
+            break;
+        case DRAW_CMD_RECT_ROUNDED:
+            raster_rect_rounded(canvas, cmd);
+            break;
+        case DRAW_CMD_LINE:
+            raster_line(canvas, cmd);
+            break;
+        case DRAW_CMD_CIRCLE:
+            raster_circle(canvas, cmd);
+            break;
+        case DRAW_CMD_GLYPHS:
+            raster_glyphs(canvas, cmd, glyphs);
+            break;
+        case DRAW_CMD_POLYLINE:
+            raster_polyline(canvas, cmd);
+            break;
+        case DRAW_CMD_TRIANGLES:
+            raster_triangles(canvas, cmd);
+            break;
+        case DRAW_CMD_LAYER:
+            if (layers && cmd->layer < DRAW_LIST_MAX_LAYERS && layers[cmd->layer])
+                soft_raster_execute(canvas, layers[cmd->layer], glyphs, NULL);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief RGBAバッファをPAM形式（RGB_ALPHA）で書き出す。画像比較用。
+ */
+bool soft_canvas_write_pam(const SoftCanvas *canvas, const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+        return false;
+    fprintf(fp, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n",
+            canvas->width, canvas->height);
+    size_t size = (size_t)canvas->width * canvas->height * 4;
+    bool ok = fwrite(canvas->rgba, 1, size, fp) == size;
+    return fclose(fp) == 0 && ok;
+}
+
+/**
+ * @brief soft_canvas_write_pam で書き出したPAM画像を読み込む。canvasは読み込んだ大きさで確保する。
+ */
+bool soft_canvas_read_pam(SoftCanvas *canvas, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return false;
+    int width = 0, height = 0, depth = 0, maxval = 0;
+    char line[64];
+    bool header = fgets(line, sizeof(line), fp) && strcmp(line, "P7\n") == 0;
+    while (header && fgets(line, sizeof(line), fp) && strcmp(line, "ENDHDR\n") != 0)
+    {
+        sscanf(line, "WIDTH %d", &width);
+        sscanf(line, "HEIGHT %d", &height);
+        sscanf(line, "DEPTH %d", &depth);
+        sscanf(line, "MAXVAL %d", &maxval);
+    }
+    bool ok = header && width > 0 && height > 0 && depth == 4 && maxval == 255 &&
+              soft_canvas_init(canvas, width, height);
+    if (ok)
+    {
+        size_t size = (size_t)width * height * 4;
+        ok = fread(canvas->rgba, 1, size, fp) == size;
+        if (!ok)
+            soft_canvas_free(canvas);
+    }
+    fclose(fp);
+    return ok;
+}
+
+/**
+ * @brief tile x tile 画素ごとの平均値を1画素にした縮小画像を作る。dstは縮小後の大きさで確保する。
+ *        端の区画は画面内の画素だけで平均する。
+ */
+bool soft_canvas_downsample(const SoftCanvas *src, int tile, SoftCanvas *dst)
+{
+    if (!soft_canvas_init(dst, (src->width + tile - 1) / tile, (src->height + tile - 1) / tile))
+        return false;
+    for (int ty = 0; ty < dst->height; ty++)
+    {
+        for (int tx = 0; tx < dst->width; tx++)
+        {
+            unsigned sum[4] = {0}, n = 0;
+            for (int y = ty * tile; y < (ty + 1) * tile && y < src->height; y++)
+            {
+                for (int x = tx * tile; x < (tx + 1) * tile && x < src->width; x++, n++)
+                {
+                    const uint8_t *p = &src->rgba[((size_t)y * src->width + x) * 4];
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += p[c];
+                }
+            }
+            uint8_t *q = &dst->rgba[((size_t)ty * dst->width + tx) * 4];
+            for (int c = 0; c < 4; c++)
+                q[c] = (sum[c] + n / 2) / n;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef SOFT_RASTER_H
+#define SOFT_RASTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "draw_list.h"
+
+// 描画先のRGBAバッファ（ストレートアルファ）
+typedef struct
+{
+    int width, height;
+    uint8_t *rgba;
+} SoftCanvas;
+
+// 文字描画に使うフォントアトラスのRGBA画像
+typedef struct
+{
+    int width, height;
+    const uint8_t *rgba;
+} SoftTexture;
+
+bool soft_canvas_init(SoftCanvas *canvas, int width, int height);
+void soft_canvas_free(SoftCanvas *canvas);
+void soft_raster_execute(SoftCanvas *canvas, const DrawList *list, const SoftTexture *glyphs,
+                         const DrawList *const *layers);
+bool soft_canvas_write_pam(const SoftCanvas *canvas, const char *path);
+bool soft_canvas_read_pam(SoftCanvas *canvas, const char *path);
+bool soft_canvas_downsample(const SoftCanvas *src, int tile, SoftCanvas *dst);
+
+#endif
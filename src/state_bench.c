@@ -0,0 +1,403 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "edge_queue.h"
+#include "health.h"
+#include "motion.h"
+#include "state_engine.h"
+#include "triple_buffer.h"
+
+// 状態管理処理のマイクロベンチマーク
+// 画面なしで状態更新のtickあたりの時間、スレッド間の受け渡し遅延、描画用状態のコピー時間を計測し、
+// 結果を1行1件のJSONで標準出力に書き出す。
+
+#define BATCH 1024 // 1回の時間計測でまとめて実行する回数
+#define BENCH_FRAME_NS 16896002.0 // tickの時刻とフレームカウントに使う周期（MVS）
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief 計測値を並べ替えて統計値を1行のJSONで出力する。
+ */
+static void report(const char *name, const char *unit, double *samples, size_t n, const char *extra)
+{
+    double sum = 0;
+    for (size_t i = 0; i < n; i++)
+        sum += samples[i];
+    qsort(samples, n, sizeof(double), compare_double);
+    printf("{\"name\":\"%s\",\"unit\":\"%s\",\"samples\":%zu,\"mean\":%.3f,\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f%s%s}\n",
+           name, unit, n, sum / n, samples[(n - 1) * 50 / 100], samples[(n - 1) * 99 / 100], samples[n - 1],
+           extra ? "," : "", extra ? extra : "");
+    fflush(stdout);
+}
+
+static uint32_t lcg_state = 12345;
+
+static inline uint32_t lcg(void)
+{
+    lcg_state = lcg_state * 1664525u + 1013904223u;
+    return lcg_state >> 8;
+}
+
+#define MAX_TICK_EDGES (INPUT_MAX_PLAYERS * 2 + 2) // 1tickのエッジ数の上限
+
+/**
+ * @brief 1tickで届くエッジ列を作る。2人ごとに平均して数tickに1回の入力変化と、まれにDELキーを含む。
+ */
+static int make_tick_edges(InputEdge *edges, uint16_t *words, int players)
+{
+    int n = 0;
+    for (int pair = 0; pair < players; pair += 2)
+    {
+        uint32_t r = lcg();
+        int count = (r & 3) == 0 ? (int)(r >> 2) % 4 : 0;
+        for (int i = 0; i < count; i++)
+        {
+            int player = pair + (players - pair > 1 ? lcg() & 1 : 0);
+            words[player] ^= 1u << (lcg() % 10);
+            edges[n++] = (InputEdge){.word = words[player], .player = player};
+        }
+    }
+    if (lcg() % 4096 == 0)
+    {
+        edges[n++] = (InputEdge){.word = INPUT_SYS_DELETE, .player = INPUT_PLAYER_SYSTEM};
+        edges[n++] = (InputEdge){.word = 0, .player = INPUT_PLAYER_SYSTEM};
+    }
+    return n;
+}
+
+/**
+ * @brief 状態更新1tickあたりの時間。入力変化がない場合と、合成した入力列をSOCDの方式ごとやプレイヤー数ごとに計る。
+ */
+static void bench_state_tick(int batches, bool with_edges, SocdPolicy policy, int players, const char *name)
+{
+    static StateContext st;
+    static InputEdge edges[BATCH][MAX_TICK_EDGES];
+    static int counts[BATCH];
+    static uint64_t tick_ns[BATCH];
+    uint16_t words[INPUT_MAX_PLAYERS] = {0};
+    double *samples = malloc(batches * sizeof(double));
+    uint64_t tick = 1;
+
+    state_context_init(&st, policy, players, BENCH_FRAME_NS, BENCH_FRAME_NS);
+    for (int b = 0; b < batches; b++)
+    {
+        for (int i = 0; i < BATCH; i++, tick++)
+        {
+            // 実際のtickと同じく、エッジはtickの時刻より前に届いたものとする
+            tick_ns[i] = (uint64_t)(tick * BENCH_FRAME_NS);
+            counts[i] = with_edges ? make_tick_edges(edges[i], words, players) : 0;
+            for (int k = 0; k < counts[i]; k++)
+                edges[i][k].time_ns = tick_ns[i] - (counts[i] - k);
+        }
+        uint64_t t0 = now_ns();
+        for (int i = 0; i < BATCH; i++)
+            state_context_tick(&st, edges[i], counts[i], tick_ns[i]);
+        samples[b] = (double)(now_ns() - t0) / BATCH;
+    }
+    char extra[64];
+    snprintf(extra, sizeof(extra), "\"players\":%d", players);
+    report(name, "ns_per_tick", samples, batches, extra);
+    free(samples);
+}
+
+/**
+ * @brief 描画スレッドへ渡す状態のコピー時間。
+ *        copied_bytes は実際に書き込む量で、高解像度軌跡は残っている点の分しか写さないため点のない状態の値。
+ */
+static void bench_snapshot_copy(int batches)
+{
+    static StateContext st;
+    static DrawableSet sets[3];
+    double *samples = malloc(batches * sizeof(double));
+
+    state_context_init(&st, SOCD_CANCEL, INPUT_DEFAULT_PLAYERS, BENCH_FRAME_NS, BENCH_FRAME_NS);
+    for (int b = 0; b < batches; b++)
+    {
+        uint64_t t0 = now_ns();
+        for (int i = 0; i < BATCH; i++)
+            state_context_publish(&st, &sets[i % 3]);
+        samples[b] = (double)(now_ns() - t0) / BATCH;
+    }
+    char extra[64];
+    snprintf(extra, sizeof(extra), "\"bytes\":%zu,\"copied_bytes\":%zu", sizeof(DrawableSet),
+             offsetof(DrawableSet, players) + INPUT_DEFAULT_PLAYERS * offsetof(PlayerDrawable, trail));
+    report("snapshot_copy", "ns_per_copy", samples, batches, extra);
+    free(samples);
+}
+
+/**
+ * @brief 稼働状況カウンタの更新（1tick分）と書き出し（1回分）の時間。
+ *        書き出し間隔あたりの合計からCPU使用率の見積もりを出す。
+ */
+static void bench_health(int batches)
+{
+    static HealthCounters counters;
+    static char text[HEALTH_TEXT_MAX];
+    double *samples = malloc(batches * sizeof(double));
+
+    for (int b = 0; b < batches; b++)
+    {
+        uint64_t t0 = now_ns();
+        for (int i = 0; i < BATCH; i++)
+        {
+            // run_state_tick と描画ループで更新する分
+            health_add(&counters.edges, i & 3);
+            health_set(&counters.log_resets, b);
+            health_set(&counters.published_ns, t0);
+            health_add(&counters.frames, 1);
+            health_set(&counters.repeated_states, i);
+            health_set(&counters.skipped_states, b);
+        }
+        samples[b] = (double)(now_ns() - t0) / BATCH;
+    }
+    double update_ns = 0;
+    for (int b = 0; b < batches; b++)
+        update_ns += samples[b] / batches;
+    report("health_update", "ns_per_tick", samples, batches, NULL);
+
+    HealthSnapshot snap = {.uptime_ns = 123456789012ULL, .ticks = 7304, .edges = 912, .frames = 7300};
+    size_t len = 0;
+    for (int b = 0; b < batches; b++)
+    {
+        uint64_t t0 = now_ns();
+        for (int i = 0; i < BATCH / 16; i++)
+        {
+            snap.ticks++;
+            len = health_format(&snap, text, sizeof(text));
+        }
+        samples[b] = (double)(now_ns() - t0) / (BATCH / 16);
+    }
+    double format_ns = 0;
+    for (int b = 0; b < batches; b++)
+        format_ns += samples[b] / batches;
+    // 60Hzのtickと描画で毎回更新し、既定の間隔で書き出したときの1秒あたりのCPU時間
+    double cpu_percent = (update_ns * 60 + format_ns * 1000.0 / HEALTH_DEFAULT_INTERVAL_MS) / 1e9 * 100;
+    char extra[96];
+    snprintf(extra, sizeof(extra), "\"bytes\":%zu,\"cpu_percent\":%.6f", len, cpu_percent);
+    report("health_format", "ns_per_format", samples, batches, extra);
+    free(samples);
+}
+
+/**
+ * @brief コマンド認識の方向の変化1回あたりの時間。
+ *        既定の定義と、それに無作為な定義を足して上限近くまで増やしたものを比べ、定義の数によらないことを確かめる。
+ *        足す定義のラベルはフォントアトラスにある数字だけで作る。定義を読めなければ偽を返す。
+ */
+static bool bench_motion_feed(int batches, bool fill, const char *name)
+{
+    static MotionTable table;
+    static char text[16384];
+    int len = snprintf(text, sizeof(text), "%s", motion_default_definitions);
+    if (!motion_table_load(&table, text, name, BENCH_FRAME_NS))
+        return false;
+    for (int m = table.motion_count; fill && m < MOTION_MAX; m++)
+    {
+        char pattern[8];
+        int n = 3 + lcg() % 4;
+        for (int i = 0; i < n; i++)
+            pattern[i] = '1' + lcg() % 9;
+        pattern[n] = '\0';
+        len += snprintf(text + len, sizeof(text) - len, "extra%d %d 20 %s\n", m, m, pattern);
+    }
+    if (!motion_table_load(&table, text, name, BENCH_FRAME_NS))
+        return false;
+
+    static MotionTracker tracker;
+    static const uint8_t dirs[] = {0x2, 0xA, 0x8, 0x0, 0x8, 0x2, 0xA, 0x0, 0x4, 0x6, 0x2, 0x9, 0x1, 0x5}; // 回転と往復
+    double *samples = malloc(batches * sizeof(double));
+    uint64_t t = 0;
+    unsigned matched = 0;
+    motion_tracker_reset(&tracker);
+    for (int b = 0; b < batches; b++)
+    {
+        uint64_t t0 = now_ns();
+        for (int i = 0; i < BATCH; i++)
+        {
+            t += 30000000ULL;
+            matched += motion_tracker_feed(&tracker, &table, dirs[i % sizeof(dirs)], t) != 0;
+        }
+        samples[b] = (double)(now_ns() - t0) / BATCH;
+    }
+    char extra[128];
+    snprintf(extra, sizeof(extra), "\"motions\":%d,\"patterns\":%d,\"states\":%d,\"matched\":%u", table.motion_count,
+             table.pattern_count, table.state_count, matched);
+    report(name, "ns_per_change", samples, batches, extra);
+    free(samples);
+    return true;
+}
+
+// スレッド間受け渡しの計測用
+// 生産側は一定間隔で眠り、消費側は空なら他のスレッドに譲りながら取り出し続ける。
+// 1コアの環境でも生産側が動けるようにするため。
+static EdgeQueue bench_queue;
+static atomic_bool producer_done;
+static const struct timespec pace = {.tv_sec = 0, .tv_nsec = 20000}; // 20us
+
+static void *edge_producer(void *arg)
+{
+    int count = *(int *)arg;
+    for (int i = 0; i < count; i++)
+    {
+        // 入力検知スレッドと同じく眠ってから積む
+        nanosleep(&pace, NULL);
+        InputEdge e = {.time_ns = now_ns(), .word = i & 0x3FF, .player = i & 1};
+        while (!edge_queue_push(&bench_queue, &e))
+            ;
+    }
+    atomic_store(&producer_done, true);
+    return NULL;
+}
+
+/**
+ * @brief エッジキューで入力検知スレッドから状態管理スレッドへ渡すまでの遅延。
+ */
+static void bench_edge_handoff(int count)
+{
+    double *samples = malloc(count * sizeof(double));
+    pthread_t tid;
+    atomic_store(&producer_done, false);
+    pthread_create(&tid, NULL, edge_producer, &count);
+
+    int n = 0;
+    InputEdge e;
+    while (n < count)
+    {
+        if (edge_queue_pop(&bench_queue, &e))
+            samples[n++] = (double)(now_ns() - e.time_ns);
+        else if (atomic_load(&producer_done))
+            break;
+        else
+            sched_yield();
+    }
+    pthread_join(tid, NULL);
+    report("edge_queue_handoff", "ns", samples, n, NULL);
+    free(samples);
+}
+
+// トリプルバッファの計測用
+// 書き込み側はログと継続時間の全体を公開ごとの通し番号から作った値で埋め、読み出し側で1つでも通し番号と合わなければ
+// 書き込み途中の状態を読んだとみなす。
+typedef struct
+{
+    DrawableSet set;
+    uint64_t publish_ns;
+} BenchSnapshot;
+
+static BenchSnapshot snapshots[3];
+static TripleBuffer bench_buffer;
+
+static void *snapshot_writer(void *arg)
+{
+    int count = *(int *)arg;
+    for (int i = 1; i <= count; i++)
+    {
+        nanosleep(&pace, NULL);
+        BenchSnapshot *s = &snapshots[triple_buffer_write_index(&bench_buffer)];
+        for (int p = 0; p < INPUT_DEFAULT_PLAYERS; p++)
+            for (int k = 0; k < MAX_LOG; k++)
+            {
+                s->set.players[p].log[k] = (LogState){.dir_index = i & 0xF, .btn_index = (i >> 4) & 0xF, .used = 1};
+                s->set.players[p].tenths[k] = (uint16_t)i;
+            }
+        s->set.tick = i;
+        s->publish_ns = now_ns();
+        triple_buffer_publish(&bench_buffer);
+    }
+    atomic_store(&producer_done, true);
+    return NULL;
+}
+
+/**
+ * @brief トリプルバッファで状態を公開してから描画スレッドが受け取るまでの遅延と、不整合な読み出しの有無。
+ */
+static void bench_snapshot_handoff(int count)
+{
+    double *samples = malloc(count * sizeof(double));
+    pthread_t tid;
+    unsigned long torn = 0;
+    int n = 0;
+
+    memset(snapshots, 0, sizeof(snapshots));
+    triple_buffer_init(&bench_buffer);
+    atomic_store(&producer_done, false);
+    pthread_create(&tid, NULL, snapshot_writer, &count);
+
+    while (n < count && !atomic_load(&producer_done))
+    {
+        bool updated;
+        const BenchSnapshot *s = &snapshots[triple_buffer_read_index(&bench_buffer, &updated)];
+        if (!updated)
+        {
+            sched_yield();
+            continue;
+        }
+        samples[n++] = (double)(now_ns() - s->publish_ns);
+        // すべての項目を公開ごとの通し番号（tick）と比べる
+        uint64_t seq = s->set.tick;
+        bool complete = true;
+        for (int p = 0; p < INPUT_DEFAULT_PLAYERS && complete; p++)
+            for (int k = 0; k < MAX_LOG && complete; k++)
+            {
+                const LogState *log = &s->set.players[p].log[k];
+                complete = s->set.players[p].tenths[k] == (uint16_t)seq && log->dir_index == (seq & 0xF) &&
+                           log->btn_index == ((seq >> 4) & 0xF) && log->used;
+            }
+        if (!complete)
+            torn++;
+    }
+    pthread_join(tid, NULL);
+    char extra[64];
+    snprintf(extra, sizeof(extra), "\"torn\":%lu", torn);
+    report("snapshot_handoff", "ns", samples, n, extra);
+    free(samples);
+}
+
+int main(int argc, char **argv)
+{
+    int batches = 2000;
+    int handoffs = 100000;
+    if (argc > 1 && strcmp(argv[1], "--quick") == 0)
+    {
+        batches = 100;
+        handoffs = 5000;
+    }
+    else if (argc > 1)
+    {
+        fprintf(stderr, "usage: %s [--quick]\n", argv[0]);
+        return 1;
+    }
+
+    bench_state_tick(batches, false, SOCD_CANCEL, INPUT_DEFAULT_PLAYERS, "state_tick_idle");
+    bench_state_tick(batches, true, SOCD_CANCEL, INPUT_DEFAULT_PLAYERS, "state_tick_edges");
+    bench_state_tick(batches, true, SOCD_LAST_WIN, INPUT_DEFAULT_PLAYERS, "state_tick_edges_socd_last");
+    bench_state_tick(batches, true, SOCD_UP_PRIORITY, INPUT_DEFAULT_PLAYERS, "state_tick_edges_socd_up");
+    // プレイヤー数に対して線形に増えることを確認する
+    for (int players = 1; players <= INPUT_MAX_PLAYERS; players *= 2)
+        bench_state_tick(batches, true, SOCD_CANCEL, players, "state_tick_players");
+    bench_snapshot_copy(batches);
+    bench_health(batches);
+    bool motions_loaded = bench_motion_feed(batches, false, "motion_feed_default");
+    motions_loaded = bench_motion_feed(batches, true, "motion_feed_max") && motions_loaded;
+    bench_edge_handoff(handoffs);
+    bench_snapshot_handoff(handoffs);
+    return motions_loaded ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "motion.h"
+#include "state_engine.h"
+
+// 状態管理の処理の回帰確認用プログラム
+// 決まった乱数列から作った入力（2プレイヤーのレバーとボタン、DEL、スクロール、無操作リセットを起こす長い空白）を
+// tickごとに状態管理の処理に通し、毎tick公開した描画用状態のハッシュ値を求める。
+// ハッシュ値には表示する各行の状態とフレームカウント、終了した行の継続時間、軌跡、描画可否、履歴の件数、
+// スクロール量を含める。既定の長さでは、ログと軌跡を詰めて持つ前の処理で求めた値（STATE_CHECK_HASH）と比べ、
+// 表示に出る内容が変わっていないことを確かめる。
+
+#define CHECK_TICK_NS 16896002.0                 // MVSのtick周期
+#define CHECK_DEFAULT_TICKS 200000
+#define STATE_CHECK_HASH 0xfbed0fb20a6eb04fULL   // 既定の長さでのハッシュ値
+
+static inline uint64_t fnv(uint64_t hash, uint64_t value)
+{
+    return (hash ^ value) * 0x100000001b3ULL;
+}
+
+// 入力列を作る乱数（xorshift64）
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static inline uint32_t rng(uint32_t n)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 32) % n;
+}
+
+/**
+ * @brief 1tick分の入力を作る。ほとんどのtickは入力なしで、ときどき数個のエッジが届く。
+ *        まれに無操作リセットより長い空白を置く。
+ */
+static int make_edges(InputEdge *edges, uint16_t *words, uint64_t tick, uint64_t *quiet_until)
+{
+    if (tick < *quiet_until)
+        return 0;
+    if (rng(20000) == 0)
+    {
+        *quiet_until = tick + RESET_FRAME_COUNT + 1 + rng(600);
+        return 0;
+    }
+    uint64_t base_ns = (uint64_t)((tick - 1) * CHECK_TICK_NS);
+    int n = 0;
+    int changes = rng(4) == 0 ? 1 + rng(3) : 0;
+    for (int i = 0; i < changes; i++)
+    {
+        int p = rng(2);
+        uint16_t bit = 1u << rng(8); // 上下左右とABCD
+        words[p] ^= bit;
+        edges[n++] = (InputEdge){.time_ns = base_ns + rng((uint32_t)CHECK_TICK_NS), .word = words[p], .player = p};
+    }
+    uint32_t r = rng(1000);
+    uint16_t system = r == 0 ? INPUT_SYS_DELETE : r < 4 ? INPUT_SYS_SCROLL_BACK : r < 7 ? INPUT_SYS_SCROLL_FORWARD : 0;
+    if (system)
+    {
+        uint64_t t = base_ns + rng((uint32_t)CHECK_TICK_NS);
+        edges[n++] = (InputEdge){.time_ns = t, .word = system, .player = INPUT_PLAYER_SYSTEM};
+        edges[n++] = (InputEdge){.time_ns = t + 1, .word = 0, .player = INPUT_PLAYER_SYSTEM};
+    }
+    // 同じtickのエッジは時刻順に渡す
+    for (int i = 1; i < n; i++)
+        for (int j = i; j > 0 && edges[j].time_ns < edges[j - 1].time_ns; j--)
+        {
+            InputEdge e = edges[j];
+            edges[j] = edges[j - 1];
+            edges[j - 1] = e;
+        }
+    return n;
+}
+
+/**
+ * @brief 公開した描画用状態のうち表示に出る内容をハッシュ値に畳み込む。
+ */
+static uint64_t hash_drawable(uint64_t hash, const DrawableSet *set)
+{
+    for (int p = 0; p < set->player_count; p++)
+    {
+        const PlayerDrawable *pd = &set->players[p];
+        hash = fnv(hash, pd->drawable | (uint64_t)pd->history << 8);
+        for (int k = 0; k < MAX_TRAJECTORY; k++)
+            hash = fnv(hash, traj_at(pd->traj, k));
+        for (int k = 0; k < MAX_LOG; k++)
+        {
+            const LogState *s = &pd->log[k];
+            unsigned count = s->used ? log_count_from_tenths(pd->tenths[k]) : 0;
+            uint32_t ended = k > 0 ? pd->tenths[k] : 0;
+            hash = fnv(hash, s->used | s->dir_index << 1 | s->btn_index << 5 | s->motion << 9 | (uint64_t)count << 16 |
+                                 (uint64_t)ended << 32);
+        }
+    }
+    return fnv(hash, set->scroll);
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --ticks N    number of ticks to replay (default: %d, compared with the expected hash)\n",
+            prog, CHECK_DEFAULT_TICKS);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"ticks", required_argument, NULL, 't'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    unsigned long ticks = CHECK_DEFAULT_TICKS;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            ticks = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            print_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (ticks == 0)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    static MotionTable table;
+    static StateContext st;
+    static DrawableSet set;
+    if (!motion_table_load(&table, motion_default_definitions, "default motions", CHECK_TICK_NS))
+        return 1;
+    state_context_init(&st, SOCD_LAST_WIN, INPUT_DEFAULT_PLAYERS, CHECK_TICK_NS, CHECK_TICK_NS);
+    st.motions = &table;
+
+    InputEdge edges[8];
+    uint16_t words[INPUT_DEFAULT_PLAYERS] = {0};
+    uint64_t quiet_until = 0, hash = 0xcbf29ce484222325ULL;
+    unsigned long edge_count = 0;
+    for (uint64_t tick = 0; tick < ticks; tick++)
+    {
+        int n = tick ? make_edges(edges, words, tick, &quiet_until) : 0;
+        edge_count += n;
+        state_context_tick(&st, edges, n, (uint64_t)(tick * CHECK_TICK_NS));
+        state_context_publish(&st, &set);
+        hash = hash_drawable(hash, &set);
+    }
+
+    printf("[info] %lu ticks, %lu edges, %lu log resets, state hash %016llx\n", ticks, edge_count, st.log_resets,
+           (unsigned long long)hash);
+    if (ticks != CHECK_DEFAULT_TICKS)
+        return 0;
+    if (hash != STATE_CHECK_HASH)
+    {
+        printf("[error] expected state hash %016llx: the published state changed\n", (unsigned long long)STATE_CHECK_HASH);
+        return 1;
+    }
+    printf("[info] state hash matches\n");
+    return 0;
+}
@@ -0,0 +1,311 @@
+#include "state_engine.h"
+
+#include <string.h>
+
+/**
+ * @brief 直前の入力データと比較して異なればログを追加し、真値を返す。
+ *        直前のログのフレームカウントは追加したログの開始時刻との差で決まる。
+ *        ログはリングバッファなので、追加しても既存のログは動かさない。
+ *        LogRing *log : 更新対象のプレイヤーのログ
+ *        const LogState *new_log : 新しい入力データ
+ *        uint64_t time_ns : 新しい入力の時刻
+ *        // 呼び出し例（state_context_tick内）
+ *        update_log(&ps->log, &edge_log, e->time_ns);
+ */
+bool update_log(LogRing *log, const LogState *new_log, uint64_t time_ns)
+{
+    if (is_equal_state(new_log, log_ring_top(log)))
+        return false;
+
+    // 同じtickでリセットした後のエッジは、リセットより前の時刻でも継続時間が負にならないようにする
+    uint64_t top_start = log_ring_top_start(log);
+    if (time_ns < top_start)
+        time_ns = top_start;
+    log_ring_push(log, new_log, time_ns);
+    return true;
+}
+
+/**
+ * @brief 高解像度軌跡にレバー位置を追加する。位置が変わらなければ何もしない。
+ *        直前の点から TRAIL_MERGE_NS 以内の変化は直前の点を置き換え、元の位置に戻ったときは直前の点を取り消す。
+ *        斜め入力の2つのキーのずれのような一瞬の中間位置を線分にしないための間引き。
+ */
+void trail_ring_add(TrailRing *trail, uint8_t dir, uint64_t time_ns)
+{
+    if (trail->count > 0)
+    {
+        TrailPoint *top = &trail->points[(trail->count - 1) & (TRAIL_POINTS - 1)];
+        if (top->dir == dir)
+            return;
+        if (time_ns < top->time_ns) // 同じtickでリセットした後のエッジ
+            time_ns = top->time_ns;
+        if (trail->count > 1 && time_ns - top->time_ns < TRAIL_MERGE_NS)
+        {
+            const TrailPoint *prev = &trail->points[(trail->count - 2) & (TRAIL_POINTS - 1)];
+            if (prev->dir == dir)
+                trail->count--;
+            else
+                top->dir = dir;
+            return;
+        }
+    }
+    trail->points[trail->count & (TRAIL_POINTS - 1)] = (TrailPoint){time_ns, dir};
+    trail->count++;
+}
+
+/**
+ * @brief 高解像度軌跡を新しい順に切り出す。位置を離れてから TRAIL_FADE_NS 以上経った点は渡さない。
+ */
+static inline int copy_trail(TrailPoint *dest, const TrailRing *trail, uint64_t now_ns)
+{
+    uint32_t available = trail->count < TRAIL_POINTS ? trail->count : TRAIL_POINTS;
+    uint64_t left_ns = now_ns; // その点の位置を離れた時刻。最新の点はまだ離れていない
+    int n = 0;
+    for (uint32_t k = 0; k < available; k++)
+    {
+        if (now_ns > left_ns && now_ns - left_ns >= TRAIL_FADE_NS)
+            break;
+        dest[n] = trail->points[(trail->count - 1 - k) & (TRAIL_POINTS - 1)];
+        left_ns = dest[n++].time_ns;
+    }
+    return n;
+}
+
+/**
+ * @brief 描画スレッドへの値引き渡し関数です。
+ *        軌跡は新しい順に、入力ログは表示する MAX_LOG 行だけを新しい順に切り出して渡す。
+ *        scroll が0なら最後のリセット以降のログ、0より大きければリセット前も含めて scroll 行遡った位置から渡す。
+ */
+static inline void copy_drawable_set(PlayerDrawable *dest, const PlayerState *src, const StateContext *st)
+{
+    uint32_t scroll = st->scroll;
+    dest->traj = src->trajectory; // 軌跡
+    dest->trail_count = copy_trail(dest->trail, &src->trail, st->now_ns);
+
+    const LogRing *log = &src->log;
+    uint32_t available = log_ring_available(log);
+    uint32_t rows = log->count - log->base; // 通常表示で見せる件数
+    uint32_t offset = 0;
+    if (scroll > 0)
+    {
+        rows = available;
+        offset = available > MAX_LOG ? available - MAX_LOG : 0;
+        if (scroll < offset)
+            offset = scroll;
+    }
+    if (rows > available)
+        rows = available;
+    for (uint32_t k = 0; k < MAX_LOG; k++) // 入力ログと終了したログの継続時間
+    {
+        uint32_t back = offset + k;
+        uint32_t i = (log->count - 1 - back) & LOG_HISTORY_MASK;
+        dest->log[k] = back < rows ? log->entries[i] : (LogState){0};
+        dest->tenths[k] = back < rows && back > 0
+                              ? log_duration_tenths(log->start_ns[(i + 1) & LOG_HISTORY_MASK] - log->start_ns[i], st->frame_ns)
+                              : 0;
+    }
+
+    // 継続中の最新ログは公開時点の継続時間を入れておく。描画側は開始時刻から求め直す
+    dest->top_open = offset == 0;
+    dest->top_start_ns = log_ring_top_start(log);
+    if (dest->top_open && dest->log[0].used)
+    {
+        uint64_t elapsed = st->now_ns > dest->top_start_ns ? st->now_ns - dest->top_start_ns : 0;
+        dest->tenths[0] = log_duration_tenths(elapsed, st->frame_ns);
+    }
+    dest->drawable = src->visible || scroll > 0; // 描画可否を渡す
+    dest->log_gen = src->log_gen;
+    dest->history = available;
+    dest->word = src->word;
+}
+
+/**
+ * @brief ログを初期状態にする。履歴は残し、通常表示の起点をニュートラルの1件に移す。
+ *        直前のログのフレームカウントはリセットした時刻までになる。
+ */
+static void reset_log(LogRing *log, uint64_t now_ns)
+{
+    log_ring_push(log, &(LogState){.used = 1}, now_ns);
+    log->base = log->count - 1;
+}
+
+/**
+ * @brief 状態を初期化する。tick_nsはtick周期で無操作リセットまでの時間に、frame_nsはフレームカウントの1フレームの長さに使う。
+ *        表示の単位（--count-unit）を変えてもリセットまでの時間は変わらない。
+ */
+void state_context_init(StateContext *st, SocdPolicy socd_policy, int player_count, double tick_ns, double frame_ns)
+{
+    memset(st, 0, sizeof(*st));
+    st->player_count = player_count;
+    st->socd_policy = socd_policy;
+    st->frame_ns = frame_ns;
+    st->idle_ns = (uint64_t)(RESET_FRAME_COUNT * tick_ns);
+    for (int p = 0; p < INPUT_MAX_PLAYERS; p++)
+    {
+        LogRing *log = &st->players[p].log;
+        log_ring_push(log, &(LogState){.used = 1}, 0);
+        log->base = 0;
+    }
+}
+
+/**
+ * @brief 追加したログのレバー状態をコマンドの認識に渡し、完成したコマンドをそのログに記録する。
+ *        向きが変わったときだけ遷移するため、ボタンだけの変化では何もしない。
+ */
+static inline void tag_motion(const StateContext *st, PlayerState *ps, uint64_t time_ns)
+{
+    if (!st->motions)
+        return;
+    LogState *top = log_ring_top(&ps->log);
+    top->motion = motion_tracker_feed(&ps->motion, st->motions, top->dir_index, time_ns);
+}
+
+/**
+ * @brief スクロールで遡れる最大の行数を返す。履歴の最も多いプレイヤーにあわせる。
+ */
+static uint32_t max_scroll(const StateContext *st)
+{
+    uint32_t a = 0;
+    for (int p = 0; p < st->player_count; p++)
+    {
+        uint32_t n = log_ring_available(&st->players[p].log);
+        if (n > a)
+            a = n;
+    }
+    return a > MAX_LOG ? a - MAX_LOG : 0;
+}
+
+/**
+ * @brief プレイヤーの入力ワードのレバー状態をSOCDの方式で解決してログ状態にする。
+ *        後押し優先のために直前の状態を更新するので、エッジの順に呼ぶ。
+ */
+static inline LogState resolve_log_state(const StateContext *st, PlayerState *ps, uint16_t word)
+{
+    uint8_t raw = word & INPUT_DIR_MASK;
+    uint8_t dir = socd_resolve(st->socd_policy, ps->raw_dir, raw, ps->resolved_dir);
+    ps->raw_dir = raw;
+    ps->resolved_dir = dir;
+    return log_state_from_word(word, dir);
+}
+
+/**
+ * @brief 1tick分の状態を進める。edgesはtick間に届いたエッジ（システム用のエッジを含む）。
+ *        tick間に届いたエッジはすべてログに畳み込むため、tick内で押して離した入力も失われない。
+ *        ログの開始時刻はエッジの時刻を使い、now_nsはこのtickの時刻とする。
+ *        フレームカウントは時刻から求めるため、tickが遅れてもずれず、入力がなければログには触れない。
+ */
+void state_context_tick(StateContext *st, const InputEdge *edges, int edge_count, uint64_t now_ns)
+{
+    st->now_ns = now_ns;
+    if (st->tick == 0) // 初期状態のログは最初のtickから始まったものとする
+        for (int p = 0; p < INPUT_MAX_PLAYERS; p++)
+            st->players[p].log.start_ns[0] = now_ns;
+    const uint16_t debug_combo = INPUT_BIT_START | INPUT_BIT_SELECT;
+
+    // DELキー、スクロール、デバッグ切り替えはエッジごとに立ち上がりを見て、短い押下も拾う
+    bool delkey = false;
+    uint32_t scroll = st->scroll;
+    for (int i = 0; i < edge_count; i++)
+    {
+        const InputEdge *e = &edges[i];
+        if (e->player == INPUT_PLAYER_SYSTEM)
+        {
+            uint16_t pressed = e->word & ~st->system_word;
+            delkey |= (pressed & INPUT_SYS_DELETE) != 0;
+            if (pressed & INPUT_SYS_SCROLL_BACK)
+                scroll += LOG_SCROLL_PAGE;
+            if (pressed & INPUT_SYS_SCROLL_FORWARD)
+                scroll = scroll > LOG_SCROLL_PAGE ? scroll - LOG_SCROLL_PAGE : 0;
+            st->system_word = e->word;
+            continue;
+        }
+        if (e->player >= st->player_count)
+            continue;
+        st->players[e->player].word = e->word;
+        uint32_t bit = 1u << e->player;
+        st->debug_combo_players = (e->word & debug_combo) == debug_combo ? st->debug_combo_players | bit
+                                                                          : st->debug_combo_players & ~bit;
+        debug_toggle_update(&st->debug, st->debug_combo_players != 0);
+    }
+
+    // trajectoryとログ、DELによるリセット処理をここで統合
+
+    // DELキーもしくはニュートラルのまま一定時間経ったら状態初期化
+    for (int p = 0; p < st->player_count; p++)
+    {
+        PlayerState *ps = &st->players[p];
+        bool idle = ps->visible && is_neutral(log_ring_top(&ps->log)) &&
+                    now_ns - log_ring_top_start(&ps->log) >= st->idle_ns;
+        if (delkey || idle)
+        {
+            ps->trajectory = 0;
+            ps->trail.count = 0;
+            motion_tracker_reset(&ps->motion);
+            reset_log(&ps->log, now_ns);
+            st->log_resets++;
+            ps->visible = delkey;
+            ps->log_gen++;
+        }
+    }
+
+    // tick間の変化をすべてログに追加
+    // レバー状態はエッジの順にSOCDの方式で解決する
+    uint32_t folded = 0;
+    for (int i = 0; i < edge_count; i++)
+    {
+        const InputEdge *e = &edges[i];
+        if (e->player >= st->player_count)
+            continue;
+        PlayerState *ps = &st->players[e->player];
+        LogState edge_log = resolve_log_state(st, ps, e->word);
+        trail_ring_add(&ps->trail, edge_log.dir_index, e->time_ns);
+        if (!update_log(&ps->log, &edge_log, e->time_ns))
+            continue;
+        tag_motion(st, ps, e->time_ns);
+        folded |= 1u << e->player;
+        ps->visible = true;
+        ps->log_gen++;
+    }
+
+    // レバー軌跡更新と、リセット直後から押し続けている入力のログ追加
+    for (int p = 0; p < st->player_count; p++)
+    {
+        PlayerState *ps = &st->players[p];
+        LogState new_log = log_state_from_word(ps->word, ps->resolved_dir);
+        ps->trajectory = traj_push(ps->trajectory, new_log.dir_index);
+        trail_ring_add(&ps->trail, new_log.dir_index, now_ns);
+        if (!(folded & (1u << p)) && update_log(&ps->log, &new_log, now_ns))
+        {
+            tag_motion(st, ps, now_ns);
+            ps->visible = true;
+            ps->log_gen++;
+        }
+    }
+
+    // 新しい入力かDELで通常表示に戻る
+    if (delkey || folded)
+        scroll = 0;
+    uint32_t limit = max_scroll(st);
+    if (scroll > limit)
+        scroll = limit;
+    if (scroll != st->scroll)
+    {
+        st->scroll = scroll;
+        for (int p = 0; p < st->player_count; p++)
+            st->players[p].log_gen++;
+    }
+}
+
+/**
+ * @brief 描画スレッドへ渡す状態を書き込む。
+ */
+void state_context_publish(StateContext *st, DrawableSet *set)
+{
+    for (int p = 0; p < st->player_count; p++)
+        copy_drawable_set(&set->players[p], &st->players[p], st);
+    set->player_count = st->player_count;
+    set->frame_ns = st->frame_ns;
+    set->scroll = st->scroll;
+    set->tick = st->tick++;
+    set->show_debug = st->debug.show;
+}
@@ -0,0 +1,270 @@
+#ifndef STATE_ENGINE_H
+#define STATE_ENGINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "input_edge.h"
+#include "motion.h"
+#include "socd.h"
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+// 入力ログと軌跡の状態管理
+// raylibに依存しない純粋な処理だけをまとめ、画面なしで計測や再生ができるようにしている。
+
+#define MAX_LOG 22        // 最大入力ログ表示数。画面の縦幅に併せた件数にする
+#define MAX_TRAJECTORY 15 // 最大レバー軌跡数。描画の負担にならない程度にする
+#define MAX_FRAME_COUNT 1000
+#define RESET_FRAME_COUNT 1800 // 30秒間無操作（約1800フレーム）でリセット
+#define MAX_DURATION_TENTHS 0xFFFF // 1/10フレーム単位の継続時間の上限
+
+#define LOG_HISTORY 4096 // 2のべき乗。1プレイヤーあたりに保持する入力ログ数
+#define LOG_HISTORY_MASK (LOG_HISTORY - 1)
+#define LOG_SCROLL_PAGE (MAX_LOG - 1) // スクロール1回で移動する行数。1行は前の画面と重ねる
+#define TRAJECTORY_MASK ((1ULL << (4 * MAX_TRAJECTORY)) - 1) // 4ビットずつ詰めた軌跡の有効範囲
+#define TRAIL_POINTS 32              // 2のべき乗。入力ごとの高解像度軌跡の点数の上限（線分は1つ少ない）
+#define TRAIL_MERGE_NS 4000000ULL    // 直前の点からこの時間内のレバー変化は直前の点を置き換えて間引く
+#define TRAIL_FADE_NS 250000000ULL   // 高解像度軌跡が消えるまでの時間（約15フレーム）
+
+// レバー状態とボタン状態の構造体
+// コードポイントキャッシュから文字列を解決するためのインデックスで構成し、16ビットに収めている。
+// 継続フレームカウントは持たず、ログの開始時刻の差から求める。
+typedef struct
+{
+    unsigned short int dir_index : 4; // 上下左右状態のビット値を合成した計算省略用フィールド
+    unsigned short int btn_index : 4; // ABCD状態のビット値を合成した計算省略用フィールド
+    unsigned short int motion : 6;    // この方向で完成したコマンドの番号+1（0なら認識なし）
+    unsigned short int used : 1;      // ログのある行（描画用に切り出した空の行は0）
+} LogState;
+
+_Static_assert(sizeof(LogState) == 2, "log entries are 16 bits");
+_Static_assert(4 * MAX_TRAJECTORY <= 64, "the trajectory fits in one 64-bit word");
+
+/**
+ * @brief 各ビット値の合計フィールドを比較して同値なら真値を返す。
+ */
+static inline bool is_neutral(const LogState *a)
+{
+    return a->dir_index == 0 && a->btn_index == 0;
+}
+
+/**
+ * @brief 各ビット値の合計フィールドを比較して同値なら真値を返す。
+ */
+static inline bool is_equal_state(const LogState *a, const LogState *b)
+{
+    return a->dir_index == b->dir_index && a->btn_index == b->btn_index;
+}
+
+/**
+ * @brief 入力ワードと解決済みのレバー状態からログ状態構造体へ変換する。
+ *        ボタン状態はワードのニブルをそのまま使う。
+ */
+static inline LogState log_state_from_word(uint16_t word, uint8_t dir)
+{
+    return (LogState){.dir_index = dir, .btn_index = (word & INPUT_BTN_MASK) >> INPUT_BTN_SHIFT, .used = 1};
+}
+
+/**
+ * @brief 4ビットずつ詰めた軌跡に最新のレバー状態を追加する。最も古いものは押し出される。
+ */
+static inline uint64_t traj_push(uint64_t traj, unsigned dir)
+{
+    return (traj << 4 | dir) & TRAJECTORY_MASK;
+}
+
+/**
+ * @brief 4ビットずつ詰めた軌跡から k 個前（0が最新）のレバー状態を取り出す。
+ */
+static inline unsigned traj_at(uint64_t traj, int k)
+{
+    return (traj >> (4 * k)) & 0xF;
+}
+
+/**
+ * @brief 経過時間を1/10フレーム単位の継続時間に換算する。frame_nsは表示に使う1フレームの長さ。
+ */
+static inline uint32_t log_duration_tenths(uint64_t elapsed_ns, double frame_ns)
+{
+    double tenths = elapsed_ns * 10.0 / frame_ns;
+    return tenths < MAX_DURATION_TENTHS ? (uint32_t)tenths : MAX_DURATION_TENTHS;
+}
+
+/**
+ * @brief 1/10フレーム単位の継続時間を表示するフレームカウントにする。
+ *        始まったフレームを1と数えるため切り上げ、1～MAX_FRAME_COUNTに収める。
+ */
+static inline unsigned log_count_from_tenths(uint32_t tenths)
+{
+    unsigned count = (tenths + 9) / 10;
+    return count < 1 ? 1 : count > MAX_FRAME_COUNT ? MAX_FRAME_COUNT : count;
+}
+
+// デバッグ表示はスタート+セレクト同時押しのトグル方式になるため
+// トグル用に前回状態を保存することと
+// 入力検知からの状態変更、表示スレッドへ順に連携させていく必要がある
+typedef struct
+{
+    bool show;      // デバッグ状態のフラグ本体
+    bool triggered; // 更新トリガー用のバッファ
+    bool prev;      // 前回状態
+} DebugToggle;
+
+/**
+ * @brief スタート+セレクト同時押しの立ち上がりでデバッグ表示を切り替える。
+ */
+static inline void debug_toggle_update(DebugToggle *d, bool cur_debug_state)
+{
+    if (cur_debug_state && !d->prev && !d->triggered)
+    {
+        d->show ^= 1;
+        d->triggered = true;
+    }
+    if (!cur_debug_state)
+        d->triggered = false;
+    d->prev = cur_debug_state;
+}
+
+// 入力ログのリングバッファ
+// 追加は書き込み位置を進めるだけで、ログが増えても移動やメモリ確保をしない。古いものから上書きする。
+// リセットしても履歴は消さず、通常表示の起点（base）だけを進めるため、スクロールで前のラウンドまで遡れる。
+// 常に1件以上あり、最新のログは (count - 1) の位置にある。
+// 各ログには開始時刻を持たせ、フレームカウントは描画スレッドへ渡すときに次のログの開始時刻との差から求める。
+// 継続中の最新のログのカウントは描画するときに現在時刻から求めるため、入力がなければ状態の更新は要らない。
+typedef struct
+{
+    LogState entries[LOG_HISTORY];
+    uint64_t start_ns[LOG_HISTORY]; // ログごとの開始時刻（CLOCK_MONOTONIC）
+    uint32_t count;                 // 追加した通算の件数
+    uint32_t base;                  // 通常表示で最古となるログの通し番号
+} LogRing;
+
+/**
+ * @brief 最新のログを返す。
+ */
+static inline LogState *log_ring_top(LogRing *log)
+{
+    return &log->entries[(log->count - 1) & LOG_HISTORY_MASK];
+}
+
+/**
+ * @brief 最新のログの開始時刻を返す。
+ */
+static inline uint64_t log_ring_top_start(const LogRing *log)
+{
+    return log->start_ns[(log->count - 1) & LOG_HISTORY_MASK];
+}
+
+/**
+ * @brief ログを追加する。
+ */
+static inline void log_ring_push(LogRing *log, const LogState *entry, uint64_t start_ns)
+{
+    log->entries[log->count & LOG_HISTORY_MASK] = *entry;
+    log->start_ns[log->count & LOG_HISTORY_MASK] = start_ns;
+    log->count++;
+}
+
+/**
+ * @brief 保持している履歴の件数を返す。
+ */
+static inline uint32_t log_ring_available(const LogRing *log)
+{
+    return log->count < LOG_HISTORY ? log->count : LOG_HISTORY;
+}
+
+// 高解像度軌跡の1点
+// レバーがその位置に入った時刻と位置（レバー状態のビット値）。
+typedef struct
+{
+    uint64_t time_ns;
+    uint8_t dir;
+} TrailPoint;
+
+// 高解像度軌跡のリングバッファ
+// tickごとの軌跡と違い、入力のたびにレバー位置が変わったときだけ点を追加する。
+// 短時間の変化は間引き、古い点は上書きするため点数は TRAIL_POINTS を超えない。
+typedef struct
+{
+    uint32_t count; // 追加した点の総数（単調増加）
+    TrailPoint points[TRAIL_POINTS];
+} TrailRing;
+
+// 描画スレッドへ渡す1プレイヤー分の状態
+// 軌跡は64ビットに詰めた値、入力ログはリングバッファから表示する範囲だけを切り出した16ビットの固定長配列。
+// 添え字が少ないほど最新のもので、フレームカウントは tenths から求める。継続中の最新ログの tenths は公開した時点の値で、
+// 描画側は top_start_ns から描画する時点のカウントを求め直す。
+// 一定時間入力がない場合はデータ初期化のうえ描画を抑制して可視性をよくする。
+// プレイヤーごとにキャッシュライン境界から始め、描画側がプレイヤー単位で読むときに隣と混ざらないようにする。
+typedef struct
+{
+    _Alignas(CACHE_LINE_SIZE) uint64_t traj; // 軌跡データ（4ビットずつ、最下位が最新。traj_atで取り出す）
+    LogState log[MAX_LOG];                   // 入力ログデータ
+    bool drawable;                           // 描画するかどうかのbool値
+    unsigned long log_gen;                   // ログの追加やリセットのたびに増える世代番号
+    uint32_t history;                        // 保持している履歴の件数
+    uint16_t word;                           // 現在の入力ワード
+    bool top_open;                           // log[0]が継続中（遡って表示しているときは偽）
+    uint64_t top_start_ns;                   // log[0]の開始時刻
+    uint16_t tenths[MAX_LOG];                // ログの継続時間（1/10フレーム単位）
+    uint8_t trail_count;                     // 高解像度軌跡の点数
+    TrailPoint trail[TRAIL_POINTS];          // 消えるまでの時間内の高解像度軌跡（新しい順）
+} PlayerDrawable;
+
+// 描画スレッドと状態更新スレッド用の中間バッファ
+// プレイヤーごとの状態は player_count 人分だけ書き込む。
+typedef struct
+{
+    int player_count;                         // 有効なプレイヤー数
+    unsigned long tick;                       // 公開したtick番号
+    uint64_t trace_end;                       // 遅延トレースの公開済みの次の番号
+    bool show_debug;                          // デバッグ表示の有無
+    uint32_t scroll;                          // 履歴を遡って表示している行数（0なら通常表示）
+    double frame_ns;                          // フレームカウントの1フレームの長さ
+    PlayerDrawable players[INPUT_MAX_PLAYERS];
+} DrawableSet;
+
+// 状態管理スレッドが保持する1プレイヤー分の状態
+// tickごとにプレイヤーを順に処理するため、1人分をまとめてキャッシュライン境界に揃えている。
+// 毎tick触る値を先頭に置き、ログ本体はその後ろに続ける。
+typedef struct
+{
+    _Alignas(CACHE_LINE_SIZE) bool visible;   // 入力もしくはDELのあと表示中。無操作でのリセット後は偽
+    uint16_t word;
+    uint8_t raw_dir;                          // 直前の生のレバー状態
+    uint8_t resolved_dir;                     // 直前の解決済みのレバー状態
+    unsigned long log_gen;
+    uint64_t trajectory;                      // 軌跡（4ビットずつ、最下位が最新）
+    TrailRing trail;                          // 入力ごとの高解像度軌跡
+    MotionTracker motion;                     // コマンドの認識状態
+    LogRing log;
+} PlayerState;
+
+// 状態管理スレッドが保持する状態
+// セッション記録の再生でも同じ処理で状態を進めるため、スレッドの外にまとめている。
+typedef struct
+{
+    int player_count;               // 有効なプレイヤー数。範囲外のプレイヤーのエッジは無視する
+    uint16_t system_word;
+    uint32_t debug_combo_players;   // スタート+セレクトを押しているプレイヤーのビットマスク
+    uint32_t scroll;                // 履歴を遡って表示している行数
+    unsigned long tick;
+    DebugToggle debug;
+    SocdPolicy socd_policy;         // レバーの同時入力の解決方式
+    double frame_ns;                // フレームカウントの1フレームの長さ
+    uint64_t idle_ns;               // ニュートラルのままこの時間が経つとリセットする（RESET_FRAME_COUNT tick）
+    uint64_t now_ns;                // 直近のtickの時刻
+    uint64_t log_resets;            // DELもしくは無操作でログをリセットした回数（全プレイヤーの合計）
+    const MotionTable *motions;     // コマンドの認識に使うオートマトン（NULLなら認識しない）
+    PlayerState players[INPUT_MAX_PLAYERS];
+} StateContext;
+
+bool update_log(LogRing *log, const LogState *new_log, uint64_t time_ns);
+void trail_ring_add(TrailRing *trail, uint8_t dir, uint64_t time_ns);
+void state_context_init(StateContext *st, SocdPolicy socd_policy, int player_count, double tick_ns, double frame_ns);
+void state_context_tick(StateContext *st, const InputEdge *edges, int edge_count, uint64_t now_ns);
+void state_context_publish(StateContext *st, DrawableSet *set);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef TEXT_CACHE_H
+#define TEXT_CACHE_H
+
+#include "draw_list.h"
+#include "state_engine.h"
+
+// 入力ログ表示に使う文字列キャッシュ
+// フォントの読み込み、文字幅の計測、グリフの矩形の計算はすべてビルド時に input_dispi_font_bake で行い、
+// フォントアトラスとあわせて生成ヘッダ（font_baked.h）の定数表にする。
+// 実行時はフォントの解析も文字列ごとのメモリ確保もせず、表をそのまま参照する。
+//
+// [入力ログ表示の仕様]
+// 000 →ABCD
+// ~~~ ~~~~~~
+//  |   |
+//  |   `----- 最大5文字: レバー状態とボタンの組み合わせ
+//  `--------- 最大3文字: 000～999もしくはLOT（--subframe では100フレーム未満を0.0～99.9の4文字）
+
+#define FONT_SIZE 32
+#define FONT_GLYPH_PADDING 4 // raylibのLoadFontExと同じグリフ間の余白
+
+// 表示に使う文字。ここに含まれる文字だけをフォントアトラスに入れる
+#define TEXT_CACHE_CHARSET "•・↖↗↙↘↑↓←→ABCD0123456789.LOT[]あいうえお"
+
+#define COUNT_CACHE_SIZE (MAX_FRAME_COUNT + 1) // フレームカウント文字列000～999およびLOTのキャッシュ数
+#define SUBFRAME_CACHE_SIZE 1000               // 1/10フレーム単位のカウント文字列0.0～99.9のキャッシュ数
+#define DIR_STATE_COUNT 16                     // レバー状態ビット構成の0～Fにあわせた上下左右文字のキャッシュ数
+#define BTN_STATE_COUNT 16                     // ボタン状態ビット構成の0～Fにあわせたボタン文字のキャッシュ数
+#define CACHED_TEXT_MAX_GLYPHS 4
+
+// 文字キャッシュ構造体
+// 寄せ位置計算用の文字列幅と、描画位置からの相対座標で表したグリフの矩形を保持する。
+typedef struct
+{
+    char text[5];   // 元文字列（確認用）
+    float width;    // 寄せ位置計算用の文字列幅
+    int quad_count; // 描画する矩形の数
+    GlyphQuad quads[CACHED_TEXT_MAX_GLYPHS];
+} CachedText;
+
+// 全文字列キャッシュ
+typedef struct
+{
+    CachedText count[COUNT_CACHE_SIZE];
+    CachedText subframe[SUBFRAME_CACHE_SIZE];
+    CachedText dir[DIR_STATE_COUNT];
+    CachedText button[BTN_STATE_COUNT];
+} TextCaches;
+
+#endif
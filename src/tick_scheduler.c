@@ -0,0 +1,155 @@
+#include "tick_scheduler.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+/**
+ * https://wiki.neogeodev.org/index.php?title=Framerate
+ * ネオジオの周波数に合わせた周期を名前で選べるようにしておく。
+ */
+static const struct
+{
+    const char *name;
+    double period_ns;
+} named_rates[] = {
+    {"mvs", 16896002.0}, // 59.1856
+    {"aes", 16778805.0}, // 59.599
+    {"60", 16666666.0},  // 60FPS
+};
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t deadline_ns(const TickScheduler *s, uint64_t tick)
+{
+    return s->epoch_ns + (uint64_t)((long double)tick * s->period_ns);
+}
+
+/**
+ * @brief mvs/aes/60 もしくはHz単位の数値からtick周期を求める。
+ */
+bool tick_scheduler_parse_rate(const char *s, double *period_ns)
+{
+    for (size_t i = 0; i < sizeof(named_rates) / sizeof(named_rates[0]); i++)
+    {
+        if (strcmp(s, named_rates[i].name) == 0)
+        {
+            *period_ns = named_rates[i].period_ns;
+            return true;
+        }
+    }
+    char *end;
+    double hz = strtod(s, &end);
+    if (end == s || *end != '\0' || hz < 1.0 || hz > 10000.0)
+        return false;
+    *period_ns = 1e9 / hz;
+    return true;
+}
+
+void tick_scheduler_init(TickScheduler *s, double period_ns)
+{
+    memset(s, 0, sizeof(*s));
+    s->period_ns = period_ns;
+}
+
+/**
+ * @brief 現在時刻を基準時刻にしてtickを開始する。0番目のtickは即時とする。
+ */
+void tick_scheduler_start(TickScheduler *s)
+{
+    s->epoch_ns = now_ns();
+    s->tick = 0;
+    atomic_store(&s->last_ns, s->epoch_ns);
+    atomic_store(&s->ticks, 1);
+}
+
+/**
+ * @brief 期限を過ぎたtickの起床遅れを集計して返す。
+ *        大きく遅れたときは飛ばしたtickを数えて、現在時刻に合う位相から再開する。
+ */
+static uint64_t account_tick(TickScheduler *s, uint64_t deadline)
+{
+    uint64_t now = now_ns();
+    uint64_t late = now > deadline ? now - deadline : 0;
+    if (late > s->period_ns * TICK_SCHEDULER_MAX_CATCHUP)
+    {
+        uint64_t current = (uint64_t)((now - s->epoch_ns) / s->period_ns);
+        atomic_fetch_add_explicit(&s->skipped, current - s->tick, memory_order_relaxed);
+        s->tick = current;
+    }
+
+    atomic_fetch_add_explicit(&s->ticks, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->late_total_ns, late, memory_order_relaxed);
+    if (late > TICK_SCHEDULER_LATE_NS)
+        atomic_fetch_add_explicit(&s->late_ticks, 1, memory_order_relaxed);
+    if (late > atomic_load_explicit(&s->late_max_ns, memory_order_relaxed))
+        atomic_store_explicit(&s->late_max_ns, late, memory_order_relaxed);
+    atomic_store_explicit(&s->last_ns, now, memory_order_relaxed);
+    return late;
+}
+
+/**
+ * @brief 次のtickの期限まで絶対時刻で待ち、起床遅れを返す。
+ */
+uint64_t tick_scheduler_wait(TickScheduler *s)
+{
+    s->tick++;
+    uint64_t deadline = deadline_ns(s, s->tick);
+    struct timespec ts = {.tv_sec = deadline / 1000000000ULL, .tv_nsec = deadline % 1000000000ULL};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+    return account_tick(s, deadline);
+}
+
+/**
+ * @brief 次のtickの期限をtimerfdに絶対時刻で設定する。
+ *        周期が整数のナノ秒にならないため、間隔タイマーではなく毎回期限を設定し直す。
+ */
+bool tick_scheduler_arm(TickScheduler *s, int timer_fd)
+{
+    uint64_t deadline = deadline_ns(s, s->tick + 1);
+    struct itimerspec its = {.it_value = {.tv_sec = deadline / 1000000000ULL, .tv_nsec = deadline % 1000000000ULL}};
+    return timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0;
+}
+
+/**
+ * @brief tick_scheduler_arm で設定した期限が来たときに呼び、起床遅れを返す。
+ */
+uint64_t tick_scheduler_expired(TickScheduler *s)
+{
+    s->tick++;
+    return account_tick(s, deadline_ns(s, s->tick));
+}
+
+/**
+ * @brief 開始からの実測tickレートを返す。
+ */
+double tick_scheduler_measured_hz(TickScheduler *s)
+{
+    uint64_t last = atomic_load_explicit(&s->last_ns, memory_order_relaxed);
+    uint64_t ticks = atomic_load_explicit(&s->ticks, memory_order_relaxed);
+    if (last <= s->epoch_ns || ticks < 2)
+        return 0.0;
+    return (ticks - 1) * 1e9 / (double)(last - s->epoch_ns);
+}
+
+/**
+ * @brief 実測レートと起床遅れの統計を出力する。
+ */
+void tick_scheduler_report(TickScheduler *s, FILE *fp)
+{
+    uint64_t ticks = atomic_load(&s->ticks);
+    fprintf(fp, "[info] tick rate: %.4f Hz (target %.4f Hz), ticks %llu, skipped %llu\n",
+            tick_scheduler_measured_hz(s), 1e9 / s->period_ns,
+            (unsigned long long)ticks, (unsigned long long)atomic_load(&s->skipped));
+    fprintf(fp, "[info] tick lateness: max %.1f us, mean %.1f us\n",
+            atomic_load(&s->late_max_ns) / 1e3,
+            ticks ? atomic_load(&s->late_total_ns) / 1e3 / ticks : 0.0);
+}
@@ -0,0 +1,37 @@
+#ifndef TICK_SCHEDULER_H
+#define TICK_SCHEDULER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TICK_SCHEDULER_MAX_CATCHUP 30 // これ以上遅れたら追いつくのをあきらめて位相を合わせ直すtick数
+#define TICK_SCHEDULER_LATE_NS 1000000 // これより遅れて起床したtickを遅延として数える
+
+// 固定の基準時刻からの絶対時刻でtickを刻むスケジューラ
+// n番目のtickの期限は「基準時刻 + n × 周期」で求めるため、寝過ごしても誤差が積み上がらない。
+// 統計値は描画スレッドからも読むためアトミックにしている。
+typedef struct
+{
+    double period_ns;           // tick周期
+    uint64_t epoch_ns;          // 基準時刻（CLOCK_MONOTONIC）
+    uint64_t tick;              // 直近に待ったtick番号
+    atomic_uint_fast64_t ticks; // 実行したtick数
+    atomic_uint_fast64_t skipped;      // 追いつけずに飛ばしたtick数
+    atomic_uint_fast64_t late_ticks;   // TICK_SCHEDULER_LATE_NS より遅れて起床したtick数
+    atomic_uint_fast64_t late_max_ns;  // 最大の起床遅れ
+    atomic_uint_fast64_t late_total_ns; // 起床遅れの合計
+    atomic_uint_fast64_t last_ns;      // 直近の起床時刻
+} TickScheduler;
+
+bool tick_scheduler_parse_rate(const char *s, double *period_ns);
+void tick_scheduler_init(TickScheduler *s, double period_ns);
+void tick_scheduler_start(TickScheduler *s);
+uint64_t tick_scheduler_wait(TickScheduler *s);
+bool tick_scheduler_arm(TickScheduler *s, int timer_fd);
+uint64_t tick_scheduler_expired(TickScheduler *s);
+double tick_scheduler_measured_hz(TickScheduler *s);
+void tick_scheduler_report(TickScheduler *s, FILE *fp);
+
+#endif
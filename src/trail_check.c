@@ -0,0 +1,167 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "draw_list.h"
+#include "soft_raster.h"
+#include "state_engine.h"
+
+// 高解像度軌跡の確認用プログラム
+// 軌跡のリングバッファに決まった順で点を追加し、短時間の変化の置き換え、一瞬の寄り道の取り消し、
+// 点数の上限を確かめる。あわせて状態管理の処理にエッジを通し、消えるまでの時間内の点だけが新しい順に
+// 公開されることと、DELでのリセットで軌跡が消えることを確かめる。
+// 最後に折れ線を画面なしの描画で塗り、端の色と線の外側の画素を確かめる。
+
+#define MS 1000000ULL
+
+static int failures;
+
+static void expect(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("[error] %s\n", what);
+        failures++;
+    }
+}
+
+/**
+ * @brief 軌跡の点を古い順にn個取り出して比べる。
+ */
+static bool trail_equals(const TrailRing *trail, const uint8_t *dirs, const uint64_t *times, uint32_t n)
+{
+    if (trail->count != n)
+        return false;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const TrailPoint *p = &trail->points[i & (TRAIL_POINTS - 1)];
+        if (p->dir != dirs[i] || p->time_ns != times[i])
+            return false;
+    }
+    return true;
+}
+
+static void check_ring(void)
+{
+    TrailRing trail = {0};
+    trail_ring_add(&trail, 0, 0);
+    trail_ring_add(&trail, 0, 10 * MS);
+    expect(trail_equals(&trail, (uint8_t[]){0}, (uint64_t[]){0}, 1), "ring: the same position adds a point");
+
+    // 斜めの2つのキーのずれ: 下から4ms以内に右下になれば下の点を右下に置き換える
+    trail_ring_add(&trail, INPUT_BIT_DOWN, 100 * MS);
+    trail_ring_add(&trail, INPUT_BIT_DOWN | INPUT_BIT_RIGHT, 102 * MS);
+    expect(trail_equals(&trail, (uint8_t[]){0, INPUT_BIT_DOWN | INPUT_BIT_RIGHT}, (uint64_t[]){0, 100 * MS}, 2),
+           "ring: a change within the merge window does not replace the previous point");
+
+    // 間引く時間を過ぎた変化は新しい点になる
+    trail_ring_add(&trail, INPUT_BIT_RIGHT, 102 * MS + TRAIL_MERGE_NS);
+    expect(trail.count == 3, "ring: a change after the merge window does not add a point");
+
+    // 一瞬の寄り道: 上へ動いて4ms以内に右へ戻れば上の点を取り消す
+    trail_ring_add(&trail, INPUT_BIT_UP, 200 * MS);
+    trail_ring_add(&trail, INPUT_BIT_RIGHT, 203 * MS);
+    expect(trail.count == 3 && trail.points[2].dir == INPUT_BIT_RIGHT && trail.points[2].time_ns == 102 * MS + TRAIL_MERGE_NS,
+           "ring: a blip that returns to the previous position is not dropped");
+
+    // リセットした後の同じtickのエッジは直前の点の時刻にそろえ、時刻を戻さない（同時刻なので置き換えになる）
+    trail_ring_add(&trail, INPUT_BIT_LEFT, 50 * MS);
+    expect(trail.count == 3 && trail.points[2].dir == INPUT_BIT_LEFT && trail.points[2].time_ns == 102 * MS + TRAIL_MERGE_NS,
+           "ring: an edge older than the last point moves time backwards");
+
+    // 点数の上限を超えると古い点から上書きする
+    TrailRing full = {0};
+    for (int i = 0; i < TRAIL_POINTS + 8; i++)
+        trail_ring_add(&full, i & 1 ? INPUT_BIT_UP : INPUT_BIT_DOWN, (uint64_t)i * 10 * MS);
+    const TrailPoint *oldest = &full.points[full.count & (TRAIL_POINTS - 1)];
+    expect(full.count == TRAIL_POINTS + 8 && oldest->time_ns == 8 * 10 * MS,
+           "ring: the oldest points are not overwritten once the ring is full");
+}
+
+static void check_state(void)
+{
+    static StateContext st;
+    static DrawableSet set;
+    state_context_init(&st, SOCD_CANCEL, 1, 16 * MS, 16 * MS);
+
+    // 0msのtickでニュートラルの点、10msに右、20msにニュートラルへ戻る
+    InputEdge edges[] = {
+        {.time_ns = 10 * MS, .word = INPUT_BIT_RIGHT},
+        {.time_ns = 20 * MS, .word = 0},
+    };
+    state_context_tick(&st, NULL, 0, 0);
+    state_context_publish(&st, &set);
+    state_context_tick(&st, edges, 2, 32 * MS);
+    state_context_publish(&st, &set);
+    const PlayerDrawable *pd = &set.players[0];
+    expect(pd->trail_count == 3 && pd->trail[0].dir == 0 && pd->trail[0].time_ns == 20 * MS &&
+               pd->trail[1].dir == INPUT_BIT_RIGHT && pd->trail[1].time_ns == 10 * MS && pd->trail[2].time_ns == 0,
+           "state: the published trail is not the three points, newest first");
+
+    // 点はその位置を離れてから TRAIL_FADE_NS の間だけ渡す。最新の点は離れていないので残る
+    state_context_tick(&st, NULL, 0, 10 * MS + TRAIL_FADE_NS - 1);
+    state_context_publish(&st, &set);
+    expect(pd->trail_count == 3, "state: a point left just inside the fade window is not published");
+    state_context_tick(&st, NULL, 0, 10 * MS + TRAIL_FADE_NS);
+    state_context_publish(&st, &set);
+    expect(pd->trail_count == 2, "state: a point left one fade window ago is still published");
+    state_context_tick(&st, NULL, 0, 20 * MS + TRAIL_FADE_NS);
+    state_context_publish(&st, &set);
+    expect(pd->trail_count == 1 && pd->trail[0].time_ns == 20 * MS,
+           "state: the current position is not published after the others faded");
+
+    // DELでのリセットで軌跡は消え、押し続けている向きから始め直す
+    InputEdge hold = {.time_ns = 400 * MS, .word = INPUT_BIT_LEFT};
+    InputEdge del[] = {
+        {.time_ns = 500 * MS, .word = INPUT_SYS_DELETE, .player = INPUT_PLAYER_SYSTEM},
+        {.time_ns = 501 * MS, .word = 0, .player = INPUT_PLAYER_SYSTEM},
+    };
+    state_context_tick(&st, &hold, 1, 416 * MS);
+    state_context_publish(&st, &set);
+    state_context_tick(&st, del, 2, 512 * MS);
+    state_context_publish(&st, &set);
+    expect(pd->trail_count == 1 && pd->trail[0].dir == INPUT_BIT_LEFT && pd->trail[0].time_ns == 512 * MS,
+           "state: DEL does not restart the trail from the held direction");
+}
+
+static void check_raster(void)
+{
+    static DrawList list;
+    SoftCanvas canvas;
+    if (!soft_canvas_init(&canvas, 100, 20))
+    {
+        expect(false, "raster: cannot allocate the canvas");
+        return;
+    }
+    const DrawColor red = {0xFF, 0, 0, 0xFF}, blue = {0, 0, 0xFF, 0xFF};
+    const DrawVertex vertices[] = {{10, 10, red}, {50, 10, red}, {90, 10, blue}};
+    draw_list_reset(&list);
+    draw_list_polyline(&list, vertices, 3, 4);
+    expect(list.count == 1 && list.vertex_count == 3, "raster: the polyline is not one command with three vertices");
+    soft_raster_execute(&canvas, &list, NULL, NULL);
+
+    const uint8_t *start = &canvas.rgba[(10 * canvas.width + 12) * 4];
+    const uint8_t *end = &canvas.rgba[(10 * canvas.width + 88) * 4];
+    const uint8_t *middle = &canvas.rgba[(10 * canvas.width + 70) * 4];
+    const uint8_t *outside = &canvas.rgba[(16 * canvas.width + 50) * 4];
+    expect(start[0] == 0xFF && start[2] == 0 && start[3] == 0xFF, "raster: the start of the trail is not the first colour");
+    expect(end[2] > 0xF0 && end[0] < 0x10, "raster: the end of the trail is not the last colour");
+    expect(middle[0] > 0x60 && middle[2] > 0x60, "raster: the colour is not blended along the segment");
+    expect(outside[3] == 0, "raster: pixels outside the thickness are drawn");
+    soft_canvas_free(&canvas);
+}
+
+int main(void)
+{
+    check_ring();
+    check_state();
+    check_raster();
+    if (failures)
+    {
+        printf("[error] %d trail checks failed\n", failures);
+        return 1;
+    }
+    printf("[info] trail merge, blip removal, fade window, reset and polyline raster checks passed\n");
+    return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+#define TRIPLE_BUFFER_FRESH 0x4 // 中間バッファに未読の公開データがあることを示すビット
+#define TRIPLE_BUFFER_INDEX 0x3
+
+// 書き込み側1つと読み出し側1つの間で最新の状態を受け渡すトリプルバッファ
+// 実データは呼び出し側が3つ分の配列として持ち、ここではその添え字だけを管理する。
+// 書き込み側は back、読み出し側は front を専有し、middle との交換だけをアトミックに行うため、
+// どちらも相手を待つことはなく、読み出し側は常に最後に公開された完全な状態を得られる。
+typedef struct
+{
+    _Alignas(CACHE_LINE_SIZE) atomic_uint middle; // 添え字 + TRIPLE_BUFFER_FRESH
+    _Alignas(CACHE_LINE_SIZE) unsigned back;      // 書き込み側専用
+    _Alignas(CACHE_LINE_SIZE) unsigned front;     // 読み出し側専用
+} TripleBuffer;
+
+static inline void triple_buffer_init(TripleBuffer *tb)
+{
+    tb->front = 0;
+    atomic_init(&tb->middle, 1);
+    tb->back = 2;
+}
+
+/**
+ * @brief 書き込み側が次に書き込むバッファの添え字を返す。
+ */
+static inline unsigned triple_buffer_write_index(const TripleBuffer *tb)
+{
+    return tb->back;
+}
+
+/**
+ * @brief 書き込み済みのバッファを公開し、空いたバッファを次の書き込み先にする。
+ */
+static inline void triple_buffer_publish(TripleBuffer *tb)
+{
+    unsigned old = atomic_exchange_explicit(&tb->middle, tb->back | TRIPLE_BUFFER_FRESH, memory_order_acq_rel);
+    tb->back = old & TRIPLE_BUFFER_INDEX;
+}
+
+/**
+ * @brief 新しく公開されたバッファがあれば受け取り、読み出し側のバッファの添え字を返す。
+ *        新しいものがなければ前回と同じバッファを返す。
+ */
+static inline unsigned triple_buffer_read_index(TripleBuffer *tb, bool *updated)
+{
+    bool fresh = atomic_load_explicit(&tb->middle, memory_order_relaxed) & TRIPLE_BUFFER_FRESH;
+    if (fresh)
+    {
+        unsigned old = atomic_exchange_explicit(&tb->middle, tb->front, memory_order_acq_rel);
+        tb->front = old & TRIPLE_BUFFER_INDEX;
+    }
+    if (updated)
+        *updated = fresh;
+    return tb->front;
+}
+
+#endif